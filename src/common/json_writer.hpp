@@ -0,0 +1,170 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __JSON_WRITER_HPP__
+#define __JSON_WRITER_HPP__
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+
+namespace mesos {
+namespace internal {
+
+// Writes JSON directly into a string as it gets generated, rather
+// than first building a tree of JSON::Value's (see stout/json.hpp)
+// and then rendering it, which matters for big documents like the
+// master's state.json. Keys and values must be written in order,
+// e.g.:
+//
+//   JsonWriter writer(&out);
+//   writer.beginObject();
+//   writer.field("id", "1");
+//   writer.key("tasks");
+//   writer.beginArray();
+//   ...
+//   writer.endArray();
+//   writer.endObject();
+//
+// Strings and numbers get rendered exactly as JSON::render renders
+// them (with the exception that keys get escaped too).
+class JsonWriter
+{
+public:
+  explicit JsonWriter(std::string* _out) : out(_out), keyed(false) {}
+
+  void beginObject()
+  {
+    separate();
+    out->push_back('{');
+    first.push_back(true);
+  }
+
+  void endObject()
+  {
+    CHECK(!first.empty() && !keyed);
+    first.pop_back();
+    out->push_back('}');
+  }
+
+  void beginArray()
+  {
+    separate();
+    out->push_back('[');
+    first.push_back(true);
+  }
+
+  void endArray()
+  {
+    CHECK(!first.empty() && !keyed);
+    first.pop_back();
+    out->push_back(']');
+  }
+
+  // Writes the key for the next value of an object.
+  void key(const std::string& key)
+  {
+    CHECK(!keyed);
+    separate();
+    escape(key);
+    out->push_back(':');
+    keyed = true;
+  }
+
+  void value(const std::string& value)
+  {
+    separate();
+    escape(value);
+  }
+
+  void value(const char* value)
+  {
+    this->value(std::string(value));
+  }
+
+  // Note that like JSON::Number booleans get written as numbers.
+  void value(double value)
+  {
+    separate();
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.10g", value);
+    out->append(buffer);
+  }
+
+  template <typename T>
+  void field(const std::string& key, const T& value)
+  {
+    this->key(key);
+    this->value(value);
+  }
+
+private:
+  JsonWriter(const JsonWriter&);
+  JsonWriter& operator = (const JsonWriter&);
+
+  // Writes a comma if this isn't the first value of the current
+  // object or array (and the value doesn't follow its key).
+  void separate()
+  {
+    if (keyed) {
+      keyed = false;
+    } else if (!first.empty()) {
+      if (!first.back()) {
+        out->push_back(',');
+      }
+      first.back() = false;
+    }
+  }
+
+  // Like JSON::render this escaping DOES NOT handle unicode.
+  void escape(const std::string& s)
+  {
+    out->push_back('"');
+    for (size_t i = 0; i < s.size(); i++) {
+      switch (s[i]) {
+        case '"': out->append("\\\""); break;
+        case '\\': out->append("\\\\"); break;
+        case '/': out->append("\\/"); break;
+        case '\b': out->append("\\b"); break;
+        case '\f': out->append("\\f"); break;
+        case '\n': out->append("\\n"); break;
+        case '\r': out->append("\\r"); break;
+        case '\t': out->append("\\t"); break;
+        default: out->push_back(s[i]); break;
+      }
+    }
+    out->push_back('"');
+  }
+
+  std::string* out;
+
+  // Whether the current object or array (innermost last) is empty.
+  std::vector<bool> first;
+
+  // Whether a key has been written without its value.
+  bool keyed;
+};
+
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __JSON_WRITER_HPP__
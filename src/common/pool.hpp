@@ -0,0 +1,165 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __POOL_HPP__
+#define __POOL_HPP__
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <new>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "common/lock.hpp"
+
+
+namespace mesos {
+namespace internal {
+
+// A pool of objects of type T. Objects get created in slabs of
+// contiguous memory (rather than each getting its own heap
+// allocation) and the memory of destroyed objects gets reused for
+// new objects, so creating and destroying objects at a high rate
+// doesn't fragment the heap. Note that slabs are only freed when
+// the pool is destroyed, so the pool's capacity is the peak number
+// of objects (rounded up to a slab). Objects must be destroyed with
+// the pool that created them (and not deleted). Thread-safe.
+template <typename T>
+class Pool
+{
+public:
+  explicit Pool(size_t _objectsPerSlab = 64)
+    : objectsPerSlab(_objectsPerSlab), live(0)
+  {
+    CHECK(objectsPerSlab > 0);
+    pthread_mutex_init(&mutex, NULL);
+  }
+
+  ~Pool()
+  {
+    // Objects that are still alive keep their slabs from being freed.
+    if (live == 0) {
+      for (size_t i = 0; i < slabs.size(); i++) {
+        free(slabs[i]);
+      }
+    }
+
+    pthread_mutex_destroy(&mutex);
+  }
+
+  T* create()
+  {
+    return new (allocate()) T();
+  }
+
+  template <typename A1>
+  T* create(const A1& a1)
+  {
+    return new (allocate()) T(a1);
+  }
+
+  template <typename A1, typename A2>
+  T* create(const A1& a1, const A2& a2)
+  {
+    return new (allocate()) T(a1, a2);
+  }
+
+  template <typename A1, typename A2, typename A3>
+  T* create(const A1& a1, const A2& a2, const A3& a3)
+  {
+    return new (allocate()) T(a1, a2, a3);
+  }
+
+  template <typename A1, typename A2, typename A3, typename A4>
+  T* create(const A1& a1, const A2& a2, const A3& a3, const A4& a4)
+  {
+    return new (allocate()) T(a1, a2, a3, a4);
+  }
+
+  // Destroys an object created by this pool (NULL is ignored).
+  void destroy(T* t)
+  {
+    if (t != NULL) {
+      t->~T();
+      release(t);
+    }
+  }
+
+  // Returns the number of objects currently created.
+  size_t size() const
+  {
+    Lock lock(&mutex);
+    return live;
+  }
+
+  // Returns the number of objects that fit in the allocated slabs.
+  size_t capacity() const
+  {
+    Lock lock(&mutex);
+    return slabs.size() * objectsPerSlab;
+  }
+
+private:
+  Pool(const Pool<T>&);
+  Pool<T>& operator = (const Pool<T>&);
+
+  void* allocate()
+  {
+    Lock lock(&mutex);
+
+    if (available.empty()) {
+      // Since sizeof(T) is a multiple of the alignment of T, every
+      // object in a (malloc aligned) slab is suitably aligned.
+      char* slab = (char*) malloc(sizeof(T) * objectsPerSlab);
+      CHECK(slab != NULL) << "Failed to allocate a slab";
+      slabs.push_back(slab);
+
+      // Push in reverse so objects get used in address order.
+      for (size_t i = objectsPerSlab; i > 0; i--) {
+        available.push_back(slab + (i - 1) * sizeof(T));
+      }
+    }
+
+    void* memory = available.back();
+    available.pop_back();
+    live++;
+    return memory;
+  }
+
+  void release(void* memory)
+  {
+    Lock lock(&mutex);
+    CHECK(live > 0);
+    available.push_back(memory);
+    live--;
+  }
+
+  const size_t objectsPerSlab;
+
+  mutable pthread_mutex_t mutex;
+  std::vector<char*> slabs;
+  std::vector<void*> available;
+  size_t live;
+};
+
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __POOL_HPP__
@@ -0,0 +1,473 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <pthread.h>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+#include <glog/logging.h>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+
+#include "common/lock.hpp"
+#include "common/resource_vector.hpp"
+
+using std::string;
+using std::vector;
+
+
+namespace mesos {
+namespace internal {
+
+// Interned resource names (one table per Value::Type). Lookups are
+// on the hot path (every Resources to ResourceVector conversion and
+// every 'scalar(name)'), so they don't lock: a table is never
+// modified once it has been published, instead inserting a name
+// copies the table and publishes the copy (under 'mutex', which only
+// serializes the writers). Replaced tables are leaked on purpose
+// since readers might still be using them, but there are only as
+// many of them as there are distinct resource names.
+struct Table
+{
+  hashmap<string, size_t> indices;
+  vector<string> names;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static Table* volatile tables[Value::Type_ARRAYSIZE];
+
+
+// Returns the most recently published table for the specified type,
+// or NULL if no name of that type has been interned yet.
+static const Table* table(const Value::Type& type)
+{
+  const Table* table = tables[type];
+  __sync_synchronize(); // Read the table after the pointer.
+  return table;
+}
+
+
+// Adds the name to a copy of the table (if it isn't already there)
+// and publishes the copy. Must be called with 'mutex' held.
+static void insert(const Value::Type& type, const string& name)
+{
+  const Table* current = tables[type];
+  if (current != NULL && current->indices.contains(name)) {
+    return;
+  }
+
+  Table* copy = current != NULL ? new Table(*current) : new Table();
+  copy->indices[name] = copy->names.size();
+  copy->names.push_back(name);
+
+  __sync_synchronize(); // Write the table before the pointer.
+  tables[type] = copy;
+}
+
+
+// Returns the table for the specified type, creating it if necessary.
+// New tables start out with the standard resource names, so that
+// (most) lookups never have to insert and the standard resources get
+// the same (small) indices in every process.
+static const Table* initialize(const Value::Type& type)
+{
+  const Table* result = table(type);
+  if (result != NULL) {
+    return result;
+  }
+
+  Lock lock(&mutex);
+
+  if (tables[type] == NULL) {
+    if (type == Value::SCALAR) {
+      insert(type, "cpus");
+      insert(type, "mem");
+      insert(type, "disk");
+    } else if (type == Value::RANGES) {
+      insert(type, "ports");
+    } else {
+      tables[type] = new Table();
+    }
+  }
+
+  return table(type);
+}
+
+
+size_t ResourceVector::index(const string& name, const Value::Type& type)
+{
+  const Table* current = initialize(type);
+
+  hashmap<string, size_t>::const_iterator it = current->indices.find(name);
+  if (it != current->indices.end()) {
+    return it->second;
+  }
+
+  Lock lock(&mutex);
+
+  insert(type, name);
+
+  return table(type)->indices.find(name)->second;
+}
+
+
+// Returns the name of the resource with the specified type and index.
+static const string& name(const Value::Type& type, size_t index)
+{
+  const Table* current = table(type);
+
+  CHECK(current != NULL && index < current->names.size());
+  return current->names[index];
+}
+
+
+typedef vector<std::pair<uint64_t, uint64_t> > Intervals;
+
+
+// Sorts the intervals and merges all overlapping (or adjacent) ones.
+static void coalesce(Intervals* intervals)
+{
+  if (intervals->empty()) {
+    return;
+  }
+
+  std::sort(intervals->begin(), intervals->end());
+
+  size_t last = 0;
+  for (size_t i = 1; i < intervals->size(); i++) {
+    std::pair<uint64_t, uint64_t>& current = (*intervals)[last];
+    const std::pair<uint64_t, uint64_t>& next = (*intervals)[i];
+
+    if (current.second == std::numeric_limits<uint64_t>::max() ||
+        next.first <= current.second + 1) {
+      current.second = std::max(current.second, next.second);
+    } else {
+      (*intervals)[++last] = next;
+    }
+  }
+
+  intervals->resize(last + 1);
+}
+
+
+// Removes every interval in 'right' from 'left' (both coalesced).
+static Intervals subtract(const Intervals& left, const Intervals& right)
+{
+  Intervals result;
+
+  size_t j = 0;
+  foreach (const Intervals::value_type& interval, left) {
+    uint64_t begin = interval.first;
+    uint64_t end = interval.second;
+
+    // Skip everything in 'right' before this (and hence every
+    // following) interval.
+    while (j < right.size() && right[j].second < begin) {
+      j++;
+    }
+
+    bool removed = false;
+    for (size_t k = j; k < right.size() && right[k].first <= end; k++) {
+      if (right[k].first > begin) {
+        result.push_back(std::make_pair(begin, right[k].first - 1));
+      }
+
+      if (right[k].second >= end) {
+        removed = true;
+        break;
+      }
+
+      begin = right[k].second + 1;
+    }
+
+    if (!removed) {
+      result.push_back(std::make_pair(begin, end));
+    }
+  }
+
+  return result;
+}
+
+
+// Returns true if every interval in 'left' is within an interval in
+// 'right' (both coalesced).
+static bool contains(const Intervals& right, const Intervals& left)
+{
+  size_t j = 0;
+  foreach (const Intervals::value_type& interval, left) {
+    while (j < right.size() && right[j].second < interval.first) {
+      j++;
+    }
+
+    if (j == right.size() ||
+        right[j].first > interval.first ||
+        right[j].second < interval.second) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+ResourceVector::ResourceVector(const Resources& resources)
+{
+  foreach (const Resource& resource, resources) {
+    add(resource);
+  }
+}
+
+
+ResourceVector::ResourceVector(
+    const google::protobuf::RepeatedPtrField<Resource>& resources)
+{
+  foreach (const Resource& resource, resources) {
+    add(resource);
+  }
+}
+
+
+void ResourceVector::add(const Resource& resource)
+{
+  if (!Resources::isValid(resource)) {
+    return;
+  }
+
+  size_t i = index(resource.name(), resource.type());
+
+  if (resource.type() == Value::SCALAR) {
+    if (scalars.size() <= i) {
+      scalars.resize(i + 1, 0);
+    }
+    scalars[i] += llround(resource.scalar().value() * SCALAR_PRECISION);
+  } else if (resource.type() == Value::RANGES) {
+    if (ranges.size() <= i) {
+      ranges.resize(i + 1);
+    }
+    foreach (const Value::Range& range, resource.ranges().range()) {
+      if (range.begin() <= range.end()) {
+        ranges[i].push_back(std::make_pair(range.begin(), range.end()));
+      }
+    }
+    coalesce(&ranges[i]);
+  } else if (resource.type() == Value::SET) {
+    if (sets.size() <= i) {
+      sets.resize(i + 1);
+    }
+    foreach (const string& item, resource.set().item()) {
+      sets[i].push_back(item);
+    }
+    std::sort(sets[i].begin(), sets[i].end());
+    sets[i].erase(std::unique(sets[i].begin(), sets[i].end()), sets[i].end());
+  }
+}
+
+
+Resources ResourceVector::resources() const
+{
+  google::protobuf::RepeatedPtrField<Resource> result;
+
+  for (size_t i = 0; i < scalars.size(); i++) {
+    if (scalars[i] != 0) {
+      Resource* resource = result.Add();
+      resource->set_name(name(Value::SCALAR, i));
+      resource->set_type(Value::SCALAR);
+      resource->mutable_scalar()->set_value(scalar(i));
+    }
+  }
+
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (!ranges[i].empty()) {
+      Resource* resource = result.Add();
+      resource->set_name(name(Value::RANGES, i));
+      resource->set_type(Value::RANGES);
+      foreach (const Intervals::value_type& interval, ranges[i]) {
+        Value::Range* range = resource->mutable_ranges()->add_range();
+        range->set_begin(interval.first);
+        range->set_end(interval.second);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < sets.size(); i++) {
+    if (!sets[i].empty()) {
+      Resource* resource = result.Add();
+      resource->set_name(name(Value::SET, i));
+      resource->set_type(Value::SET);
+      foreach (const string& item, sets[i]) {
+        resource->mutable_set()->add_item(item);
+      }
+    }
+  }
+
+  return result;
+}
+
+
+ResourceVector ResourceVector::allocatable() const
+{
+  ResourceVector result(*this);
+
+  foreach (int64_t& scalar, result.scalars) {
+    scalar = std::max(scalar, (int64_t) 0);
+  }
+
+  return result;
+}
+
+
+bool ResourceVector::empty() const
+{
+  foreach (int64_t scalar, scalars) {
+    if (scalar != 0) {
+      return false;
+    }
+  }
+
+  foreach (const Intervals& intervals, ranges) {
+    if (!intervals.empty()) {
+      return false;
+    }
+  }
+
+  foreach (const vector<string>& items, sets) {
+    if (!items.empty()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+bool ResourceVector::operator == (const ResourceVector& that) const
+{
+  return *this <= that && that <= *this;
+}
+
+
+bool ResourceVector::operator <= (const ResourceVector& that) const
+{
+  for (size_t i = 0; i < scalars.size(); i++) {
+    if (scalars[i] > (i < that.scalars.size() ? that.scalars[i] : 0)) {
+      return false;
+    }
+  }
+
+  // Missing scalars in this vector are zero.
+  for (size_t i = scalars.size(); i < that.scalars.size(); i++) {
+    if (that.scalars[i] < 0) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (!ranges[i].empty() &&
+        (i >= that.ranges.size() || !contains(that.ranges[i], ranges[i]))) {
+      return false;
+    }
+  }
+
+  for (size_t i = 0; i < sets.size(); i++) {
+    if (!sets[i].empty() &&
+        (i >= that.sets.size() ||
+         !std::includes(that.sets[i].begin(), that.sets[i].end(),
+                        sets[i].begin(), sets[i].end()))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+ResourceVector& ResourceVector::operator += (const ResourceVector& that)
+{
+  if (scalars.size() < that.scalars.size()) {
+    scalars.resize(that.scalars.size(), 0);
+  }
+
+  for (size_t i = 0; i < that.scalars.size(); i++) {
+    scalars[i] += that.scalars[i];
+  }
+
+  if (ranges.size() < that.ranges.size()) {
+    ranges.resize(that.ranges.size());
+  }
+
+  for (size_t i = 0; i < that.ranges.size(); i++) {
+    if (!that.ranges[i].empty()) {
+      ranges[i].insert(
+          ranges[i].end(), that.ranges[i].begin(), that.ranges[i].end());
+      coalesce(&ranges[i]);
+    }
+  }
+
+  if (sets.size() < that.sets.size()) {
+    sets.resize(that.sets.size());
+  }
+
+  for (size_t i = 0; i < that.sets.size(); i++) {
+    if (!that.sets[i].empty()) {
+      vector<string> items;
+      std::set_union(sets[i].begin(), sets[i].end(),
+                     that.sets[i].begin(), that.sets[i].end(),
+                     std::back_inserter(items));
+      sets[i].swap(items);
+    }
+  }
+
+  return *this;
+}
+
+
+ResourceVector& ResourceVector::operator -= (const ResourceVector& that)
+{
+  if (scalars.size() < that.scalars.size()) {
+    scalars.resize(that.scalars.size(), 0);
+  }
+
+  for (size_t i = 0; i < that.scalars.size(); i++) {
+    scalars[i] -= that.scalars[i];
+  }
+
+  for (size_t i = 0; i < std::min(ranges.size(), that.ranges.size()); i++) {
+    if (!ranges[i].empty() && !that.ranges[i].empty()) {
+      ranges[i] = subtract(ranges[i], that.ranges[i]);
+    }
+  }
+
+  for (size_t i = 0; i < std::min(sets.size(), that.sets.size()); i++) {
+    if (!sets[i].empty() && !that.sets[i].empty()) {
+      vector<string> items;
+      std::set_difference(sets[i].begin(), sets[i].end(),
+                          that.sets[i].begin(), that.sets[i].end(),
+                          std::back_inserter(items));
+      sets[i].swap(items);
+    }
+  }
+
+  return *this;
+}
+
+} // namespace internal {
+} // namespace mesos {
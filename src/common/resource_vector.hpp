@@ -0,0 +1,142 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef __RESOURCE_VECTOR_HPP__
+#define __RESOURCE_VECTOR_HPP__
+
+#include <stdint.h>
+
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <mesos/mesos.hpp>
+
+#include "common/resources.hpp"
+
+
+namespace mesos {
+namespace internal {
+
+// A compact (i.e., non protocol buffer) representation of resources
+// used for bookkeeping in the allocator, sorters and master, where
+// resources get added, subtracted and compared far more often than
+// they get sent in messages. Resource names are interned (per type)
+// into small indices so a ResourceVector never stores or compares
+// names. Scalars are stored as fixed point numbers (in units of
+// 1/SCALAR_PRECISION) in a flat array indexed by name, ranges as
+// sorted, coalesced arrays of (inclusive) intervals and sets as
+// sorted arrays of items. Conversions to and from protocol buffers
+// should only happen at message boundaries.
+//
+// Note that unlike Resources a scalar of zero (or a ranges or set
+// without any items) is the same as not having the resource at all.
+class ResourceVector
+{
+public:
+  ResourceVector() {}
+
+  // Implicit so that protocol buffer resources can be used anywhere
+  // a ResourceVector is expected (e.g., 'vector += task.resources()').
+  ResourceVector(const Resources& resources);
+  ResourceVector(
+      const google::protobuf::RepeatedPtrField<Resource>& resources);
+
+  // Returns the protocol buffer representation (e.g., for messages).
+  Resources resources() const;
+
+  // Returns a ResourceVector with only the allocatable resources
+  // (i.e., without any negative scalars).
+  ResourceVector allocatable() const;
+
+  // Returns true if there are no resources, i.e., every scalar is
+  // zero and there are no ranges or sets (see the note above).
+  bool empty() const;
+
+  // Returns the value of the scalar with the specified index (see
+  // ResourceVector::index), or zero if there is no such scalar.
+  double scalar(size_t index) const
+  {
+    return index < scalars.size()
+      ? scalars[index] / (double) SCALAR_PRECISION
+      : 0;
+  }
+
+  double scalar(const std::string& name) const
+  {
+    return scalar(index(name, Value::SCALAR));
+  }
+
+  // Returns a bound on the indices of the scalars in this vector
+  // (for iterating over them using 'scalar(index)').
+  size_t scalarCount() const
+  {
+    return scalars.size();
+  }
+
+  bool operator == (const ResourceVector& that) const;
+  bool operator <= (const ResourceVector& that) const;
+
+  ResourceVector operator + (const ResourceVector& that) const
+  {
+    ResourceVector result(*this);
+    result += that;
+    return result;
+  }
+
+  ResourceVector operator - (const ResourceVector& that) const
+  {
+    ResourceVector result(*this);
+    result -= that;
+    return result;
+  }
+
+  ResourceVector& operator += (const ResourceVector& that);
+  ResourceVector& operator -= (const ResourceVector& that);
+
+  // Returns the (interned) index for resources with the specified
+  // name and type. Indices are never reused, so callers on a hot
+  // path can look up the index once (e.g., for "cpus").
+  static size_t index(const std::string& name, const Value::Type& type);
+
+  // Number of fixed point units per scalar unit.
+  static const int64_t SCALAR_PRECISION = 1000;
+
+private:
+  typedef std::vector<std::pair<uint64_t, uint64_t> > Intervals;
+
+  void add(const Resource& resource);
+
+  std::vector<int64_t> scalars;
+  std::vector<Intervals> ranges;
+  std::vector<std::vector<std::string> > sets;
+};
+
+
+inline std::ostream& operator << (
+    std::ostream& stream,
+    const ResourceVector& resources)
+{
+  return stream << resources.resources();
+}
+
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __RESOURCE_VECTOR_HPP__
@@ -17,40 +17,342 @@
  */
 
 #include <algorithm>
+#include <deque>
+#include <map>
 
+#include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/dispatch.hpp>
 #include <process/future.hpp>
+#include <process/timer.hpp>
 
 #include <stout/duration.hpp>
 #include <stout/foreach.hpp>
+#include <stout/option.hpp>
+#include <stout/stringify.hpp>
 
 #include "log/coordinator.hpp"
 #include "log/replica.hpp"
 
 using namespace process;
 
+using process::wait; // Necessary on some OS's to disambiguate.
+
+using std::deque;
 using std::list;
+using std::map;
 using std::pair;
 using std::set;
 using std::string;
 
+namespace params = std::tr1::placeholders;
+
 
 namespace mesos {
 namespace internal {
 namespace log {
 
+// Returns a request to write the specified action as the coordinator
+// with the specified ID (a commit is just a learned write).
+static WriteRequest writeRequest(
+    uint64_t id,
+    const Action& action,
+    bool learned)
+{
+  WriteRequest request;
+  request.set_id(id);
+  request.set_position(action.position());
+  if (learned) {
+    request.set_learned(true);
+  }
+  request.set_type(action.type());
+  switch (action.type()) {
+    case Action::NOP:
+      CHECK(action.has_nop());
+      request.mutable_nop();
+      break;
+    case Action::APPEND:
+      CHECK(action.has_append());
+      request.mutable_append()->MergeFrom(action.append());
+      break;
+    case Action::TRUNCATE:
+      CHECK(action.has_truncate());
+      request.mutable_truncate()->MergeFrom(action.truncate());
+      break;
+    default:
+      LOG(FATAL) << "Unknown Action::Type!";
+  }
+  return request;
+}
+
+
+// Performs the asynchronous appends of a coordinator. An append gets
+// written to the remote replicas as soon as it's within the window
+// (i.e., without waiting for the appends before it to get a quorum)
+// but its promise only gets satisfied (and its learned message sent)
+// once every append before it has been committed too.
+class PipelineProcess : public Process<PipelineProcess>
+{
+public:
+  PipelineProcess(uint32_t _quorum,
+                  Replica* _replica,
+                  Network* _network,
+                  uint32_t _window)
+    : quorum(_quorum),
+      replica(_replica),
+      network(_network),
+      window(_window)
+  {
+    CHECK(window > 0);
+  }
+
+  // Appends the action (which has already been assigned a position
+  // after those of all previous appends).
+  Future<uint64_t> append(const Action& action, const Duration& timeout)
+  {
+    if (error.isSome()) {
+      return Future<uint64_t>::failed(error.get());
+    }
+
+    Write* write = new Write(action);
+    write->timer =
+      delay(timeout, self(), &Self::timedout, action.position());
+    queued.push_back(write);
+
+    Future<uint64_t> future = write->promise.future();
+    send();
+    return future;
+  }
+
+protected:
+  virtual void finalize()
+  {
+    fail("Coordinator destroyed");
+  }
+
+private:
+  struct Write
+  {
+    Write(const Action& _action)
+      : action(_action),
+        okays(0),
+        accepted(false),
+        committing(false),
+        committed(false) {}
+
+    const Action action;
+    process::Promise<uint64_t> promise;
+    Timer timer;
+    set<Future<WriteResponse> > futures; // Remote responses.
+    uint32_t okays;
+    bool accepted; // True once a quorum has accepted the write.
+    bool committing; // True once written to the local replica.
+    bool committed; // True once the local replica has learned it.
+  };
+
+  // Writes queued appends to the remote replicas while within the
+  // window.
+  void send()
+  {
+    while (!queued.empty() && writes.size() < window) {
+      Write* write = queued.front();
+      queued.pop_front();
+
+      const uint64_t position = write->action.position();
+      writes[position] = write;
+
+      // TODO(benh): Eliminate this special case hack?
+      if (quorum == 1) {
+        write->accepted = true;
+        commit();
+        continue;
+      }
+
+      // Broadcast the request to the network *excluding* the local
+      // replica.
+      set<UPID> filter;
+      filter.insert(replica->pid());
+      network->broadcast(
+          protocol::write,
+          writeRequest(write->action.performed(), write->action, false),
+          filter)
+        .onAny(defer(self(), &Self::broadcasted, params::_1, position));
+    }
+  }
+
+  void broadcasted(
+      const Future<set<Future<WriteResponse> > >& futures,
+      uint64_t position)
+  {
+    CHECK(futures.isReady());
+
+    if (writes.count(position) == 0) {
+      discard(futures.get()); // Already failed.
+      return;
+    }
+
+    Write* write = writes[position];
+    write->futures = futures.get();
+    foreach (const Future<WriteResponse>& future, write->futures) {
+      future.onAny(defer(self(), &Self::written, params::_1, position));
+    }
+  }
+
+  void written(const Future<WriteResponse>& future, uint64_t position)
+  {
+    if (writes.count(position) == 0 || !future.isReady()) {
+      return; // Already failed or accepted (and discarded).
+    }
+
+    Write* write = writes[position];
+    if (write->accepted) {
+      return;
+    }
+
+    const WriteResponse& response = future.get();
+    CHECK(response.position() == position);
+    if (!response.okay()) {
+      fail("Coordinator demoted");
+    } else if (++write->okays >= (quorum - 1)) { // N.B. (quorum - 1)!
+      write->accepted = true;
+      discard(write->futures);
+      commit();
+    }
+  }
+
+  // Writes the accepted appends at the front of the pipeline to the
+  // local replica as learned. Note that these local writes are made
+  // concurrently (and might be learned out of order by the local
+  // replica), the order gets enforced in 'committed'.
+  void commit()
+  {
+    map<uint64_t, Write*>::iterator iterator = writes.begin();
+    for (; iterator != writes.end(); ++iterator) {
+      Write* write = iterator->second;
+      if (!write->accepted) {
+        break;
+      } else if (!write->committing) {
+        write->committing = true;
+        // TODO(benh): Add a non-message based way to do this write.
+        protocol::write(
+            replica->pid(),
+            writeRequest(write->action.performed(), write->action, true))
+          .onAny(defer(self(), &Self::committed, params::_1, iterator->first));
+      }
+    }
+  }
+
+  void committed(const Future<WriteResponse>& future, uint64_t position)
+  {
+    if (writes.count(position) == 0) {
+      return;
+    } else if (future.isFailed()) {
+      fail(future.failure());
+      return;
+    }
+
+    CHECK(future.isReady()) << "Not expecting a discarded future!";
+
+    if (!future.get().okay()) {
+      fail("Coordinator demoted");
+      return;
+    }
+
+    writes[position]->committed = true;
+
+    // Send out the learned messages and satisfy the promises of the
+    // appends that are now committed in order.
+    set<UPID> filter;
+    filter.insert(replica->pid());
+
+    while (!writes.empty() && writes.begin()->second->committed) {
+      Write* write = writes.begin()->second;
+      writes.erase(writes.begin());
+
+      LearnedMessage message;
+      message.mutable_action()->MergeFrom(write->action);
+      message.mutable_action()->set_learned(true);
+      network->broadcast(message, filter);
+
+      Timer::cancel(write->timer);
+      write->promise.set(write->action.position());
+      delete write;
+    }
+
+    send();
+  }
+
+  void timedout(uint64_t position)
+  {
+    bool pending = writes.count(position) > 0;
+    foreach (Write* write, queued) {
+      pending = pending || write->action.position() == position;
+    }
+
+    if (pending) {
+      fail("Timed out while appending at position " + stringify(position));
+    }
+  }
+
+  // Fails all outstanding (and subsequent) appends.
+  void fail(const string& message)
+  {
+    if (error.isNone()) {
+      LOG(INFO) << "Coordinator failed to append: " << message;
+      error = message;
+    }
+
+    foreachvalue (Write* write, writes) {
+      queued.push_back(write);
+    }
+    writes.clear();
+
+    foreach (Write* write, queued) {
+      Timer::cancel(write->timer);
+      discard(write->futures);
+      write->promise.fail(message);
+      delete write;
+    }
+    queued.clear();
+  }
+
+  const uint32_t quorum;
+  Replica* replica;
+  Network* network;
+  const uint32_t window;
+
+  Option<string> error;
+
+  // Appends written to the remote replicas but not yet committed,
+  // by position, and the appends waiting to be written, in order.
+  map<uint64_t, Write*> writes;
+  deque<Write*> queued;
+};
+
+
 Coordinator::Coordinator(int _quorum,
                          Replica* _replica,
-                         Network* _network)
+                         Network* _network,
+                         uint32_t window)
   : elected(false),
     quorum(_quorum),
     replica(_replica),
     network(_network),
     id(0),
-    index(0) {}
+    index(0),
+    appended(0)
+{
+  pipeline = new PipelineProcess(quorum, replica, network, window);
+  spawn(pipeline);
+}
 
 
-Coordinator::~Coordinator() {}
+Coordinator::~Coordinator()
+{
+  terminate(pipeline);
+  wait(pipeline);
+  delete pipeline;
+}
 
 
 Result<uint64_t> Coordinator::elect(const Timeout& timeout)
@@ -119,6 +421,32 @@ Result<uint64_t> Coordinator::elect(const Timeout& timeout)
     // catchup the local replica all the way to the end of the log
     // before we can perform any up-to-date local reads.
 
+    // First catch up in bulk from the other replicas, so that only
+    // the positions that none of them have learned need a full Paxos
+    // round each (see 'fill'). A failed catch-up isn't fatal since
+    // filling is always correct (just slower). Each request gets a
+    // fraction of the remaining time so that it can be retried on
+    // every other replica if some of them are unavailable.
+    Future<set<UPID> > pids = network->get();
+    pids.await();
+    CHECK(pids.isReady());
+
+    set<UPID> peers = pids.get();
+    peers.erase(replica->pid());
+
+    Future<uint64_t> caughtup = replica->catchup(
+        peers,
+        index,
+        Seconds(timeout.remaining().secs() / (peers.size() + 1)));
+
+    if (!caughtup.await(timeout.remaining())) {
+      caughtup.discard();
+      elected = false;
+      return Result<uint64_t>::none();
+    } else if (caughtup.isFailed()) {
+      LOG(WARNING) << "Coordinator failed to catch up: " << caughtup.failure();
+    }
+
     Future<set<uint64_t> > positions = replica->missing(index);
 
     if (!positions.await(timeout.remaining())) {
@@ -170,6 +498,11 @@ Result<uint64_t> Coordinator::append(
     return Result<uint64_t>::error("Coordinator not elected");
   }
 
+  Result<uint64_t> flushed = flush(timeout);
+  if (!flushed.isSome()) {
+    return flushed;
+  }
+
   Action action;
   action.set_position(index);
   action.set_promised(id);
@@ -189,6 +522,28 @@ Result<uint64_t> Coordinator::append(
 }
 
 
+Future<uint64_t> Coordinator::appendAsync(
+    const string& bytes,
+    const Duration& timeout)
+{
+  if (!elected) {
+    return Future<uint64_t>::failed("Coordinator not elected");
+  }
+
+  Action action;
+  action.set_position(index++);
+  action.set_promised(id);
+  action.set_performed(id);
+  action.set_type(Action::APPEND);
+  Action::Append* append = action.mutable_append();
+  append->set_bytes(bytes);
+
+  appended = dispatch(pipeline, &PipelineProcess::append, action, timeout);
+
+  return appended;
+}
+
+
 Result<uint64_t> Coordinator::truncate(
     uint64_t to,
     const Timeout& timeout)
@@ -197,6 +552,11 @@ Result<uint64_t> Coordinator::truncate(
     return Result<uint64_t>::error("Coordinator not elected");
   }
 
+  Result<uint64_t> flushed = flush(timeout);
+  if (!flushed.isSome()) {
+    return flushed;
+  }
+
   Action action;
   action.set_position(index);
   action.set_promised(id);
@@ -216,6 +576,24 @@ Result<uint64_t> Coordinator::truncate(
 }
 
 
+Result<uint64_t> Coordinator::flush(const Timeout& timeout)
+{
+  // Since asynchronous appends get committed in order (and a failure
+  // fails all the appends after it) it's enough to wait for the last.
+  if (!appended.await(timeout.remaining())) {
+    return Result<uint64_t>::none();
+  } else if (appended.isFailed()) {
+    elected = false;
+    return Result<uint64_t>::error(appended.failure());
+  } else if (appended.isDiscarded()) {
+    elected = false;
+    return Result<uint64_t>::error("Asynchronous append discarded");
+  }
+
+  return appended.get();
+}
+
+
 Result<uint64_t> Coordinator::write(
     const Action& action,
     const Timeout& timeout)
@@ -243,26 +621,7 @@ Result<uint64_t> Coordinator::write(
     }
   }
 
-  WriteRequest request;
-  request.set_id(id);
-  request.set_position(action.position());
-  request.set_type(action.type());
-  switch (action.type()) {
-    case Action::NOP:
-      CHECK(action.has_nop());
-      request.mutable_nop();
-      break;
-    case Action::APPEND:
-      CHECK(action.has_append());
-      request.mutable_append()->MergeFrom(action.append());
-      break;
-    case Action::TRUNCATE:
-      CHECK(action.has_truncate());
-      request.mutable_truncate()->MergeFrom(action.truncate());
-      break;
-    default:
-      LOG(FATAL) << "Unknown Action::Type!";
-  }
+  WriteRequest request = writeRequest(id, action, false);
 
   // Broadcast the request to the network *excluding* the local replica.
   set<Future<WriteResponse> > futures =
@@ -317,27 +676,7 @@ Result<uint64_t> Coordinator::commit(const Action& action)
 
   CHECK(elected);
 
-  WriteRequest request;
-  request.set_id(id);
-  request.set_position(action.position());
-  request.set_learned(true); // A commit is just a learned write.
-  request.set_type(action.type());
-  switch (action.type()) {
-    case Action::NOP:
-      CHECK(action.has_nop());
-      request.mutable_nop();
-      break;
-    case Action::APPEND:
-      CHECK(action.has_append());
-      request.mutable_append()->MergeFrom(action.append());
-      break;
-    case Action::TRUNCATE:
-      CHECK(action.has_truncate());
-      request.mutable_truncate()->MergeFrom(action.truncate());
-      break;
-    default:
-      LOG(FATAL) << "Unknown Action::Type!";
-  }
+  WriteRequest request = writeRequest(id, action, true);
 
   //  TODO(benh): Add a non-message based way to do this write.
   Future<WriteResponse> future = protocol::write(replica->pid(), request);
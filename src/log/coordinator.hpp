@@ -22,9 +22,11 @@
 #include <string>
 #include <vector>
 
+#include <process/future.hpp>
 #include <process/process.hpp>
 #include <process/timeout.hpp>
 
+#include <stout/duration.hpp>
 #include <stout/result.hpp>
 
 #include "log/network.hpp"
@@ -37,10 +39,19 @@ namespace mesos {
 namespace internal {
 namespace log {
 
+// Forward declaration.
+class PipelineProcess;
+
+
 class Coordinator
 {
 public:
-  Coordinator(int quorum, Replica* replica, Network* group);
+  // The window is the maximum number of asynchronous appends (see
+  // appendAsync) that get written to the replicas concurrently.
+  Coordinator(int quorum,
+              Replica* replica,
+              Network* group,
+              uint32_t window = 64);
 
   ~Coordinator();
 
@@ -58,6 +69,20 @@ public:
       const std::string& bytes,
       const process::Timeout& timeout);
 
+  // Appends the specified bytes without waiting for any previous
+  // appends to complete, i.e., up to 'window' appends get written
+  // concurrently (later ones get queued). Appends always get
+  // committed in the order they were made and the returned future is
+  // satisfied with the position of the append once it's committed.
+  // A failure (e.g., the coordinator got demoted or the append didn't
+  // get a quorum within the timeout) also fails every append after
+  // it, after which the coordinator must not be used anymore (other
+  // than to be demoted). The synchronous operations first wait for
+  // any outstanding appends to get committed.
+  process::Future<uint64_t> appendAsync(
+      const std::string& bytes,
+      const Duration& timeout);
+
   // Returns the result of trying to truncate the log (from the
   // beginning to the specified position exclusive). A result of
   // none means the truncate failed (e.g., due to timeout), but can be
@@ -65,6 +90,10 @@ public:
   Result<uint64_t> truncate(uint64_t to, const process::Timeout& timeout);
 
 private:
+  // Helper that waits for all asynchronous appends to get committed.
+  // A result of none means it timed out.
+  Result<uint64_t> flush(const process::Timeout& timeout);
+
   // Helper that tries to achieve consensus of the specified action. A
   // result of none means the write failed (e.g., due to timeout), but
   // can be retried.
@@ -105,6 +134,10 @@ private:
   uint64_t id; // Coordinator ID.
 
   uint64_t index; // Last position written in the log.
+
+  PipelineProcess* pipeline; // Performs the asynchronous appends.
+
+  process::Future<uint64_t> appended; // Last asynchronous append.
 };
 
 } // namespace log {
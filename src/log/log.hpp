@@ -19,13 +19,18 @@
 #ifndef __LOG_HPP__
 #define __LOG_HPP__
 
+#include <algorithm>
 #include <list>
 #include <set>
 #include <string>
 
+#include <tr1/functional>
+
+#include <process/future.hpp>
 #include <process/process.hpp>
 #include <process/timeout.hpp>
 
+#include <stout/duration.hpp>
 #include <stout/foreach.hpp>
 #include <stout/result.hpp>
 #include <stout/try.hpp>
@@ -43,6 +48,7 @@ class Log
 {
 public:
   // Forward declarations.
+  class Cursor;
   class Reader;
   class Writer;
 
@@ -93,6 +99,7 @@ public:
 
   private:
     friend class Log;
+    friend class Cursor;
     friend class Reader;
     friend class Writer;
     Position(uint64_t _value) : value(_value) {}
@@ -106,12 +113,41 @@ public:
     std::string data;
 
   private:
+    friend class Cursor;
     friend class Reader;
     friend class Writer;
     Entry(const Position& _position, const std::string& _data)
       : position(_position), data(_data) {}
   };
 
+  // A cursor reads the entries of the log one at a time starting
+  // from some position, e.g., reading everything from the beginning
+  // of the log and then tailing it for new entries, without reading
+  // all of the entries at once (see Reader::read). The entries get
+  // read from the local replica in batches as the cursor advances.
+  class Cursor
+  {
+  public:
+    // Returns the next entry. A none result means that the next
+    // entry hasn't been learned by the local replica yet (or the
+    // read timed out), i.e., try again later. An error means the
+    // entries can't be read (e.g., they have been truncated).
+    Result<Entry> next(const process::Timeout& timeout);
+
+    // Returns the position of the entry the cursor reads next (or
+    // the position it will be at or after).
+    Position position() const;
+
+  private:
+    friend class Reader;
+    Cursor(Replica* _replica, const Position& from, size_t _batch);
+
+    Replica* replica;
+    size_t batch; // Number of positions to read at a time.
+    uint64_t from; // Next position to read from the replica.
+    std::list<Entry> entries; // Read but not yet returned.
+  };
+
   class Reader
   {
   public:
@@ -124,6 +160,11 @@ public:
                                    const Position& to,
                                    const process::Timeout& timeout);
 
+    // Returns a cursor for reading the entries starting at the
+    // specified position, reading (at most) the specified number of
+    // positions from the local replica at a time.
+    Cursor cursor(const Position& from, size_t batch = 128);
+
     // Returns the beginning position of the log from the perspective
     // of the local replica (which may be out of date if the log has
     // been opened and truncated while this replica was partitioned).
@@ -146,7 +187,12 @@ public:
     // one writer (local and remote) is valid at a time. A writer
     // becomes invalid if any operation returns an error, and a new
     // writer must be created in order perform subsequent operations.
-    Writer(Log* log, const Duration& timeout, int retries = 3);
+    // The window is the maximum number of asynchronous appends that
+    // get written to the replicas concurrently.
+    Writer(Log* log,
+           const Duration& timeout,
+           int retries = 3,
+           uint32_t window = 64);
     ~Writer();
 
     // Attempts to append the specified data to the log. A none result
@@ -157,6 +203,18 @@ public:
         const std::string& data,
         const process::Timeout& timeout);
 
+    // Appends the specified data to the log without waiting for any
+    // previous appends to complete. Appends are committed in the
+    // order they were made and the returned future is satisfied with
+    // the position of the entry once it has been committed. A failed
+    // future means the append (or one before it) timed out or the
+    // writer lost its leadership, in which case every subsequent
+    // append fails too and a new Writer must be created. The other
+    // operations first wait for outstanding appends to be committed.
+    process::Future<Position> appendAsync(
+        const std::string& data,
+        const Duration& timeout);
+
     // Attempts to truncate the log up to but not including the
     // specificed position. A none result means the operation timed
     // out, otherwise the new ending position of the log is returned
@@ -166,23 +224,28 @@ public:
         const process::Timeout& timeout);
 
   private:
+    // Helper for converting the positions of asynchronous appends.
+    static Position position(const uint64_t& value);
+
     Option<std::string> error;
     Coordinator coordinator;
   };
 
   // Creates a new replicated log that assumes the specified quorum
-  // size, is backed by a file at the specified path, and coordiantes
-  // with other replicas via the set of process PIDs.
+  // size, is backed by a file at the specified path (using the
+  // specified storage, see Replica), and coordiantes with other
+  // replicas via the set of process PIDs.
   Log(int _quorum,
       const std::string& path,
-      const std::set<process::UPID>& pids)
+      const std::set<process::UPID>& pids,
+      const std::string& storage = "leveldb")
     : group(NULL)
   {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
 
     quorum = _quorum;
 
-    replica = new Replica(path);
+    replica = new Replica(path, storage);
 
     network = new Network(pids);
 
@@ -191,16 +254,18 @@ public:
   }
 
   // Creates a new replicated log that assumes the specified quorum
-  // size, is backed by a file at the specified path, and coordiantes
-  // with other replicas associated with the specified ZooKeeper
-  // servers, timeout, and znode.
+  // size, is backed by a file at the specified path (using the
+  // specified storage, see Replica), and coordiantes with other
+  // replicas associated with the specified ZooKeeper servers,
+  // timeout, and znode.
   Log(int _quorum,
       const std::string& path,
       const std::string& servers,
       const Duration& timeout,
       const std::string& znode,
       const Option<zookeeper::Authentication>& auth
-        = Option<zookeeper::Authentication>::none())
+        = Option<zookeeper::Authentication>::none(),
+      const std::string& storage = "leveldb")
   {
     GOOGLE_PROTOBUF_VERIFY_VERSION;
 
@@ -208,7 +273,7 @@ public:
 
     LOG(INFO) << "Creating a new log replica";
 
-    replica = new Replica(path);
+    replica = new Replica(path, storage);
 
     group = new zookeeper::Group(servers, timeout, znode, auth);
     network = new ZooKeeperNetwork(group);
@@ -320,6 +385,12 @@ Result<std::list<Log::Entry> > Log::Reader::read(
 }
 
 
+Log::Cursor Log::Reader::cursor(const Log::Position& from, size_t batch)
+{
+  return Cursor(replica, from, batch);
+}
+
+
 Log::Position Log::Reader::beginning()
 {
   // TODO(benh): Take a timeout and return an Option.
@@ -340,9 +411,89 @@ Log::Position Log::Reader::ending()
 }
 
 
-Log::Writer::Writer(Log* log, const Duration& timeout, int retries)
+Log::Cursor::Cursor(
+    Replica* _replica,
+    const Log::Position& _from,
+    size_t _batch)
+  : replica(_replica),
+    batch(_batch),
+    from(_from.value)
+{
+  CHECK(batch > 0);
+}
+
+
+Result<Log::Entry> Log::Cursor::next(const process::Timeout& timeout)
+{
+  while (entries.empty()) {
+    process::Future<uint64_t> ending = replica->ending();
+
+    if (!ending.await(timeout.remaining())) {
+      return Result<Log::Entry>::none();
+    }
+
+    CHECK(ending.isReady()) << "Not expecting a failed or discarded future!";
+
+    if (ending.get() < from) {
+      return Result<Log::Entry>::none();
+    }
+
+    process::Future<std::list<Action> > actions =
+      replica->read(from, std::min(ending.get(), from + (batch - 1)));
+
+    if (!actions.await(timeout.remaining())) {
+      return Result<Log::Entry>::none();
+    } else if (actions.isFailed()) {
+      return Result<Log::Entry>::error(actions.failure());
+    }
+
+    CHECK(actions.isReady()) << "Not expecting discarded future!";
+
+    const uint64_t start = from;
+
+    // Stop at the first position that is missing (a hole) or pending
+    // (not learned), the cursor continues from there next time.
+    foreach (const Action& action, actions.get()) {
+      if (action.position() != from ||
+          !action.has_performed() ||
+          !action.has_learned() ||
+          !action.learned()) {
+        break;
+      }
+
+      from++;
+
+      // And only return appends.
+      CHECK(action.has_type());
+      if (action.type() == Action::APPEND) {
+        entries.push_back(Entry(action.position(), action.append().bytes()));
+      }
+    }
+
+    if (from == start) {
+      return Result<Log::Entry>::none();
+    }
+  }
+
+  Entry entry = entries.front();
+  entries.pop_front();
+  return entry;
+}
+
+
+Log::Position Log::Cursor::position() const
+{
+  return entries.empty() ? Position(from) : entries.front().position;
+}
+
+
+Log::Writer::Writer(
+    Log* log,
+    const Duration& timeout,
+    int retries,
+    uint32_t window)
   : error(Option<std::string>::none()),
-    coordinator(log->quorum, log->replica, log->network)
+    coordinator(log->quorum, log->replica, log->network, window)
 {
   do {
     Result<uint64_t> result = coordinator.elect(process::Timeout(timeout));
@@ -389,6 +540,19 @@ Result<Log::Position> Log::Writer::append(
 }
 
 
+process::Future<Log::Position> Log::Writer::appendAsync(
+    const std::string& data,
+    const Duration& timeout)
+{
+  if (error.isSome()) {
+    return process::Future<Log::Position>::failed(error.get());
+  }
+
+  return coordinator.appendAsync(data, timeout)
+    .then(std::tr1::function<Position(const uint64_t&)>(&Writer::position));
+}
+
+
 Result<Log::Position> Log::Writer::truncate(
     const Log::Position& to,
     const process::Timeout& timeout)
@@ -414,6 +578,12 @@ Result<Log::Position> Log::Writer::truncate(
 }
 
 
+Log::Position Log::Writer::position(const uint64_t& value)
+{
+  return Log::Position(value);
+}
+
+
 void Log::watch(const std::set<zookeeper::Group::Membership>& memberships)
 {
   if (membership.isReady() && memberships.count(membership.get()) == 0) {
@@ -61,6 +61,9 @@ public:
   // Set the PIDs that are part of this network.
   void set(const std::set<process::UPID>& pids);
 
+  // Returns the PIDs that are part of this network.
+  process::Future<std::set<process::UPID> > get();
+
   // Sends a request to each member of the network and returns a set
   // of futures that represent their responses.
   template <typename Req, typename Res>
@@ -137,6 +140,11 @@ public:
     }
   }
 
+  std::set<process::UPID> get()
+  {
+    return pids;
+  }
+
   // Sends a request to each of the groups members and returns a set
   // of futures that represent their responses.
   template <typename Req, typename Res>
@@ -219,6 +227,12 @@ inline void Network::set(const std::set<process::UPID>& pids)
 }
 
 
+inline process::Future<std::set<process::UPID> > Network::get()
+{
+  return process::dispatch(process, &NetworkProcess::get);
+}
+
+
 template <typename Req, typename Res>
 process::Future<std::set<process::Future<Res> > > Network::broadcast(
     const Protocol<Req, Res>& protocol,
@@ -23,17 +23,28 @@
 #include <leveldb/write_batch.h>
 
 #include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
 
+#include <process/defer.hpp>
+#include <process/delay.hpp>
 #include <process/dispatch.hpp>
 #include <process/protobuf.hpp>
+#include <process/statistics.hpp>
+#include <process/timer.hpp>
 
+#include <stout/cache.hpp>
 #include <stout/foreach.hpp>
 #include <stout/nothing.hpp>
 #include <stout/numify.hpp>
+#include <stout/option.hpp>
 #include <stout/stopwatch.hpp>
 #include <stout/utils.hpp>
 
 #include "log/replica.hpp"
+#include "log/segmented_storage.hpp"
+#include "log/storage.hpp"
 
 #include "messages/log.hpp"
 
@@ -41,9 +52,14 @@ using namespace process;
 
 using process::wait; // Necessary on some OS's to disambiguate.
 
+using std::deque;
 using std::list;
+using std::map;
 using std::set;
 using std::string;
+using std::vector;
+
+namespace params = std::tr1::placeholders;
 
 namespace mesos {
 namespace internal {
@@ -55,32 +71,11 @@ namespace protocol {
 Protocol<PromiseRequest, PromiseResponse> promise;
 Protocol<WriteRequest, WriteResponse> write;
 Protocol<LearnRequest, LearnResponse> learn;
+Protocol<CatchupRequest, CatchupResponse> catchup;
 
 } // namespace protocol {
 
 
-struct State
-{
-  uint64_t coordinator; // Last promise made to a coordinator.
-  uint64_t begin; // Beginning position of the log.
-  uint64_t end; // Ending position of the log.
-  std::set<uint64_t> learned; // Positions present and learned
-  std::set<uint64_t> unlearned; // Positions present but unlearned.
-};
-
-
-// Abstract interface for reading and writing records.
-class Storage
-{
-public:
-  virtual ~Storage() {}
-  virtual Try<State> recover(const string& path) = 0;
-  virtual Try<Nothing> persist(const Promise& promise) = 0;
-  virtual Try<Nothing> persist(const Action& action) = 0;
-  virtual Try<Action> read(uint64_t position) = 0;
-};
-
-
 // Concrete implementation of the storage interface using leveldb.
 class LevelDBStorage : public Storage
 {
@@ -91,7 +86,9 @@ public:
   virtual Try<State> recover(const string& path);
   virtual Try<Nothing> persist(const Promise& promise);
   virtual Try<Nothing> persist(const Action& action);
+  virtual Try<Nothing> sync();
   virtual Try<Action> read(uint64_t position);
+  virtual Try<std::list<Action> > read(uint64_t from, uint64_t to);
 
 private:
   class Varint64Comparator : public leveldb::Comparator
@@ -174,11 +171,18 @@ private:
   leveldb::DB* db;
 
   uint64_t first; // First position still in leveldb, used during truncation.
+
+  // Records persisted since the last sync (and their total size), the
+  // actions are kept around for reads until the batch gets written.
+  leveldb::WriteBatch batch;
+  size_t records;
+  size_t bytes;
+  std::map<uint64_t, Action> actions;
 };
 
 
 LevelDBStorage::LevelDBStorage()
-  : db(NULL), first(0)
+  : db(NULL), first(0), records(0), bytes(0)
 {
   // Nothing to see here.
 }
@@ -324,12 +328,6 @@ Try<State> LevelDBStorage::recover(const string& path)
 
 Try<Nothing> LevelDBStorage::persist(const Promise& promise)
 {
-  Stopwatch stopwatch;
-  stopwatch.start();
-
-  leveldb::WriteOptions options;
-  options.sync = true;
-
   Record record;
   record.set_type(Record::PROMISE);
   record.mutable_promise()->MergeFrom(promise);
@@ -340,14 +338,9 @@ Try<Nothing> LevelDBStorage::persist(const Promise& promise)
     return Try<Nothing>::error("Failed to serialize record");
   }
 
-  leveldb::Status status = db->Put(options, encode(0, false), value);
-
-  if (!status.ok()) {
-    return Try<Nothing>::error(status.ToString());
-  }
-
-  LOG(INFO) << "Persisting promise (" << value.size()
-            << " bytes) to leveldb took " << stopwatch.elapsed();
+  batch.Put(encode(0, false), value);
+  records++;
+  bytes += value.size();
 
   return Nothing();
 }
@@ -355,9 +348,6 @@ Try<Nothing> LevelDBStorage::persist(const Promise& promise)
 
 Try<Nothing> LevelDBStorage::persist(const Action& action)
 {
-  Stopwatch stopwatch;
-  stopwatch.start();
-
   Record record;
   record.set_type(Record::ACTION);
   record.mutable_action()->MergeFrom(action);
@@ -368,27 +358,16 @@ Try<Nothing> LevelDBStorage::persist(const Action& action)
     return Try<Nothing>::error("Failed to serialize record");
   }
 
-  leveldb::WriteOptions options;
-  options.sync = true;
-
-  leveldb::Status status = db->Put(options, encode(action.position()), value);
-
-  if (!status.ok()) {
-    return Try<Nothing>::error(status.ToString());
-  }
-
-  LOG(INFO) << "Persisting action (" << value.size()
-            << " bytes) to leveldb took " << stopwatch.elapsed();
+  batch.Put(encode(action.position()), value);
+  records++;
+  bytes += value.size();
+  actions[action.position()] = action;
 
-  // Delete positions if a truncate action has been *learned*. Note
-  // that we do this in a best-effort fashion (i.e., we ignore any
-  // failures to the database since we can always try again).
+  // Delete positions if a truncate action has been *learned*.
   if (action.has_type() && action.type() == Action::TRUNCATE &&
       action.has_learned() && action.learned()) {
     CHECK(action.has_truncate());
 
-    stopwatch.start(); // Restart the stopwatch.
-
     // To actually perform the truncation in leveldb we need to remove
     // all the keys that represent positions no longer in the log. We
     // do this by attempting to delete all keys that represent the
@@ -402,9 +381,9 @@ Try<Nothing> LevelDBStorage::persist(const Action& action)
     // was, for posterity, the original implementation). In addition,
     // caching the "first" position we know is in the database is
     // cheaper than using an iterator to determine the first position
-    // (which was, for posterity, the second implementation).
-
-    leveldb::WriteBatch batch;
+    // (which was, for posterity, the second implementation). The
+    // deletes are part of the batch (rather than a separate
+    // asynchronous write) so they don't cost anything extra.
 
     // Add positions up to (but excluding) the truncate position to
     // the batch starting at the first position still in leveldb.
@@ -414,20 +393,12 @@ Try<Nothing> LevelDBStorage::persist(const Action& action)
       index++;
     }
 
-    // If we added any positions, attempt to delete them!
     if (index > 0) {
-      // We do this write asynchronously (e.g., using default options).
-      leveldb::Status status = db->Write(leveldb::WriteOptions(), &batch);
+      first = action.truncate().to(); // Save the new first position!
 
-      if (!status.ok()) {
-        LOG(WARNING) << "Ignoring leveldb batch delete failure: "
-                     << status.ToString();
-      } else {
-        first = action.truncate().to(); // Save the new first position!
+      actions.erase(actions.begin(), actions.lower_bound(first));
 
-        LOG(INFO) << "Deleting ~" << index
-                  << " keys from leveldb took " << stopwatch.elapsed();
-      }
+      LOG(INFO) << "Deleting ~" << index << " keys from leveldb";
     }
   }
 
@@ -435,8 +406,46 @@ Try<Nothing> LevelDBStorage::persist(const Action& action)
 }
 
 
+Try<Nothing> LevelDBStorage::sync()
+{
+  if (records == 0) {
+    return Nothing();
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  leveldb::WriteOptions options;
+  options.sync = true;
+
+  leveldb::Status status = db->Write(options, &batch);
+
+  if (!status.ok()) {
+    return Try<Nothing>::error(status.ToString());
+  }
+
+  LOG(INFO) << "Persisting " << records << " records (" << bytes
+            << " bytes) to leveldb took " << stopwatch.elapsed();
+
+  batch.Clear();
+  records = 0;
+  bytes = 0;
+  actions.clear();
+
+  return Nothing();
+}
+
+
 Try<Action> LevelDBStorage::read(uint64_t position)
 {
+  // Positions persisted since the last sync aren't in leveldb yet.
+  std::map<uint64_t, Action>::const_iterator iterator =
+    actions.find(position);
+
+  if (iterator != actions.end()) {
+    return iterator->second;
+  }
+
   Stopwatch stopwatch;
   stopwatch.start();
 
@@ -468,12 +477,86 @@ Try<Action> LevelDBStorage::read(uint64_t position)
 }
 
 
+Try<list<Action> > LevelDBStorage::read(uint64_t from, uint64_t to)
+{
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  list<Action> result;
+
+  // Rather than a lookup per position we scan the range, merging in
+  // the positions persisted since the last sync (which take
+  // precedence). Note that positions before 'first' might still be
+  // in leveldb until the truncation gets synced.
+  std::map<uint64_t, Action>::const_iterator pending =
+    actions.lower_bound(from);
+
+  leveldb::Iterator* iterator = db->NewIterator(leveldb::ReadOptions());
+
+  iterator->Seek(encode(std::max(from, first)));
+
+  while (true) {
+    Option<uint64_t> position;
+    if (iterator->Valid() && decode(iterator->key()) <= to) {
+      position = decode(iterator->key());
+    }
+
+    if (pending != actions.end() && pending->first <= to &&
+        (position.isNone() || pending->first <= position.get())) {
+      if (position.isSome() && position.get() == pending->first) {
+        iterator->Next();
+      }
+      result.push_back(pending->second);
+      ++pending;
+      continue;
+    } else if (position.isNone()) {
+      break;
+    }
+
+    leveldb::Slice value = iterator->value();
+
+    google::protobuf::io::ArrayInputStream stream(value.data(), value.size());
+
+    Record record;
+
+    if (!record.ParseFromZeroCopyStream(&stream)) {
+      delete iterator;
+      return Try<list<Action> >::error("Failed to deserialize record");
+    }
+
+    if (record.type() != Record::ACTION) {
+      delete iterator;
+      return Try<list<Action> >::error("Bad record");
+    }
+
+    result.push_back(record.action());
+
+    iterator->Next();
+  }
+
+  leveldb::Status status = iterator->status();
+
+  delete iterator;
+
+  if (!status.ok()) {
+    return Try<list<Action> >::error(status.ToString());
+  }
+
+  LOG(INFO) << "Reading " << result.size() << " positions from leveldb took "
+            << stopwatch.elapsed();
+
+  return result;
+}
+
+
 class ReplicaProcess : public ProtobufProcess<ReplicaProcess>
 {
 public:
   // Constructs a new replica process using specified path to a
-  // directory for storing the underlying log.
-  ReplicaProcess(const std::string& path);
+  // directory for storing the underlying log and the specified type
+  // of storage (see Replica::Replica).
+  // Takes ownership of the storage.
+  ReplicaProcess(const std::string& path, Storage* storage);
 
   virtual ~ReplicaProcess();
 
@@ -502,6 +585,11 @@ public:
   // Returns the highest implicit promise this replica has given.
   uint64_t promised();
 
+  // Persists the specified learned actions (e.g., received while
+  // catching up), skipping positions that have already been learned
+  // or truncated. Returns the number of positions filled.
+  uint64_t fill(const std::list<Action>& actions);
+
 private:
   // Handles a request from a coordinator to promise not to accept
   // writes from any other coordinator.
@@ -517,11 +605,34 @@ private:
   // Handles a message notifying of a learned action.
   void learned(const Action& action);
 
+  // Handles a request from a (lagging) replica for the learned
+  // actions in a range of positions.
+  void catchup(const CatchupRequest& request);
+
   // Helper routines that write a record corresponding to the
   // specified argument. Returns true on success and false otherwise.
+  // The record is only durable after the next sync, so responses
+  // that depend on it must be sent via 'respond'.
   bool persist(const Promise& promise);
   bool persist(const Action& action);
 
+  // Helper that replies to the sender of the current message once
+  // everything persisted so far is durable.
+  void respond(const google::protobuf::Message& message);
+
+  // Makes the records persisted since the last sync durable and
+  // sends the responses that were waiting for them. A sync gets
+  // dispatched when the first record of a batch is persisted, so
+  // every request that arrives before it runs (e.g., while the
+  // previous sync was in progress) is part of the batch and gets
+  // made durable with a single sync (i.e., group commit).
+  void sync();
+
+  // Helper that caches the action (see 'recent') if it's small
+  // enough, otherwise it makes sure that a previous action for the
+  // position isn't cached anymore.
+  void remember(const Action& action);
+
   // Helper routine to recover log (e.g., on restart).
   void recover(const std::string& path);
 
@@ -542,16 +653,63 @@ private:
 
   // Unlearned positions in the log.
   std::set<uint64_t> unlearned;
+
+  // Number of records persisted since the last sync.
+  size_t unsynced;
+
+  // Responses waiting for the next sync (recipient, name and data).
+  struct Response
+  {
+    process::UPID to;
+    std::string name;
+    std::string data;
+  };
+
+  std::list<Response> responses;
+
+  process::Counter syncs; // Number of syncs.
+  process::Counter synced; // Number of records synced.
+  process::Histogram syncTime;
+
+  // Recently learned (or read) actions by position, so that reading
+  // recent positions again (e.g., tailing the log) doesn't need to
+  // read (and deserialize) them from storage. Cached positions are
+  // kept up to date with storage (see 'persist') and truncated
+  // positions never get read. Only small actions get cached (see
+  // 'remember'), so the cache never takes more than CACHE_CAPACITY
+  // times CACHE_MAX_ACTION_SIZE bytes (i.e., 64MB) regardless of how
+  // large the appended entries are.
+  cache<uint64_t, Action> recent;
+
+  process::Counter hits; // Positions read from the cache.
+  process::Counter misses; // Positions read from storage.
 };
 
 
-ReplicaProcess::ReplicaProcess(const string& path)
-  : coordinator(0),
+// Number of actions cached by a replica.
+static const size_t CACHE_CAPACITY = 4096;
+
+// Largest (serialized) action cached by a replica. Reading larger
+// actions from storage is dominated by deserializing them anyway.
+static const int CACHE_MAX_ACTION_SIZE = 16 * 1024;
+
+// Time to wait before retrying a failed sync.
+static const Milliseconds SYNC_RETRY_INTERVAL(100);
+
+
+ReplicaProcess::ReplicaProcess(const string& path, Storage* _storage)
+  : storage(_storage),
+    coordinator(0),
     begin(0),
-    end(0)
+    end(0),
+    unsynced(0),
+    syncs("log/replica/syncs"),
+    synced("log/replica/synced_records"),
+    syncTime("log/replica/sync_time_ms"),
+    recent(CACHE_CAPACITY),
+    hits("log/replica/cache_hits"),
+    misses("log/replica/cache_misses")
 {
-  storage = new LevelDBStorage(); // TODO(benh): Factor out and expose storage.
-
   recover(path);
 
   // Install protobuf handlers.
@@ -568,11 +726,21 @@ ReplicaProcess::ReplicaProcess(const string& path)
   install<LearnRequest>(
       &ReplicaProcess::learn,
       &LearnRequest::position);
+
+  install<CatchupRequest>(
+      &ReplicaProcess::catchup);
 }
 
 
 ReplicaProcess::~ReplicaProcess()
 {
+  // Nobody is waiting for these records, but there is no reason to
+  // lose them either.
+  Try<Nothing> result = storage->sync();
+  if (result.isError()) {
+    LOG(ERROR) << "Error syncing the log: " << result.error();
+  }
+
   delete storage;
 }
 
@@ -587,6 +755,15 @@ Result<Action> ReplicaProcess::read(uint64_t position)
     return Result<Action>::none();
   }
 
+  Option<Action> cached = recent.get(position);
+
+  if (cached.isSome()) {
+    hits.increment();
+    return cached.get();
+  }
+
+  misses.increment();
+
   // Must exist in storage ...
   Try<Action> action = storage->read(position);
 
@@ -596,6 +773,10 @@ Result<Action> ReplicaProcess::read(uint64_t position)
 
   CHECK(action.isSome());
 
+  if (action.get().has_learned() && action.get().learned()) {
+    remember(action.get());
+  }
+
   return action.get();
 }
 
@@ -620,21 +801,45 @@ process::Future<list<Action> > ReplicaProcess::read(
     return promise.future();
   }
 
-  list<Action> actions;
+  list<Action> result;
 
-  for (uint64_t position = from; position <= to; position++) {
-    Result<Action> result = read(position);
+  // Read from the cache until the first position that isn't cached
+  // (skipping holes) and the rest from storage.
+  uint64_t position = from;
 
-    if (result.isError()) {
+  for (; position <= to; position++) {
+    if (holes.count(position) == 0) {
+      Option<Action> cached = recent.get(position);
+      if (cached.isNone()) {
+        break;
+      }
+      result.push_back(cached.get());
+    }
+  }
+
+  hits.increment(result.size());
+
+  if (position <= to) {
+    // Holes don't have an action in storage so they get skipped.
+    Try<list<Action> > stored = storage->read(position, to);
+
+    if (stored.isError()) {
       process::Promise<list<Action> > promise;
-      promise.fail(result.error());
+      promise.fail(stored.error());
       return promise.future();
-    } else if (result.isSome()) {
-      actions.push_back(result.get());
+    }
+
+    misses.increment(stored.get().size());
+
+    foreach (const Action& action, stored.get()) {
+      if (action.has_learned() && action.learned()) {
+        remember(action);
+      }
+      result.push_back(action);
     }
   }
 
-  return actions;
+  return result;
 }
 
 
@@ -680,6 +885,35 @@ uint64_t ReplicaProcess::promised()
 }
 
 
+uint64_t ReplicaProcess::fill(const list<Action>& actions)
+{
+  uint64_t filled = 0;
+
+  foreach (const Action& action, actions) {
+    const uint64_t position = action.position();
+
+    if (!action.has_learned() || !action.learned()) {
+      LOG(WARNING) << "Replica ignoring unlearned action at position "
+                   << position;
+      continue;
+    } else if (position < begin) {
+      continue; // Truncated.
+    } else if (position <= end &&
+               holes.count(position) == 0 &&
+               unlearned.count(position) == 0) {
+      continue; // Already learned.
+    }
+
+    // Note that all of these get synced together.
+    if (persist(action)) {
+      filled++;
+    }
+  }
+
+  return filled;
+}
+
+
 // Note that certain failures that occur result in returning from the
 // current function but *NOT* sending a 'nack' back to the coordinator
 // because that implies a coordinator has been demoted. Not sending
@@ -723,7 +957,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
       response.set_okay(true);
       response.set_id(request.id());
       response.mutable_action()->MergeFrom(action);
-      reply(response);
+      respond(response);
     }
 
     // Need to get the action for the specified position.
@@ -742,7 +976,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         response.set_okay(true);
         response.set_id(request.id());
         response.set_position(request.position());
-        reply(response);
+        respond(response);
       }
     } else {
       CHECK(result.isSome());
@@ -754,7 +988,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         response.set_okay(false);
         response.set_id(request.id());
         response.set_position(request.position());
-        reply(response);
+        respond(response);
       } else {
         Action original = action;
         action.set_promised(request.id());
@@ -764,7 +998,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
           response.set_okay(true);
           response.set_id(request.id());
           response.mutable_action()->MergeFrom(original);
-          reply(response);
+          respond(response);
         }
       }
     }
@@ -778,7 +1012,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
       PromiseResponse response;
       response.set_okay(false);
       response.set_id(request.id());
-      reply(response);
+      respond(response);
     } else {
       Promise promise;
       promise.set_id(request.id());
@@ -791,7 +1025,7 @@ void ReplicaProcess::promise(const PromiseRequest& request)
         response.set_okay(true);
         response.set_id(request.id());
         response.set_position(end);
-        reply(response);
+        respond(response);
       }
     }
   }
@@ -813,7 +1047,7 @@ void ReplicaProcess::write(const WriteRequest& request)
       response.set_okay(false);
       response.set_id(request.id());
       response.set_position(request.position());
-      reply(response);
+      respond(response);
     } else {
       Action action;
       action.set_position(request.position());
@@ -844,7 +1078,7 @@ void ReplicaProcess::write(const WriteRequest& request)
         response.set_okay(true);
         response.set_id(request.id());
         response.set_position(request.position());
-        reply(response);
+        respond(response);
       }
     }
   } else if (result.isSome()) {
@@ -856,7 +1090,7 @@ void ReplicaProcess::write(const WriteRequest& request)
       response.set_okay(false);
       response.set_id(request.id());
       response.set_position(request.position());
-      reply(response);
+      respond(response);
     } else {
       // TODO(benh): Check if this position has already been learned,
       // and if so, check that we are re-writing the same value!
@@ -891,7 +1125,7 @@ void ReplicaProcess::write(const WriteRequest& request)
         response.set_okay(true);
         response.set_id(request.id());
         response.set_position(request.position());
-        reply(response);
+        respond(response);
       }
     }
   }
@@ -927,12 +1161,54 @@ void ReplicaProcess::learn(uint64_t position)
     LearnResponse response;
     response.set_okay(true);
     response.mutable_action()->MergeFrom(result.get());
-    reply(response);
+    respond(response);
   } else {
     LearnResponse response;
     response.set_okay(false);
-    reply(response);
+    respond(response);
+  }
+}
+
+
+void ReplicaProcess::catchup(const CatchupRequest& request)
+{
+  LOG(INFO) << "Replica received catch-up request for positions "
+            << request.from() << " -> " << request.to();
+
+  CatchupResponse response;
+  response.set_okay(true);
+  response.set_next(request.to() + 1);
+
+  // Positions before the beginning have been truncated, those past
+  // the end are unknown.
+  const uint64_t from = std::max(request.from(), begin);
+  const uint64_t to = std::min(request.to(), end);
+
+  if (from <= to) {
+    Try<list<Action> > actions = storage->read(from, to);
+
+    if (actions.isError()) {
+      LOG(ERROR) << "Error getting log records at " << from << " -> " << to
+                 << ": " << actions.error();
+      response.set_okay(false);
+      respond(response);
+      return;
+    }
+
+    uint64_t bytes = 0;
+
+    foreach (const Action& action, actions.get()) {
+      if (request.has_bytes() && bytes >= request.bytes()) {
+        response.set_next(action.position());
+        break;
+      } else if (action.has_learned() && action.learned()) {
+        response.add_actions()->MergeFrom(action);
+        bytes += action.ByteSize();
+      }
+    }
   }
+
+  respond(response);
 }
 
 
@@ -947,6 +1223,10 @@ bool ReplicaProcess::persist(const Promise& promise)
 
   LOG(INFO) << "Persisted promise to " << promise.id();
 
+  if (unsynced++ == 0) {
+    dispatch(self(), &ReplicaProcess::sync);
+  }
+
   return true;
 }
 
@@ -962,6 +1242,16 @@ bool ReplicaProcess::persist(const Action& action)
 
   LOG(INFO) << "Persisted action at " << action.position();
 
+  // Cache learned actions and keep cached ones up to date.
+  if ((action.has_learned() && action.learned()) ||
+      recent.get(action.position()).isSome()) {
+    remember(action);
+  }
+
+  if (unsynced++ == 0) {
+    dispatch(self(), &ReplicaProcess::sync);
+  }
+
   // No longer a hole here (if there even was one).
   holes.erase(action.position());
 
@@ -1002,6 +1292,76 @@ bool ReplicaProcess::persist(const Action& action)
 }
 
 
+void ReplicaProcess::respond(const google::protobuf::Message& message)
+{
+  if (unsynced == 0) {
+    reply(message);
+    return;
+  }
+
+  CHECK(from) << "Attempting to respond without a sender";
+
+  Response response;
+  response.to = from;
+  response.name = message.GetTypeName();
+  message.SerializeToString(&response.data);
+  responses.push_back(response);
+}
+
+
+void ReplicaProcess::sync()
+{
+  if (unsynced == 0) {
+    return;
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  Try<Nothing> result = storage->sync();
+
+  if (result.isError()) {
+    // The records remain in the batch (and might already be visible
+    // to reads), so keep holding every response until a sync
+    // succeeds, otherwise we might report state that never becomes
+    // durable. Note that 'unsynced' stays non-zero, so persisting
+    // more records doesn't dispatch another sync, the retry does.
+    LOG(ERROR) << "Error syncing the log (retrying in "
+               << SYNC_RETRY_INTERVAL << "): " << result.error();
+    delay(SYNC_RETRY_INTERVAL, self(), &ReplicaProcess::sync);
+    return;
+  }
+
+  syncTime.record(stopwatch.elapsed());
+  syncs.increment();
+  synced.increment(unsynced);
+
+  if (statistics != NULL) {
+    statistics->set("log/replica/batch_size", unsynced);
+  }
+
+  unsynced = 0;
+
+  foreach (const Response& response, responses) {
+    send(response.to,
+         response.name,
+         response.data.data(),
+         response.data.size());
+  }
+  responses.clear();
+}
+
+
+void ReplicaProcess::remember(const Action& action)
+{
+  if (action.ByteSize() <= CACHE_MAX_ACTION_SIZE) {
+    recent.put(action.position(), action);
+  } else {
+    recent.erase(action.position());
+  }
+}
+
+
 void ReplicaProcess::recover(const string& path)
 {
   Try<State> state = storage->recover(path);
@@ -1039,9 +1399,242 @@ void ReplicaProcess::recover(const string& path)
 }
 
 
-Replica::Replica(const std::string& path)
+// Catches up a replica by requesting the learned actions of its
+// missing positions from its peers in bulk. The missing positions get
+// split into chunks (ranges of positions) that are requested from the
+// peers in turn while keeping a window of requests outstanding, so
+// reading and sending actions (the peers) overlaps with persisting
+// them (the replica). The actions of a chunk get persisted (and hence
+// synced) together. A chunk that fails or times out gets retried on
+// the next peer until every peer has been tried, after which its
+// positions are left missing. The rest of a chunk whose response was
+// limited (see CatchupRequest) gets requested from the same peer.
+class CatchupProcess : public Process<CatchupProcess>
 {
-  process = new ReplicaProcess(path);
+public:
+  CatchupProcess(const PID<ReplicaProcess>& _replica,
+                 const set<UPID>& _peers,
+                 uint64_t _to,
+                 const Duration& _timeout)
+    : replica(_replica),
+      peers(_peers.begin(), _peers.end()),
+      to(_to),
+      timeout(_timeout),
+      filling(0),
+      filled(0) {}
+
+  Future<uint64_t> future()
+  {
+    return promise.future();
+  }
+
+protected:
+  virtual void initialize()
+  {
+    // Stop catching up if nobody cares about the result anymore
+    // (note, we need to disambiguate the process::terminate).
+    void (*terminate)(const UPID&, bool) = &process::terminate;
+    promise.future().onDiscarded(
+        std::tr1::bind(terminate, self(), true));
+
+    if (peers.empty()) {
+      promise.set(0);
+      process::terminate(self());
+      return;
+    }
+
+    dispatch(replica, &ReplicaProcess::missing, to)
+      .onAny(defer(self(), &Self::missing, params::_1));
+  }
+
+  virtual void finalize()
+  {
+    foreachvalue (Chunk& chunk, chunks) {
+      Timer::cancel(chunk.timer);
+      chunk.response.discard();
+    }
+
+    promise.fail("Catch-up terminated");
+  }
+
+private:
+  // Number of positions in a chunk, limit on the size of the actions
+  // in a response (the rest of the chunk gets requested again) and
+  // the number of outstanding requests.
+  static const uint64_t POSITIONS = 1024;
+  static const uint64_t BYTES = 4 * 1024 * 1024;
+  static const size_t WINDOW = 4;
+
+  struct Chunk
+  {
+    uint64_t from;
+    uint64_t to;
+    size_t peer; // Index of the peer to request the chunk from.
+    size_t attempts; // Number of peers tried.
+    Future<CatchupResponse> response;
+    Timer timer;
+  };
+
+  void missing(const Future<set<uint64_t> >& future)
+  {
+    if (!future.isReady()) {
+      promise.fail(future.isFailed()
+                   ? future.failure()
+                   : "Failed to get the missing positions");
+      process::terminate(self());
+      return;
+    }
+
+    const set<uint64_t>& positions = future.get();
+
+    // Every chunk starts at a missing position.
+    set<uint64_t>::const_iterator iterator = positions.begin();
+    while (iterator != positions.end() && *iterator <= to) {
+      Chunk chunk;
+      chunk.from = *iterator;
+      chunk.to = std::min(to, chunk.from + (POSITIONS - 1));
+      chunk.peer = queued.size() % peers.size();
+      chunk.attempts = 0;
+      queued.push_back(chunk);
+      iterator = positions.upper_bound(chunk.to);
+    }
+
+    LOG(INFO) << "Replica catching up " << positions.size()
+              << " missing positions in " << queued.size() << " chunks from "
+              << peers.size() << " peers";
+
+    send();
+  }
+
+  // Requests queued chunks while within the window and finishes once
+  // all the chunks have been received and filled.
+  void send()
+  {
+    while (!queued.empty() && chunks.size() < WINDOW) {
+      Chunk chunk = queued.front();
+      queued.pop_front();
+
+      CatchupRequest request;
+      request.set_from(chunk.from);
+      request.set_to(chunk.to);
+      request.set_bytes(BYTES);
+
+      chunk.response = protocol::catchup(peers[chunk.peer], request);
+      chunk.response
+        .onAny(defer(self(), &Self::received, params::_1, chunk.from));
+      chunk.timer = delay(timeout, self(), &Self::timedout, chunk.from);
+
+      chunks[chunk.from] = chunk;
+    }
+
+    if (queued.empty() && chunks.empty() && filling == 0) {
+      LOG(INFO) << "Replica caught up " << filled << " positions";
+      promise.set(filled);
+      process::terminate(self());
+    }
+  }
+
+  void received(const Future<CatchupResponse>& future, uint64_t from)
+  {
+    if (chunks.count(from) == 0 || !(chunks[from].response == future)) {
+      return; // Already retried.
+    }
+
+    Chunk chunk = chunks[from];
+    chunks.erase(from);
+    Timer::cancel(chunk.timer);
+
+    if (!future.isReady() || !future.get().okay()) {
+      retry(chunk);
+    } else {
+      const CatchupResponse& response = future.get();
+
+      // Request the rest of the chunk if the response was limited.
+      if (response.next() > chunk.from && response.next() <= chunk.to) {
+        Chunk rest = chunk;
+        rest.from = response.next();
+        rest.attempts = 0;
+        queued.push_front(rest);
+      }
+
+      if (response.actions_size() > 0) {
+        list<Action> actions(
+            response.actions().begin(),
+            response.actions().end());
+
+        filling++;
+        dispatch(replica, &ReplicaProcess::fill, actions)
+          .onAny(defer(self(), &Self::_fill, params::_1));
+      }
+    }
+
+    send();
+  }
+
+  void _fill(const Future<uint64_t>& future)
+  {
+    filling--;
+
+    if (future.isReady()) {
+      filled += future.get();
+    }
+
+    send();
+  }
+
+  void timedout(uint64_t from)
+  {
+    if (chunks.count(from) > 0) {
+      // Retried once the discarded response gets 'received'.
+      chunks[from].response.discard();
+    }
+  }
+
+  void retry(Chunk chunk)
+  {
+    if (++chunk.attempts < peers.size()) {
+      chunk.peer = (chunk.peer + 1) % peers.size();
+      queued.push_back(chunk);
+    } else {
+      LOG(WARNING) << "Replica failed to catch up positions "
+                   << chunk.from << " -> " << chunk.to;
+    }
+  }
+
+  const PID<ReplicaProcess> replica;
+  const vector<UPID> peers;
+  const uint64_t to;
+  const Duration timeout;
+
+  // Outstanding chunks (by first position) and queued chunks.
+  map<uint64_t, Chunk> chunks;
+  deque<Chunk> queued;
+
+  size_t filling; // Number of chunks being filled.
+  uint64_t filled; // Number of positions filled.
+
+  process::Promise<uint64_t> promise;
+};
+
+
+Replica::Replica(const std::string& path, const std::string& storage)
+{
+  // TODO(benh): Factor out and expose storage.
+  if (storage == "leveldb") {
+    process = new ReplicaProcess(path, new LevelDBStorage());
+  } else if (storage == "segmented") {
+    process = new ReplicaProcess(path, new SegmentedStorage());
+  } else {
+    LOG(FATAL) << "Unknown log storage '" << storage << "'";
+  }
+
+  process::spawn(process);
+}
+
+
+Replica::Replica(const std::string& path, Storage* storage)
+{
+  process = new ReplicaProcess(path, storage);
   process::spawn(process);
 }
 
@@ -1086,6 +1679,19 @@ process::Future<uint64_t> Replica::promised()
 }
 
 
+process::Future<uint64_t> Replica::catchup(
+    const std::set<process::UPID>& peers,
+    uint64_t to,
+    const Duration& timeout)
+{
+  CatchupProcess* catchup =
+    new CatchupProcess(process->self(), peers, to, timeout);
+  process::Future<uint64_t> future = catchup->future();
+  process::spawn(catchup, true);
+  return future;
+}
+
+
 process::PID<ReplicaProcess> Replica::pid()
 {
   return process->self();
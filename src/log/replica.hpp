@@ -26,6 +26,7 @@
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
 
+#include <stout/duration.hpp>
 #include <stout/result.hpp>
 #include <stout/try.hpp>
 
@@ -41,20 +42,31 @@ namespace protocol {
 extern Protocol<PromiseRequest, PromiseResponse> promise;
 extern Protocol<WriteRequest, WriteResponse> write;
 extern Protocol<LearnRequest, LearnResponse> learn;
+extern Protocol<CatchupRequest, CatchupResponse> catchup;
 
 } // namespace protocol {
 
 
-// Forward declaration.
+// Forward declarations.
 class ReplicaProcess;
+class Storage;
 
 
 class Replica
 {
 public:
   // Constructs a new replica process using specified path to a
-  // directory for storing the underlying log.
-  Replica(const std::string& path);
+  // directory for storing the underlying log. The storage is either
+  // "leveldb" or "segmented" (append-only segment files, see
+  // log/segmented_storage.hpp).
+  Replica(const std::string& path,
+          const std::string& storage = "leveldb");
+
+  // Constructs a new replica process using the specified storage
+  // (e.g., to inject failures in tests). Takes ownership of the
+  // storage.
+  Replica(const std::string& path, Storage* storage);
+
   ~Replica();
 
   // Returns all the actions between the specified positions, unless
@@ -74,6 +86,19 @@ public:
   // Returns the highest implicit promise this replica has given.
   process::Future<uint64_t> promised();
 
+  // Catches up this replica by requesting the learned actions of its
+  // missing positions (see 'missing') up to the specified position
+  // from the specified peers in bulk, i.e., in chunks of many
+  // positions each (see CatchupRequest). A request that doesn't get a
+  // response within the timeout gets retried on another peer. Returns
+  // the number of positions learned. Positions that none of the peers
+  // have learned remain missing (i.e., they need to get filled by a
+  // coordinator).
+  process::Future<uint64_t> catchup(
+      const std::set<process::UPID>& peers,
+      uint64_t to,
+      const Duration& timeout);
+
   // Returns the PID associated with this replica.
   process::PID<ReplicaProcess> pid();
 
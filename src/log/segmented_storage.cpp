@@ -0,0 +1,688 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+
+#include <algorithm>
+#include <list>
+
+#include <stout/foreach.hpp>
+#include <stout/numify.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/strings.hpp>
+
+#include "log/segmented_storage.hpp"
+
+using std::list;
+using std::map;
+using std::set;
+using std::string;
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+// Each record is prefixed by a header with the length and the
+// checksum of the serialized record.
+static const size_t HEADER_SIZE = 2 * sizeof(uint32_t);
+
+
+// Table for computing a CRC-32 (the same one as zlib).
+struct CRC32Table
+{
+  CRC32Table()
+  {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t value = i;
+      for (int j = 0; j < 8; j++) {
+        value = (value & 1) ? (0xedb88320 ^ (value >> 1)) : (value >> 1);
+      }
+      values[i] = value;
+    }
+  }
+
+  uint32_t values[256];
+};
+
+
+static const CRC32Table table;
+
+
+static uint32_t crc32(const char* data, size_t length)
+{
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < length; i++) {
+    crc = table.values[(crc ^ (uint8_t) data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffff;
+}
+
+
+// Syncs the data of a file (but not necessarily its metadata).
+static int datasync(int fd)
+{
+#ifdef __APPLE__
+  return fsync(fd);
+#else
+  return fdatasync(fd);
+#endif
+}
+
+
+SegmentedStorage::SegmentedStorage(size_t _segmentSize)
+  : segmentSize(_segmentSize),
+    created(false),
+    begin(0),
+    truncated(false)
+{
+  promised.segment = NULL;
+  promised.offset = 0;
+}
+
+
+SegmentedStorage::~SegmentedStorage()
+{
+  foreachvalue (Segment* segment, segments) {
+    close(segment, false);
+  }
+}
+
+
+Try<State> SegmentedStorage::recover(const string& path)
+{
+  directory = path;
+
+  Try<Nothing> mkdir = os::mkdir(directory);
+  if (mkdir.isError()) {
+    return Try<State>::error(
+        "Failed to create '" + directory + "': " + mkdir.error());
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  foreach (const string& entry, os::ls(directory)) {
+    if (!strings::startsWith(entry, "segment-")) {
+      continue;
+    }
+
+    Try<uint64_t> sequence = numify<uint64_t>(entry.substr(8));
+    if (sequence.isError()) {
+      LOG(WARNING) << "Ignoring unexpected file '" << entry << "' in "
+                   << directory;
+      continue;
+    }
+
+    Try<Segment*> segment = open(sequence.get());
+    if (segment.isError()) {
+      return Try<State>::error(segment.error());
+    }
+
+    segments[sequence.get()] = segment.get();
+  }
+
+  State state;
+  state.coordinator = 0;
+  state.begin = 0;
+  state.end = 0;
+
+  uint64_t records = 0;
+
+  // Replay the records of every segment in the order they were
+  // appended, so the last record of a position wins.
+  foreachvalue (Segment* segment, segments) {
+    size_t offset = 0;
+
+    while (true) {
+      Result<Record> result = read(segment, offset);
+
+      if (result.isError()) {
+        return Try<State>::error(
+            "Failed to read record at offset " + stringify(offset) +
+            " of '" + segment->path + "': " + result.error());
+      } else if (result.isNone()) {
+        // Only the last segment can end with a torn record since a
+        // segment gets synced before appending to the next one (see
+        // SegmentedStorage::append), so anywhere else it means that
+        // records which have been synced (and hence acknowledged) got
+        // corrupted.
+        if (segment != segments.rbegin()->second && torn(segment, offset)) {
+          return Try<State>::error(
+              "Corrupted record at offset " + stringify(offset) +
+              " of '" + segment->path + "'");
+        }
+        break;
+      }
+
+      const Record record = result.get();
+
+      records++;
+
+      Location location;
+      location.segment = segment;
+      location.offset = offset;
+
+      switch (record.type()) {
+        case Record::PROMISE: {
+          CHECK(record.has_promise());
+          promise = record.promise();
+          promised = location;
+          state.coordinator = promise.id();
+          break;
+        }
+
+        case Record::ACTION: {
+          CHECK(record.has_action());
+          const Action& action = record.action();
+          if (action.has_learned() && action.learned()) {
+            state.learned.insert(action.position());
+            state.unlearned.erase(action.position());
+            if (action.has_type() && action.type() == Action::TRUNCATE) {
+              state.begin = std::max(state.begin, action.truncate().to());
+            }
+          } else {
+            state.learned.erase(action.position());
+            state.unlearned.insert(action.position());
+          }
+          state.end = std::max(state.end, action.position());
+          index[action.position()] = location;
+          segment->last = segment->actions
+            ? std::max(segment->last, action.position())
+            : action.position();
+          segment->actions = true;
+          break;
+        }
+
+        default: {
+          return Try<State>::error("Bad record");
+        }
+      }
+
+      uint32_t length;
+      memcpy(&length, segment->data + offset, sizeof(length));
+      offset += HEADER_SIZE + length;
+    }
+
+    segment->offset = offset;
+  }
+
+  // If the last segment ends with a torn record (rather than the
+  // zeros it was preallocated with) don't append after it (since the
+  // rest of the torn record might look like a record header). Instead
+  // zero its length so that it reads as the end of the segment once
+  // it isn't the last segment anymore (otherwise the next recovery
+  // would consider it corrupted).
+  if (!segments.empty()) {
+    Segment* segment = segments.rbegin()->second;
+    if (torn(segment, segment->offset)) {
+      LOG(WARNING) << "Ignoring torn record at offset " << segment->offset
+                   << " of '" << segment->path << "'";
+
+      const uint32_t length = 0;
+      ssize_t written =
+        pwrite(segment->fd, &length, sizeof(length), segment->offset);
+      if (written != (ssize_t) sizeof(length)) {
+        return Try<State>::error(
+            "Failed to write '" + segment->path + "': " + strerror(errno));
+      }
+
+      if (datasync(segment->fd) < 0) {
+        return Try<State>::error(
+            "Failed to sync '" + segment->path + "': " + strerror(errno));
+      }
+
+      segment->offset = segment->size;
+    }
+  }
+
+  // Unlike leveldb, which deletes the keys of truncated positions,
+  // the segments still contain (some of) them.
+  begin = state.begin;
+  index.erase(index.begin(), index.lower_bound(begin));
+  state.learned.erase(
+      state.learned.begin(), state.learned.lower_bound(begin));
+  state.unlearned.erase(
+      state.unlearned.begin(), state.unlearned.lower_bound(begin));
+
+  truncated = true;
+  truncate();
+
+  LOG(INFO) << "Recovered " << records << " records from "
+            << segments.size() << " segments in " << stopwatch.elapsed();
+
+  return state;
+}
+
+
+Try<Nothing> SegmentedStorage::persist(const Promise& _promise)
+{
+  Record record;
+  record.set_type(Record::PROMISE);
+  record.mutable_promise()->MergeFrom(_promise);
+
+  Try<Location> location = append(record);
+
+  if (location.isError()) {
+    return Try<Nothing>::error(location.error());
+  }
+
+  promise = _promise;
+  promised = location.get();
+
+  return Nothing();
+}
+
+
+Try<Nothing> SegmentedStorage::persist(const Action& action)
+{
+  Record record;
+  record.set_type(Record::ACTION);
+  record.mutable_action()->MergeFrom(action);
+
+  Try<Location> location = append(record);
+
+  if (location.isError()) {
+    return Try<Nothing>::error(location.error());
+  }
+
+  Segment* segment = location.get().segment;
+  segment->last = segment->actions
+    ? std::max(segment->last, action.position())
+    : action.position();
+  segment->actions = true;
+
+  if (action.position() >= begin) {
+    index[action.position()] = location.get();
+  }
+
+  // Segments get removed (see 'truncate') once a truncation has been
+  // *learned* and synced.
+  if (action.has_type() && action.type() == Action::TRUNCATE &&
+      action.has_learned() && action.learned() &&
+      action.truncate().to() > begin) {
+    begin = action.truncate().to();
+    index.erase(index.begin(), index.lower_bound(begin));
+    truncated = true;
+
+    // Make sure the last promise doesn't get removed with its segment.
+    if (promised.segment != NULL && removable(promised.segment)) {
+      return persist(Promise(promise));
+    }
+  }
+
+  return Nothing();
+}
+
+
+Try<Nothing> SegmentedStorage::sync()
+{
+  foreach (Segment* segment, unsynced) {
+    if (datasync(segment->fd) < 0) {
+      return Try<Nothing>::error(
+          "Failed to sync '" + segment->path + "': " + strerror(errno));
+    }
+  }
+
+  // New segments are only durable once the directory is synced.
+  if (created) {
+    int fd = ::open(directory.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return Try<Nothing>::error(
+          "Failed to open '" + directory + "': " + strerror(errno));
+    }
+
+    if (fsync(fd) < 0) {
+      ::close(fd);
+      return Try<Nothing>::error(
+          "Failed to sync '" + directory + "': " + strerror(errno));
+    }
+
+    ::close(fd);
+    created = false;
+  }
+
+  unsynced.clear();
+
+  truncate();
+
+  return Nothing();
+}
+
+
+Try<Action> SegmentedStorage::read(uint64_t position)
+{
+  map<uint64_t, Location>::const_iterator iterator = index.find(position);
+
+  if (iterator == index.end()) {
+    return Try<Action>::error("Unknown position");
+  }
+
+  Result<Record> record =
+    read(iterator->second.segment, iterator->second.offset);
+
+  if (record.isError()) {
+    return Try<Action>::error(record.error());
+  } else if (record.isNone()) {
+    return Try<Action>::error("Corrupted record");
+  } else if (record.get().type() != Record::ACTION) {
+    return Try<Action>::error("Bad record");
+  }
+
+  return record.get().action();
+}
+
+
+Try<list<Action> > SegmentedStorage::read(uint64_t from, uint64_t to)
+{
+  list<Action> actions;
+
+  map<uint64_t, Location>::const_iterator iterator = index.lower_bound(from);
+
+  for (; iterator != index.end() && iterator->first <= to; ++iterator) {
+    Result<Record> record =
+      read(iterator->second.segment, iterator->second.offset);
+
+    if (record.isError()) {
+      return Try<list<Action> >::error(record.error());
+    } else if (record.isNone()) {
+      return Try<list<Action> >::error("Corrupted record");
+    } else if (record.get().type() != Record::ACTION) {
+      return Try<list<Action> >::error("Bad record");
+    }
+
+    actions.push_back(record.get().action());
+  }
+
+  return actions;
+}
+
+
+string SegmentedStorage::path(uint64_t sequence) const
+{
+  return directory + "/segment-" + stringify(sequence);
+}
+
+
+Try<SegmentedStorage::Segment*> SegmentedStorage::open(uint64_t sequence)
+{
+  const string path = this->path(sequence);
+
+  int fd = ::open(path.c_str(), O_RDWR);
+
+  if (fd < 0) {
+    return Try<Segment*>::error(
+        "Failed to open '" + path + "': " + strerror(errno));
+  }
+
+  struct stat s;
+  if (fstat(fd, &s) < 0) {
+    ::close(fd);
+    return Try<Segment*>::error(
+        "Failed to stat '" + path + "': " + strerror(errno));
+  }
+
+  void* data = NULL;
+
+  // An empty segment (e.g., created right before a crash) can't be
+  // mapped but also doesn't contain any records.
+  if (s.st_size > 0) {
+    data = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      ::close(fd);
+      return Try<Segment*>::error(
+          "Failed to map '" + path + "': " + strerror(errno));
+    }
+  }
+
+  Segment* segment = new Segment();
+  segment->sequence = sequence;
+  segment->path = path;
+  segment->fd = fd;
+  segment->data = (char*) data;
+  segment->size = s.st_size;
+  segment->offset = 0;
+  segment->actions = false;
+  segment->last = 0;
+
+  return segment;
+}
+
+
+Try<SegmentedStorage::Segment*> SegmentedStorage::create(
+    uint64_t sequence,
+    size_t size)
+{
+  const string path = this->path(sequence);
+
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+
+  if (fd < 0) {
+    return Try<Segment*>::error(
+        "Failed to create '" + path + "': " + strerror(errno));
+  }
+
+  // Preallocate the segment so that appending doesn't need to update
+  // the size of the file (which would make every sync more costly).
+#ifdef __linux__
+  int error = posix_fallocate(fd, 0, size);
+#else
+  int error = ftruncate(fd, size) < 0 ? errno : 0;
+#endif
+
+  if (error != 0) {
+    ::close(fd);
+    os::rm(path);
+    return Try<Segment*>::error(
+        "Failed to allocate '" + path + "': " + strerror(error));
+  }
+
+  ::close(fd);
+
+  Try<Segment*> segment = open(sequence);
+
+  if (segment.isSome()) {
+    created = true;
+  }
+
+  return segment;
+}
+
+
+void SegmentedStorage::close(Segment* segment, bool remove)
+{
+  if (segment->data != NULL) {
+    munmap(segment->data, segment->size);
+  }
+
+  ::close(segment->fd);
+
+  if (remove) {
+    Try<Nothing> rm = os::rm(segment->path);
+    if (rm.isError()) {
+      LOG(WARNING) << "Failed to remove '" << segment->path << "': "
+                   << rm.error();
+    }
+  }
+
+  delete segment;
+}
+
+
+Result<Record> SegmentedStorage::read(
+    const Segment* segment,
+    size_t offset) const
+{
+  if (offset + HEADER_SIZE > segment->size) {
+    return Result<Record>::none();
+  }
+
+  uint32_t length;
+  uint32_t checksum;
+  memcpy(&length, segment->data + offset, sizeof(length));
+  memcpy(&checksum, segment->data + offset + sizeof(length), sizeof(checksum));
+
+  if (length == 0 || offset + HEADER_SIZE + length > segment->size) {
+    return Result<Record>::none();
+  }
+
+  const char* data = segment->data + offset + HEADER_SIZE;
+
+  if (crc32(data, length) != checksum) {
+    return Result<Record>::none();
+  }
+
+  google::protobuf::io::ArrayInputStream stream(data, length);
+
+  Record record;
+
+  if (!record.ParseFromZeroCopyStream(&stream)) {
+    return Result<Record>::error("Failed to deserialize record");
+  }
+
+  return record;
+}
+
+
+bool SegmentedStorage::torn(const Segment* segment, size_t offset) const
+{
+  if (offset + HEADER_SIZE > segment->size) {
+    return false;
+  }
+
+  uint32_t length;
+  memcpy(&length, segment->data + offset, sizeof(length));
+  return length != 0;
+}
+
+
+Try<SegmentedStorage::Location> SegmentedStorage::append(const Record& record)
+{
+  string data;
+
+  if (!record.SerializeToString(&data)) {
+    return Try<Location>::error("Failed to serialize record");
+  }
+
+  const size_t size = HEADER_SIZE + data.size();
+
+  Segment* segment = segments.empty() ? NULL : segments.rbegin()->second;
+
+  if (segment == NULL || segment->offset + size > segment->size) {
+    // Sync the current segment before appending to the next one so
+    // that only the last segment can ever end with a torn record
+    // (which recovery relies on to detect corruption).
+    if (segment != NULL && unsynced.count(segment) > 0) {
+      if (datasync(segment->fd) < 0) {
+        return Try<Location>::error(
+            "Failed to sync '" + segment->path + "': " + strerror(errno));
+      }
+      unsynced.erase(segment);
+    }
+
+    const uint64_t sequence = segment == NULL ? 0 : segment->sequence + 1;
+
+    Try<Segment*> created = create(sequence, std::max(segmentSize, size));
+
+    if (created.isError()) {
+      return Try<Location>::error(created.error());
+    }
+
+    segment = created.get();
+    segments[sequence] = segment;
+  }
+
+  const uint32_t length = data.size();
+  const uint32_t checksum = crc32(data.data(), data.size());
+
+  string buffer;
+  buffer.reserve(size);
+  buffer.append((const char*) &length, sizeof(length));
+  buffer.append((const char*) &checksum, sizeof(checksum));
+  buffer.append(data);
+
+  size_t written = 0;
+  while (written < buffer.size()) {
+    ssize_t result = pwrite(
+        segment->fd,
+        buffer.data() + written,
+        buffer.size() - written,
+        segment->offset + written);
+
+    if (result < 0 && errno == EINTR) {
+      continue;
+    } else if (result < 0) {
+      return Try<Location>::error(
+          "Failed to write '" + segment->path + "': " + strerror(errno));
+    }
+
+    written += result;
+  }
+
+  Location location;
+  location.segment = segment;
+  location.offset = segment->offset;
+
+  segment->offset += size;
+  unsynced.insert(segment);
+
+  return location;
+}
+
+
+bool SegmentedStorage::removable(const Segment* segment) const
+{
+  // The last segment is still getting appended to.
+  return segment != segments.rbegin()->second &&
+    (!segment->actions || segment->last < begin);
+}
+
+
+void SegmentedStorage::truncate()
+{
+  if (!truncated) {
+    return;
+  }
+
+  truncated = false;
+
+  map<uint64_t, Segment*>::iterator iterator = segments.begin();
+  while (iterator != segments.end()) {
+    Segment* segment = iterator->second;
+    if (removable(segment) && segment != promised.segment) {
+      LOG(INFO) << "Removing truncated log segment '" << segment->path << "'";
+      close(segment, true);
+      segments.erase(iterator++);
+    } else {
+      ++iterator;
+    }
+  }
+}
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
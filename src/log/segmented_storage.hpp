@@ -0,0 +1,149 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LOG_SEGMENTED_STORAGE_HPP__
+#define __LOG_SEGMENTED_STORAGE_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include <stout/nothing.hpp>
+#include <stout/result.hpp>
+#include <stout/try.hpp>
+
+#include "log/storage.hpp"
+
+#include "messages/log.hpp"
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+// Implementation of the storage interface that takes advantage of
+// the log being (mostly) sequential: records get appended to segment
+// files, each of which is preallocated (so appending doesn't need to
+// update the file size) and memory mapped for reads. Every record is
+// prefixed by its length and a checksum so that recovery can find
+// the end of the (last) segment after a crash, i.e., a torn or zero
+// (preallocated) record header. An in-memory index maps positions to
+// the last record written for them. A learned truncation removes
+// whole segments once no records in them are needed anymore (i.e.,
+// instead of deleting position by position), and a sync only needs
+// to sync the segments appended to since the last sync.
+class SegmentedStorage : public Storage
+{
+public:
+  // Segments are (at least) the specified size, larger records get a
+  // segment of their own.
+  explicit SegmentedStorage(size_t segmentSize = 16 * 1024 * 1024);
+  virtual ~SegmentedStorage();
+
+  virtual Try<State> recover(const std::string& path);
+  virtual Try<Nothing> persist(const Promise& promise);
+  virtual Try<Nothing> persist(const Action& action);
+  virtual Try<Nothing> sync();
+  virtual Try<Action> read(uint64_t position);
+  virtual Try<std::list<Action> > read(uint64_t from, uint64_t to);
+
+private:
+  struct Segment
+  {
+    uint64_t sequence; // Segments are named (and ordered) by sequence.
+    std::string path;
+    int fd;
+    char* data; // Memory mapping of the whole segment.
+    size_t size;
+    size_t offset; // End of the records in the segment.
+    bool actions; // Whether the segment contains any actions.
+    uint64_t last; // Highest position of the actions in the segment.
+  };
+
+  // Location of a record.
+  struct Location
+  {
+    Segment* segment;
+    size_t offset; // Of the record header.
+  };
+
+  // Returns the path of the segment with the specified sequence.
+  std::string path(uint64_t sequence) const;
+
+  // Opens (and maps) an existing segment.
+  Try<Segment*> open(uint64_t sequence);
+
+  // Creates (preallocates and maps) a new segment.
+  Try<Segment*> create(uint64_t sequence, size_t size);
+
+  // Unmaps, closes and optionally removes a segment.
+  void close(Segment* segment, bool remove);
+
+  // Reads the record at the specified offset of a segment. A none
+  // result means that there isn't a (complete and intact) record.
+  Result<Record> read(const Segment* segment, size_t offset) const;
+
+  // Returns true if there is a record header at the specified offset
+  // of a segment (i.e., it's not the end of the segment or the zeros
+  // it was preallocated with) even though there isn't a record there
+  // (see 'read'), i.e., a torn or corrupted record.
+  bool torn(const Segment* segment, size_t offset) const;
+
+  // Appends a record to the current segment (creating a new segment
+  // if it doesn't fit) and returns where it was written.
+  Try<Location> append(const Record& record);
+
+  // Returns true if none of the actions in the segment are needed
+  // anymore (i.e., they have all been truncated).
+  bool removable(const Segment* segment) const;
+
+  // Removes the removable segments (other than the one with the last
+  // promise) after a truncation.
+  void truncate();
+
+  std::string directory;
+  const size_t segmentSize;
+
+  // All the segments by sequence, the last one gets appended to.
+  std::map<uint64_t, Segment*> segments;
+
+  // Segments appended to since the last sync and whether any segment
+  // was created since the last sync (which requires syncing the
+  // directory too).
+  std::set<Segment*> unsynced;
+  bool created;
+
+  // The location of the last record of each (untruncated) position.
+  std::map<uint64_t, Location> index;
+
+  // The last promise and its location (the segment is NULL if none).
+  Promise promise;
+  Location promised;
+
+  // Positions before this have been learned to be truncated, and
+  // whether that changed since segments were last removed.
+  uint64_t begin;
+  bool truncated;
+};
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __LOG_SEGMENTED_STORAGE_HPP__
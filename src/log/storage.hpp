@@ -0,0 +1,70 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef __LOG_STORAGE_HPP__
+#define __LOG_STORAGE_HPP__
+
+#include <stdint.h>
+
+#include <list>
+#include <set>
+#include <string>
+
+#include <stout/nothing.hpp>
+#include <stout/try.hpp>
+
+#include "messages/log.hpp"
+
+namespace mesos {
+namespace internal {
+namespace log {
+
+struct State
+{
+  uint64_t coordinator; // Last promise made to a coordinator.
+  uint64_t begin; // Beginning position of the log.
+  uint64_t end; // Ending position of the log.
+  std::set<uint64_t> learned; // Positions present and learned
+  std::set<uint64_t> unlearned; // Positions present but unlearned.
+};
+
+
+// Abstract interface for reading and writing records. Records are
+// persisted in batches: a persisted record is visible to reads right
+// away but only durable after the next (successful) sync, which
+// makes all of the records persisted since the last sync durable at
+// once. After a failed sync the records remain in the batch (so the
+// next sync retries them). Reading a range of positions returns the
+// actions that have been persisted in the range in order (i.e.,
+// positions without an action are skipped).
+class Storage
+{
+public:
+  virtual ~Storage() {}
+  virtual Try<State> recover(const std::string& path) = 0;
+  virtual Try<Nothing> persist(const Promise& promise) = 0;
+  virtual Try<Nothing> persist(const Action& action) = 0;
+  virtual Try<Nothing> sync() = 0;
+  virtual Try<Action> read(uint64_t position) = 0;
+  virtual Try<std::list<Action> > read(uint64_t from, uint64_t to) = 0;
+};
+
+} // namespace log {
+} // namespace internal {
+} // namespace mesos {
+
+#endif // __LOG_STORAGE_HPP__
@@ -60,6 +60,13 @@ const uint32_t MAX_COMPLETED_TASKS_PER_FRAMEWORK = 1000;
 // Time interval to check for updated watchers list.
 const Duration WHITELIST_WATCH_INTERVAL = Seconds(5.0);
 
+// Time interval between measurements of the master's event queue.
+const Duration EVENT_QUEUE_PROBE_INTERVAL = Seconds(1.0);
+
+// Minimum time interval between snapshots of the master's state
+// taken for state.json.
+const Duration STATE_SNAPSHOT_INTERVAL = Seconds(1.0);
+
 } // namespace mesos {
 } // namespace internal {
 } // namespace master {
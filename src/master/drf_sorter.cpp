@@ -28,97 +28,110 @@ namespace internal {
 namespace master {
 
 bool DRFComparator::operator () (
-    const Client& client1,
-    const Client& client2)
+    const Client* client1,
+    const Client* client2) const
 {
-  if (client1.share == client2.share) {
-    return client1.name < client2.name;
+  if (client1->share == client2->share) {
+    return client1->name < client2->name;
+  }
+  return client1->share < client2->share;
+}
+
+
+DRFSorter::~DRFSorter()
+{
+  foreachvalue (Client* client, clients) {
+    delete client;
   }
-  return client1.share < client2.share;
 }
 
 
 void DRFSorter::add(const string& name)
 {
-  Client client;
-  client.name = name;
-  client.share = 0;
-  clients.insert(client);
+  CHECK(!clients.contains(name));
 
-  allocations[name] = Resources::parse("");
+  Client* client = new Client(name);
+  clients[name] = client;
+  sorted.insert(client);
 }
 
 
 void DRFSorter::remove(const string& name)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
+  Client* client = find(name);
 
-  if (it != clients.end()) {
-    clients.erase(it);
+  if (client->active) {
+    sorted.erase(client);
   }
 
-  allocations.erase(name);
+  clients.erase(name);
+  delete client;
 }
 
 
 void DRFSorter::activate(const string& name)
 {
-  CHECK(allocations.contains(name));
+  Client* client = find(name);
 
-  Client client;
-  client.name = name;
-  client.share = calculateShare(name);
-  clients.insert(client);
+  if (!client->active) {
+    client->active = true;
+    sorted.insert(client);
+  }
 }
 
 
 void DRFSorter::deactivate(const string& name)
 {
-  set<Client, DRFComparator>::iterator it = find(name);
+  Client* client = find(name);
 
-  if (it != clients.end()) {
-    clients.erase(it);
+  if (client->active) {
+    sorted.erase(client);
+    client->active = false;
   }
 }
 
 
 void DRFSorter::allocated(
     const string& name,
-    const Resources& resources)
+    const ResourceVector& resources)
 {
-  allocations[name] += resources;
+  Client* client = find(name);
+
+  client->allocation += resources;
 
   // If the total resources have changed, we're going to
   // recalculate all the shares, so don't bother just
   // updating this client.
   if (!dirty) {
-    update(name);
+    update(client);
   }
 }
 
 
-Resources DRFSorter::allocation(
+ResourceVector DRFSorter::allocation(
     const string& name)
 {
-  return allocations[name];
+  return find(name)->allocation;
 }
 
 
 void DRFSorter::unallocated(
     const string& name,
-    const Resources& resources)
+    const ResourceVector& resources)
 {
-  allocations[name] -= resources;
+  Client* client = find(name);
+
+  client->allocation -= resources;
 
   if (!dirty) {
-    update(name);
+    update(client);
   }
 }
 
 
-void DRFSorter::add(const Resources& _resources)
+void DRFSorter::add(const ResourceVector& resources)
 {
-  resources += _resources;
+  total += resources;
 
   // We have to recalculate all shares when the total resources
   // change, but we put it off until sort is called
@@ -128,65 +141,85 @@ void DRFSorter::add(const Resources& _resources)
 }
 
 
-void DRFSorter::remove(const Resources& _resources)
+void DRFSorter::remove(const ResourceVector& resources)
 {
-  resources -= _resources;
+  total -= resources;
+
   dirty = true;
 }
 
 
 list<string> DRFSorter::sort()
 {
-  if (dirty) {
-    set<Client, DRFComparator> temp;
-
-    set<Client, DRFComparator>::iterator it;
-    for (it = clients.begin(); it != clients.end(); it++) {
-      Client client;
-      client.name = (*it).name;
-      client.share = calculateShare((*it).name);
-      temp.insert(client);
-    }
-
-    clients = temp;
-  }
-
   list<string> ret;
 
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    ret.push_back((*it).name);
+  for (const_iterator it = begin(); it != end(); ++it) {
+    ret.push_back(*it);
   }
 
   return ret;
 }
 
 
+DRFSorter::const_iterator DRFSorter::begin()
+{
+  refresh();
+  return const_iterator(sorted.begin());
+}
+
+
+DRFSorter::const_iterator DRFSorter::end()
+{
+  return const_iterator(sorted.end());
+}
+
+
 bool DRFSorter::contains(const string& name)
 {
-  return allocations.contains(name);
+  return clients.contains(name);
 }
 
 
 int DRFSorter::count()
 {
-  return allocations.size();
+  return clients.size();
+}
+
+
+void DRFSorter::update(Client* client)
+{
+  if (client->active) {
+    sorted.erase(client);
+  }
+
+  client->share = calculateShare(client);
+
+  if (client->active) {
+    sorted.insert(client);
+  }
 }
 
-void DRFSorter::update(const string& name)
+
+void DRFSorter::refresh()
 {
-  set<Client, DRFComparator>::iterator it;
-  it = find(name);
-  clients.erase(it);
+  if (dirty) {
+    // Changing the shares would break the ordering of 'sorted' so
+    // we rebuild it from scratch.
+    sorted.clear();
+
+    foreachvalue (Client* client, clients) {
+      client->share = calculateShare(client);
+      if (client->active) {
+        sorted.insert(client);
+      }
+    }
 
-  Client client;
-  client.name = name;
-  client.share = calculateShare(name);
-  clients.insert(client);
+    dirty = false;
+  }
 }
 
 
-double DRFSorter::calculateShare(const string& name)
+double DRFSorter::calculateShare(const Client* client)
 {
   double share = 0;
 
@@ -194,15 +227,9 @@ double DRFSorter::calculateShare(const string& name)
   // currently does not take into account resources that are not
   // scalars.
 
-  foreach (const Resource& resource, resources) {
-    if (resource.type() == Value::SCALAR) {
-      double total = resource.scalar().value();
-
-      if (total > 0) {
-	Value::Scalar none;
-	const Value::Scalar& scalar = allocations[name].get(resource.name(), none);
-	share = std::max(share, scalar.value() / total);
-      }
+  for (size_t i = 0; i < total.scalarCount(); i++) {
+    if (total.scalar(i) > 0) {
+      share = std::max(share, client->allocation.scalar(i) / total.scalar(i));
     }
   }
 
@@ -210,16 +237,10 @@ double DRFSorter::calculateShare(const string& name)
 }
 
 
-set<Client, DRFComparator>::iterator DRFSorter::find(const string& name)
+Client* DRFSorter::find(const string& name)
 {
-  set<Client, DRFComparator>::iterator it;
-  for (it = clients.begin(); it != clients.end(); it++) {
-    if (name == (*it).name) {
-      break;
-    }
-  }
-
-  return it;
+  CHECK(clients.contains(name)) << "Unknown client " << name;
+  return clients[name];
 }
 
 } // namespace master {
@@ -19,6 +19,14 @@
 #ifndef __DRF_SORTER_HPP__
 #define __DRF_SORTER_HPP__
 
+#include <list>
+#include <set>
+#include <string>
+
+#include <stout/hashmap.hpp>
+
+#include "common/resource_vector.hpp"
+
 #include "master/sorter.hpp"
 
 
@@ -28,26 +36,35 @@ namespace master {
 
 struct Client
 {
-  std::string name;
+  Client(const std::string& _name)
+    : name(_name), share(0), active(true) {}
+
+  const std::string name;
+
+  // Dominant share, kept up to date as resources get allocated and
+  // unallocated (unless the sorter is dirty, see DRFSorter).
   double share;
+
+  // Whether or not this client is in the sort.
+  bool active;
+
+  // Resources allocated to this client.
+  ResourceVector allocation;
 };
 
 
 struct DRFComparator
 {
-  virtual ~DRFComparator() {}
-  virtual bool operator () (const Client& client1,
-                            const Client& client2);
+  bool operator () (const Client* client1, const Client* client2) const;
 };
 
 
-typedef std::set<Client, DRFComparator> drfSet;
-
-
 class DRFSorter : public Sorter
 {
 public:
-  virtual ~DRFSorter() {}
+  DRFSorter() : dirty(false) {}
+
+  virtual ~DRFSorter();
 
   virtual void add(const std::string& name);
 
@@ -58,16 +75,16 @@ public:
   virtual void deactivate(const std::string& name);
 
   virtual void allocated(const std::string& name,
-			 const Resources& resources);
+			 const ResourceVector& resources);
 
   virtual void unallocated(const std::string& name,
-			   const Resources& resources);
+			   const ResourceVector& resources);
 
-  virtual Resources allocation(const std::string& name);
+  virtual ResourceVector allocation(const std::string& name);
 
-  virtual void add(const Resources& resources);
+  virtual void add(const ResourceVector& resources);
 
-  virtual void remove(const Resources& resources);
+  virtual void remove(const ResourceVector& resources);
 
   virtual std::list<std::string> sort();
 
@@ -75,29 +92,66 @@ public:
 
   virtual int count();
 
+  // Iterates over the names of the active clients in the same order
+  // as 'sort' without copying them. Any change to the sorter
+  // invalidates the iterators.
+  class const_iterator
+  {
+  public:
+    const_iterator() {}
+
+    const std::string& operator * () const { return (*it)->name; }
+    const std::string* operator -> () const { return &(*it)->name; }
+
+    const_iterator& operator ++ () { ++it; return *this; }
+
+    bool operator == (const const_iterator& that) const
+    {
+      return it == that.it;
+    }
+
+    bool operator != (const const_iterator& that) const
+    {
+      return it != that.it;
+    }
+
+  private:
+    friend class DRFSorter;
+
+    const_iterator(std::set<Client*, DRFComparator>::const_iterator _it)
+      : it(_it) {}
+
+    std::set<Client*, DRFComparator>::const_iterator it;
+  };
+
+  const_iterator begin();
+  const_iterator end();
+
 private:
   // Recalculates the share for the client and moves
-  // it in 'clients' accordingly.
-  void update(const std::string& name);
+  // it in 'sorted' accordingly.
+  void update(Client* client);
+
+  // Recalculates all shares if the total resources have changed.
+  void refresh();
 
   // Returns the dominant resource share for the client.
-  double calculateShare(const std::string& name);
+  double calculateShare(const Client* client);
 
-  // Returns an iterator to the specified client, if
-  // it exists in this Sorter.
-  std::set<Client, DRFComparator>::iterator find(const std::string& name);
+  // Returns the client with the specified name (which must exist).
+  Client* find(const std::string& name);
 
-  // If true, start() will recalculate all shares.
+  // If true, shares need to be recalculated before sorting.
   bool dirty;
 
-  // A set of Clients (names and shares) sorted by share.
-  std::set<Client, DRFComparator> clients;
+  // All clients, active or deactivated, by name.
+  hashmap<std::string, Client*> clients;
 
-  // Maps client names to the resources they have been allocated.
-  hashmap<std::string, Resources> allocations;
+  // Active clients sorted by share.
+  std::set<Client*, DRFComparator> sorted;
 
   // Total resources.
-  Resources resources;
+  ResourceVector total;
 };
 
 } // namespace master {
@@ -19,7 +19,11 @@
 #ifndef __HIERARCHICAL_ALLOCATOR_PROCESS_HPP__
 #define __HIERARCHICAL_ALLOCATOR_PROCESS_HPP__
 
+#include <map>
+#include <vector>
+
 #include <process/delay.hpp>
+#include <process/statistics.hpp>
 #include <process/timeout.hpp>
 #include <process/timer.hpp>
 
@@ -27,6 +31,7 @@
 #include <stout/hashmap.hpp>
 #include <stout/stopwatch.hpp>
 
+#include "common/resource_vector.hpp"
 #include "common/resources.hpp"
 
 #include "master/allocator.hpp"
@@ -49,7 +54,9 @@ template <class UserSorter, class FrameworkSorter>
 class HierarchicalAllocatorProcess : public AllocatorProcess
 {
 public:
-  HierarchicalAllocatorProcess() : initialized(false) {}
+  HierarchicalAllocatorProcess()
+    : initialized(false),
+      allocationTime("allocator/allocation_time_ms") {}
 
   virtual ~HierarchicalAllocatorProcess() {}
 
@@ -102,17 +109,33 @@ protected:
   // Callback for doing batch allocations.
   void batch();
 
-  // Allocate any allocatable resources.
+  // Allocate any allocatable resources that might have become
+  // offerable since the last allocation, i.e., resources on the dirty
+  // slaves and resources on any slave for the dirty frameworks.
   void allocate();
 
   // Allocate resources just from the specified slave.
   void allocate(const SlaveID& slaveId);
 
-  // Allocate resources from the specified slaves.
-  void allocate(const hashset<SlaveID>& slaveIds);
+  // Allocate resources from the specified slaves to any framework
+  // and from every other slave to the specified frameworks.
+  void allocate(const hashset<SlaveID>& slaveIds,
+                const hashset<FrameworkID>& frameworkIds);
+
+  // Sends the offerable resources to the master. This is virtual so
+  // that the allocator can be driven without a master (e.g., by the
+  // allocator benchmark).
+  virtual void offer(const FrameworkID& frameworkId,
+                     const hashmap<SlaveID, Resources>& offerable);
+
+  // Removes all the filters that have expired.
+  void expire();
+
+  // Removes all the filters for the specified framework.
+  void unfilter(const FrameworkID& frameworkId);
 
-  // Remove a filter for the specified framework.
-  void expire(const FrameworkID& frameworkId, Filter* filter);
+  // Publishes the filter counters to the (libprocess) statistics.
+  void publish();
 
   // Checks whether the slave is whitelisted.
   bool isWhitelisted(const SlaveID& slave);
@@ -121,7 +144,7 @@ protected:
   // on this slave.
   bool isFiltered(const FrameworkID& frameworkId,
 		  const SlaveID& slaveId,
-		  const Resources& resources);
+		  const ResourceVector& resources) const;
 
   bool initialized;
 
@@ -136,13 +159,39 @@ protected:
   hashmap<std::string, FrameworkSorter*> sorters;
 
   // Maps slaves to their allocatable resources.
-  hashmap<SlaveID, Resources> allocatable;
+  hashmap<SlaveID, ResourceVector> allocatable;
 
   // Contains all active slaves.
   hashmap<SlaveID, SlaveInfo> slaves;
 
-  // Filters that have been added by frameworks.
-  multihashmap<FrameworkID, Filter*> filters;
+  // Slaves whose allocatable resources (or filters) have changed and
+  // frameworks that might want resources they were previously not
+  // offered (e.g., they were just added or revived their offers)
+  // since the last allocation. Every other (framework, slave) pair
+  // was already considered and filtered (or the slave had no
+  // available resources), so only these need to be allocated.
+  hashset<SlaveID> dirtySlaves;
+  hashset<FrameworkID> dirtyFrameworks;
+
+  // Filters that have been added by frameworks, indexed by slave.
+  hashmap<FrameworkID, hashmap<SlaveID, std::vector<Filter*> > > filters;
+
+  // When (in seconds since the epoch) filters for a framework on a
+  // slave expire. Expired filters get removed lazily, before each
+  // allocation (see 'expire'), so an entry might refer to filters
+  // that have already been removed.
+  std::multimap<double, std::pair<FrameworkID, SlaveID> > expirations;
+
+  // Filter counters (cumulative, see 'allocate') and their values
+  // when last published (see 'publish').
+  struct Counters {
+    size_t filters;
+    uint64_t lookups;
+    uint64_t hits;
+  } counters, published;
+
+  // Time spent performing allocations (see 'allocate').
+  process::Histogram allocationTime;
 
   // Slaves to send offers for.
   Option<hashset<std::string> > whitelist;
@@ -152,34 +201,37 @@ protected:
 };
 
 
-// Used to represent "filters" for resources unused in offers.
+// Used to represent "filters" for resources unused in offers. Filters
+// are kept per slave, so a filter only needs to check the resources.
 class Filter
 {
 public:
   virtual ~Filter() {}
-  virtual bool filter(const SlaveID& slaveId, const Resources& resources) = 0;
+  virtual bool filter(const ResourceVector& resources) = 0;
+  virtual bool expired() = 0;
 };
 
 
 class RefusedFilter : public Filter
 {
 public:
-  RefusedFilter(const SlaveID& _slaveId,
-                const Resources& _resources,
-                const Timeout& _timeout)
-    : slaveId(_slaveId),
-      resources(_resources),
+  RefusedFilter(const ResourceVector& _resources, const Timeout& _timeout)
+    : resources(_resources),
       timeout(_timeout) {}
 
-  virtual bool filter(const SlaveID& slaveId, const Resources& resources)
+  virtual bool filter(const ResourceVector& resources)
+  {
+    // Refused resources are superset. Note that we don't check the
+    // timeout since expired filters get removed before allocating.
+    return resources <= this->resources;
+  }
+
+  virtual bool expired()
   {
-    return slaveId == this->slaveId &&
-      resources <= this->resources && // Refused resources are superset.
-      timeout.remaining() > Seconds(0);
+    return timeout.remaining() <= Seconds(0);
   }
 
-  const SlaveID slaveId;
-  const Resources resources;
+  const ResourceVector resources;
   const Timeout timeout;
 };
 
@@ -194,6 +246,10 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::initialize(
   initialized = true;
   userSorter = new UserSorter();
 
+  counters.filters = published.filters = 0;
+  counters.lookups = published.lookups = 0;
+  counters.hits = published.hits = 0;
+
   delay(flags.allocation_interval, self(),
 	&HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::batch);
 }
@@ -217,12 +273,15 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkAdded(
   sorters[user]->add(frameworkId.value());
 
   // Update the allocation to this framework.
-  userSorter->allocated(user, used);
-  sorters[user]->add(used);
-  sorters[user]->allocated(frameworkId.value(), used);
+  const ResourceVector allocation = used;
+  userSorter->allocated(user, allocation);
+  sorters[user]->add(allocation);
+  sorters[user]->allocated(frameworkId.value(), allocation);
 
   users[frameworkId] = frameworkInfo.user();
 
+  dirtyFrameworks.insert(frameworkId);
+
   LOG(INFO) << "Added framework " << frameworkId;
 
   allocate();
@@ -238,7 +297,7 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkRemoved
   // Might not be in 'sorters[user]' because it was previously
   // deactivated and never re-added.
   if (sorters[user]->contains(frameworkId.value())) {
-    Resources allocation = sorters[user]->allocation(frameworkId.value());
+    ResourceVector allocation = sorters[user]->allocation(frameworkId.value());
     userSorter->unallocated(user, allocation);
     sorters[user]->remove(allocation);
     sorters[user]->remove(frameworkId.value());
@@ -246,6 +305,8 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkRemoved
 
   users.erase(frameworkId);
 
+  dirtyFrameworks.erase(frameworkId);
+
   // If this user doesn't have any more active frameworks, remove it.
   if (sorters[user]->count() == 0) {
     Sorter* s = sorters[user];
@@ -255,15 +316,7 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkRemoved
     userSorter->remove(user);
   }
 
-  foreach (Filter* filter, filters.get(frameworkId)) {
-    filters.remove(frameworkId, filter);
-
-    // Do not delete the filter, see comments in
-    // HierarchicalAllocatorProcess::offersRevived and
-    // HierarchicalAllocatorProcess::expire.
-  }
-
-  filters.remove(frameworkId);
+  unfilter(frameworkId);
 
   LOG(INFO) << "Removed framework " << frameworkId;
 }
@@ -279,6 +332,8 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkActivat
   std::string user = frameworkInfo.user();
   sorters[user]->activate(frameworkId.value());
 
+  dirtyFrameworks.insert(frameworkId);
+
   LOG(INFO) << "Activated framework " << frameworkId;
 
   allocate();
@@ -299,15 +354,9 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::frameworkDeactiv
   // of the resources that it is using. We might be able to collapse
   // the added/removed and activated/deactivated in the future.
 
-  foreach (Filter* filter, filters.get(frameworkId)) {
-    filters.remove(frameworkId, filter);
-
-    // Do not delete the filter, see comments in
-    // HierarchicalAllocatorProcess::offersRevived and
-    // HierarchicalAllocatorProcess::expire.
-  }
+  unfilter(frameworkId);
 
-  filters.remove(frameworkId);
+  dirtyFrameworks.erase(frameworkId);
 
   LOG(INFO) << "Deactivated framework " << frameworkId;
 }
@@ -325,11 +374,17 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::slaveAdded(
 
   slaves[slaveId] = slaveInfo;
 
-  userSorter->add(slaveInfo.resources());
+  const ResourceVector total = slaveInfo.resources();
+
+  userSorter->add(total);
 
-  Resources unused = slaveInfo.resources();
+  ResourceVector unused = total;
+
+  foreachpair (const FrameworkID& frameworkId,
+               const Resources& _resources,
+               used) {
+    const ResourceVector resources = _resources;
 
-  foreachpair (const FrameworkID& frameworkId, const Resources& resources, used) {
     if (users.contains(frameworkId)) {
       const std::string& user = users[frameworkId];
       sorters[user]->add(resources);
@@ -363,9 +418,10 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::slaveRemoved(con
 
   allocatable.erase(slaveId);
 
+  dirtySlaves.erase(slaveId);
+
   // Note that we DO NOT actually delete any filters associated with
-  // this slave, that will occur when the delayed
-  // HierarchicalAllocatorProcess::expire gets invoked (or the framework
+  // this slave, that will occur when they expire (or the framework
   // that applied the filters gets removed).
 
   LOG(INFO) << "Removed slave " << slaveId;
@@ -380,6 +436,11 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::updateWhitelist(
 
   whitelist = _whitelist;
 
+  // Slaves might have been added to the whitelist.
+  foreachkey (const SlaveID& slaveId, slaves) {
+    dirtySlaves.insert(slaveId);
+  }
+
   if (whitelist.isSome()) {
     LOG(INFO) << "Updated slave white list:";
     foreach (const std::string& hostname, whitelist.get()) {
@@ -404,12 +465,14 @@ template <class UserSorter, class FrameworkSorter>
 void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::resourcesUnused(
     const FrameworkID& frameworkId,
     const SlaveID& slaveId,
-    const Resources& resources,
+    const Resources& _resources,
     const Option<Filters>& filters)
 {
   CHECK(initialized);
 
-  if (resources.allocatable().size() == 0) {
+  const ResourceVector resources = _resources;
+
+  if (resources.allocatable().empty()) {
     return;
   }
 
@@ -433,6 +496,8 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::resourcesUnused(
   CHECK(allocatable.contains(slaveId));
   allocatable[slaveId] += resources;
 
+  dirtySlaves.insert(slaveId);
+
   // Create a refused resources filter.
   Seconds seconds(filters.isSome()
                   ? filters.get().refuse_seconds()
@@ -443,16 +508,16 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::resourcesUnused(
 	      << " filtered slave " << slaveId
 	      << " for " << seconds;
 
-    // Create a new filter and delay it's expiration.
-    mesos::internal::master::Filter* filter =
-      new RefusedFilter(slaveId, resources, Timeout(seconds));
+    // Create a new filter and remember when it expires.
+    Timeout timeout(seconds);
 
-    this->filters.put(frameworkId, filter);
+    this->filters[frameworkId][slaveId].push_back(
+        new RefusedFilter(resources, timeout));
 
-    delay(seconds, self(),
-          &HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::expire,
-          frameworkId,
-          filter);
+    counters.filters++;
+
+    expirations.insert(
+        std::make_pair(timeout.value(), std::make_pair(frameworkId, slaveId)));
   }
 }
 
@@ -461,11 +526,13 @@ template <class UserSorter, class FrameworkSorter>
 void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::resourcesRecovered(
     const FrameworkID& frameworkId,
     const SlaveID& slaveId,
-    const Resources& resources)
+    const Resources& _resources)
 {
   CHECK(initialized);
 
-  if (resources.allocatable().size() == 0) {
+  const ResourceVector resources = _resources;
+
+  if (resources.allocatable().empty()) {
     return;
   }
 
@@ -488,6 +555,8 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::resourcesRecover
   if (allocatable.contains(slaveId)) {
     allocatable[slaveId] += resources;
 
+    dirtySlaves.insert(slaveId);
+
     VLOG(1) << "Recovered " << resources.allocatable()
             << " on slave " << slaveId
             << " from framework " << frameworkId;
@@ -501,18 +570,9 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::offersRevived(co
 {
   CHECK(initialized);
 
-  foreach (Filter* filter, filters.get(frameworkId)) {
-    filters.remove(frameworkId, filter);
+  unfilter(frameworkId);
 
-    // We delete each actual Filter when
-    // HierarchicalAllocatorProcess::expire gets invoked. If we delete the
-    // Filter here it's possible that the same Filter (i.e., same
-    // address) could get reused and HierarchicalAllocatorProcess::expire
-    // would expire that filter too soon. Note that this only works
-    // right now because ALL Filter types "expire".
-  }
-
-  filters.remove(frameworkId);
+  dirtyFrameworks.insert(frameworkId);
 
   LOG(INFO) << "Removed filters for framework " << frameworkId;
 
@@ -535,13 +595,27 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate()
 {
   CHECK(initialized);
 
+  // Remove expired filters first since that makes slaves dirty.
+  expire();
+
+  if (dirtySlaves.empty() && dirtyFrameworks.empty()) {
+    VLOG(1) << "No slaves or frameworks to allocate for";
+    return;
+  }
+
   Stopwatch stopwatch;
   stopwatch.start();
 
-  allocate(slaves.keys());
+  allocate(dirtySlaves, dirtyFrameworks);
+
+  allocationTime.record(stopwatch.elapsed());
 
-  LOG(INFO) << "Performed allocation for " << slaves.size()
-            << " slaves in " << stopwatch.elapsed();
+  LOG(INFO) << "Performed allocation for " << dirtySlaves.size()
+            << " slaves and " << dirtyFrameworks.size()
+            << " frameworks in " << stopwatch.elapsed();
+
+  dirtySlaves.clear();
+  dirtyFrameworks.clear();
 }
 
 
@@ -553,10 +627,16 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const S
   hashset<SlaveID> slaveIds;
   slaveIds.insert(slaveId);
 
+  expire();
+
   Stopwatch stopwatch;
   stopwatch.start();
 
-  allocate(slaveIds);
+  allocate(slaveIds, hashset<FrameworkID>());
+
+  allocationTime.record(stopwatch.elapsed());
+
+  dirtySlaves.erase(slaveId);
 
   LOG(INFO) << "Performed allocation for slave " << slaveId
             << " in " << stopwatch.elapsed();
@@ -564,7 +644,9 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const S
 
 
 template <class UserSorter, class FrameworkSorter>
-void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const hashset<SlaveID>& slaveIds)
+void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(
+    const hashset<SlaveID>& slaveIds,
+    const hashset<FrameworkID>& frameworkIds)
 {
   CHECK(initialized);
 
@@ -575,14 +657,29 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const h
 
   // Get out only "available" resources (i.e., resources that are
   // allocatable and above a certain threshold, see below).
-  hashmap<SlaveID, Resources> available;
-  foreachpair (const SlaveID& slaveId, Resources resources, allocatable) {
-    if (!slaveIds.contains(slaveId)) {
-      continue;
+  static const size_t cpus = ResourceVector::index("cpus", Value::SCALAR);
+  static const size_t mem = ResourceVector::index("mem", Value::SCALAR);
+
+  // Only the specified slaves need to be looked at unless some
+  // frameworks need to be considered for every slave.
+  std::vector<SlaveID> candidates;
+  if (frameworkIds.empty()) {
+    foreach (const SlaveID& slaveId, slaveIds) {
+      if (allocatable.contains(slaveId)) {
+        candidates.push_back(slaveId);
+      }
     }
+  } else {
+    foreachkey (const SlaveID& slaveId, allocatable) {
+      candidates.push_back(slaveId);
+    }
+  }
 
+  hashmap<SlaveID, ResourceVector> available;
+  foreach (const SlaveID& slaveId, candidates) {
     if (isWhitelisted(slaveId)) {
-      resources = resources.allocatable(); // Make sure they're allocatable.
+      // Make sure they're allocatable.
+      ResourceVector resources = allocatable[slaveId].allocatable();
 
       // TODO(benh): For now, only make offers when there is some cpu
       // and memory left. This is an artifact of the original code that
@@ -592,11 +689,8 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const h
       // and then end up waiting the default Filters::refuse_seconds
       // (unless the framework set it to something different).
 
-      Value::Scalar none;
-      Value::Scalar cpus = resources.get("cpus", none);
-      Value::Scalar mem = resources.get("mem", none);
-
-      if (cpus.value() >= MIN_CPUS && mem.value() > MIN_MEM) {
+      if (resources.scalar(cpus) >= MIN_CPUS &&
+          resources.scalar(mem) > MIN_MEM) {
 	VLOG(1) << "Found available resources: " << resources
 		<< " on slave " << slaveId;
 	available[slaveId] = resources;
@@ -609,61 +703,176 @@ void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::allocate(const h
     return;
   }
 
-  foreach (const std::string& user, userSorter->sort()) {
-    foreach (const std::string& frameworkIdValue, sorters[user]->sort()) {
+  // The frameworks in the order they get offered resources. We
+  // don't update the sorters until we're done allocating (which also
+  // means every user and framework gets visited in the order they
+  // were sorted at the start of this allocation).
+  std::vector<FrameworkID> sorted;
+
+  typename UserSorter::const_iterator user;
+  for (user = userSorter->begin(); user != userSorter->end(); ++user) {
+    FrameworkSorter* frameworkSorter = sorters[*user];
+
+    typename FrameworkSorter::const_iterator frameworkIdValue;
+    for (frameworkIdValue = frameworkSorter->begin();
+         frameworkIdValue != frameworkSorter->end();
+         ++frameworkIdValue) {
       FrameworkID frameworkId;
-      frameworkId.set_value(frameworkIdValue);
-
-      Resources allocatedResources;
-      hashmap<SlaveID, Resources> offerable;
-      foreachpair (const SlaveID& slaveId, const Resources& resources, available) {
-	// Check whether or not this framework filters this slave.
-	bool filtered = isFiltered(frameworkId, slaveId, resources);
-
-	if (!filtered) {
-	  VLOG(1) << "Offering " << resources
-		  << " on slave " << slaveId
-		  << " to framework " << frameworkId;
-	  offerable[slaveId] = resources;
-
-	  // Update framework and slave resources.
-	  allocatable[slaveId] -= resources;
-	  allocatedResources += resources;
-	}
-      }
+      frameworkId.set_value(*frameworkIdValue);
+      sorted.push_back(frameworkId);
+    }
+  }
+
+  std::vector<bool> everywhere(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++) {
+    everywhere[i] = frameworkIds.contains(sorted[i]);
+  }
 
-      if (offerable.size() > 0) {
-	foreachkey (const SlaveID& slaveId, offerable) {
-	  available.erase(slaveId);
-	}
+  // Since the order of the frameworks is fixed for this allocation,
+  // each slave gets offered to the first framework (in that order)
+  // that doesn't filter it.
+  std::vector<hashmap<SlaveID, Resources> > offerable(sorted.size());
+  std::vector<ResourceVector> allocated(sorted.size());
+
+  foreachpair (const SlaveID& slaveId,
+               const ResourceVector& resources,
+               available) {
+    const bool dirty = slaveIds.contains(slaveId);
+
+    for (size_t index = 0; index < sorted.size(); index++) {
+      // Every framework that doesn't need to be considered for every
+      // slave already filtered this slave (see 'dirtySlaves').
+      if (!dirty && !everywhere[index]) {
+        continue;
+      }
 
-	sorters[user]->add(allocatedResources);
-	sorters[user]->allocated(frameworkIdValue, allocatedResources);
-	userSorter->allocated(user, allocatedResources);
+      counters.lookups++;
 
-	dispatch(master, &Master::offer, frameworkId, offerable);
+      // Check whether or not this framework filters this slave.
+      if (isFiltered(sorted[index], slaveId, resources)) {
+        counters.hits++;
+        continue;
       }
+
+      VLOG(1) << "Offering " << resources
+              << " on slave " << slaveId
+              << " to framework " << sorted[index];
+
+      offerable[index][slaveId] = resources.resources();
+
+      // Update framework and slave resources.
+      allocatable[slaveId] -= resources;
+      allocated[index] += resources;
+      break;
     }
   }
+
+  for (size_t i = 0; i < sorted.size(); i++) {
+    if (offerable[i].size() > 0) {
+      offer(sorted[i], offerable[i]);
+
+      const std::string& user = users[sorted[i]];
+      sorters[user]->add(allocated[i]);
+      sorters[user]->allocated(sorted[i].value(), allocated[i]);
+      userSorter->allocated(user, allocated[i]);
+    }
+  }
+
+  publish();
 }
 
 
 template <class UserSorter, class FrameworkSorter>
-void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::expire(
+void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::offer(
     const FrameworkID& frameworkId,
-    Filter* filter)
+    const hashmap<SlaveID, Resources>& offerable)
 {
-  // The filter might have already been removed (e.g., if the
-  // framework no longer exists or in
-  // HierarchicalAllocatorProcess::offersRevived) but not yet deleted (to
-  // keep the address from getting reused possibly causing premature
-  // expiration).
-  if (users.contains(frameworkId) &&
-      filters.contains(frameworkId, filter)) {
-    filters.remove(frameworkId, filter);
+  dispatch(master, &Master::offer, frameworkId, offerable);
+}
+
+
+template <class UserSorter, class FrameworkSorter>
+void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::expire()
+{
+  const double now = Clock::now();
+
+  while (!expirations.empty() && expirations.begin()->first <= now) {
+    const FrameworkID frameworkId = expirations.begin()->second.first;
+    const SlaveID slaveId = expirations.begin()->second.second;
+
+    expirations.erase(expirations.begin());
+
+    // The filters might have already been removed (e.g., if the
+    // framework no longer exists or its offers were revived).
+    if (!filters.contains(frameworkId) ||
+        !filters[frameworkId].contains(slaveId)) {
+      continue;
+    }
+
+    std::vector<Filter*>& _filters = filters[frameworkId][slaveId];
+
+    std::vector<Filter*>::iterator iterator = _filters.begin();
+    while (iterator != _filters.end()) {
+      if ((*iterator)->expired()) {
+        delete *iterator;
+        iterator = _filters.erase(iterator);
+        counters.filters--;
+        dirtySlaves.insert(slaveId);
+      } else {
+        ++iterator;
+      }
+    }
+
+    if (_filters.empty()) {
+      filters[frameworkId].erase(slaveId);
+      if (filters[frameworkId].empty()) {
+        filters.erase(frameworkId);
+      }
+    }
   }
+}
+
 
-  delete filter;
+template <class UserSorter, class FrameworkSorter>
+void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::unfilter(
+    const FrameworkID& frameworkId)
+{
+  if (filters.contains(frameworkId)) {
+    foreachvalue (const std::vector<Filter*>& _filters, filters[frameworkId]) {
+      foreach (Filter* filter, _filters) {
+        delete filter;
+        counters.filters--;
+      }
+    }
+
+    // Any expirations for these filters are ignored (see 'expire').
+    filters.erase(frameworkId);
+  }
+}
+
+
+template <class UserSorter, class FrameworkSorter>
+void HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::publish()
+{
+  if (counters.filters != published.filters) {
+    process::statistics->set("allocator/filters", counters.filters);
+  }
+
+  if (counters.lookups != published.lookups) {
+    process::statistics->set("allocator/filter_lookups", counters.lookups);
+
+    // The hit rate of the lookups since we last published.
+    process::statistics->set(
+        "allocator/filter_hit_rate",
+        (counters.hits - published.hits) /
+        (double) (counters.lookups - published.lookups));
+  }
+
+  if (counters.hits != published.hits) {
+    process::statistics->set("allocator/filter_hits", counters.hits);
+  }
+
+  published = counters;
 }
 
 
@@ -684,19 +893,31 @@ template <class UserSorter, class FrameworkSorter>
 bool HierarchicalAllocatorProcess<UserSorter, FrameworkSorter>::isFiltered(
     const FrameworkID& frameworkId,
     const SlaveID& slaveId,
-    const Resources& resources)
+    const ResourceVector& resources) const
 {
-  bool filtered = false;
-  foreach (Filter* filter, filters.get(frameworkId)) {
-    if (filter->filter(slaveId, resources)) {
+  // Note that this must not modify any state (e.g., by using
+  // hashmap::operator[]) since it gets called concurrently.
+  if (!filters.contains(frameworkId)) {
+    return false;
+  }
+
+  const hashmap<SlaveID, std::vector<Filter*> >& _filters =
+    filters.find(frameworkId)->second;
+
+  if (!_filters.contains(slaveId)) {
+    return false;
+  }
+
+  foreach (Filter* filter, _filters.find(slaveId)->second) {
+    if (filter->filter(resources)) {
       VLOG(1) << "Filtered " << resources
 	      << " on slave " << slaveId
 	      << " for framework " << frameworkId;
-      filtered = true;
-      break;
+      return true;
     }
   }
-  return filtered;
+
+  return false;
 }
 
 } // namespace master {
@@ -22,7 +22,10 @@
 #include <string>
 #include <vector>
 
+#include <process/id.hpp>
+
 #include <stout/foreach.hpp>
+#include <stout/gzip.hpp>
 #include <stout/json.hpp>
 #include <stout/net.hpp>
 #include <stout/numify.hpp>
@@ -32,6 +35,8 @@
 
 #include "common/attributes.hpp"
 #include "common/build.hpp"
+#include "common/json_writer.hpp"
+#include "common/resource_vector.hpp"
 #include "common/resources.hpp"
 #include "common/type_utils.hpp"
 
@@ -61,150 +66,168 @@ using std::vector;
 // TODO(bmahler): Kill these in favor of automatic Proto->JSON Conversion (when
 // it becomes available).
 
+// NOTE: These write the members of each object in lexicographic
+// order of their keys, i.e., the order in which JSON::render writes
+// a JSON::Object.
 
-// Returns a JSON object modeled on a Resources.
-JSON::Object model(const Resources& resources)
-{
-  JSON::Object object;
 
+// Writes a JSON object modeled on a Resources.
+void model(JsonWriter* writer, const Resources& resources)
+{
+  map<string, const Resource*> sorted;
   foreach (const Resource& resource, resources) {
-    switch (resource.type()) {
+    sorted[resource.name()] = &resource;
+  }
+
+  writer->beginObject();
+
+  foreachvalue (const Resource* resource, sorted) {
+    writer->key(resource->name());
+    switch (resource->type()) {
       case Value::SCALAR:
-        object.values[resource.name()] = resource.scalar().value();
+        writer->value(resource->scalar().value());
         break;
       case Value::RANGES:
-        object.values[resource.name()] = stringify(resource.ranges());
+        writer->value(stringify(resource->ranges()));
         break;
       case Value::SET:
-        object.values[resource.name()] = stringify(resource.set());
+        writer->value(stringify(resource->set()));
         break;
       default:
-        LOG(FATAL) << "Unexpected Value type: " << resource.type();
+        LOG(FATAL) << "Unexpected Value type: " << resource->type();
         break;
     }
   }
 
-  return object;
+  writer->endObject();
 }
 
 
-JSON::Object model(const Attributes& attributes)
+void model(JsonWriter* writer, const Attributes& attributes)
 {
-  JSON::Object object;
-
+  map<string, const Attribute*> sorted;
   foreach (const Attribute& attribute, attributes) {
-    switch (attribute.type()) {
+    sorted[attribute.name()] = &attribute;
+  }
+
+  writer->beginObject();
+
+  foreachvalue (const Attribute* attribute, sorted) {
+    writer->key(attribute->name());
+    switch (attribute->type()) {
       case Value::SCALAR:
-        object.values[attribute.name()] = attribute.scalar().value();
+        writer->value(attribute->scalar().value());
         break;
       case Value::RANGES:
-        object.values[attribute.name()] = stringify(attribute.ranges());
+        writer->value(stringify(attribute->ranges()));
         break;
       case Value::SET:
-        object.values[attribute.name()] = stringify(attribute.set());
+        writer->value(stringify(attribute->set()));
         break;
       case Value::TEXT:
-        object.values[attribute.name()] = attribute.text().value();
+        writer->value(attribute->text().value());
         break;
       default:
-        LOG(FATAL) << "Unexpected Value type: " << attribute.type();
+        LOG(FATAL) << "Unexpected Value type: " << attribute->type();
         break;
     }
   }
 
-  return object;
+  writer->endObject();
 }
 
 
-// Returns a JSON object modeled on a Task.
-JSON::Object model(const Task& task)
+// Writes a JSON object modeled on a Task.
+void model(JsonWriter* writer, const Task& task)
 {
-  JSON::Object object;
-  object.values["id"] = task.task_id().value();
-  object.values["name"] = task.name();
-  object.values["framework_id"] = task.framework_id().value();
-  object.values["executor_id"] = task.executor_id().value();
-  object.values["slave_id"] = task.slave_id().value();
-  object.values["state"] = TaskState_Name(task.state());
-  object.values["resources"] = model(task.resources());
-  return object;
+  writer->beginObject();
+  writer->field("executor_id", task.executor_id().value());
+  writer->field("framework_id", task.framework_id().value());
+  writer->field("id", task.task_id().value());
+  writer->field("name", task.name());
+  writer->key("resources");
+  model(writer, Resources(task.resources()));
+  writer->field("slave_id", task.slave_id().value());
+  writer->field("state", TaskState_Name(task.state()));
+  writer->endObject();
 }
 
 
-// Returns a JSON object modeled on an Offer.
-JSON::Object model(const Offer& offer)
+// Writes a JSON object modeled on an Offer.
+void model(JsonWriter* writer, const Offer& offer)
 {
-  JSON::Object object;
-  object.values["id"] = offer.id().value();
-  object.values["framework_id"] = offer.framework_id().value();
-  object.values["slave_id"] = offer.slave_id().value();
-  object.values["resources"] = model(offer.resources());
-  return object;
+  writer->beginObject();
+  writer->field("framework_id", offer.framework_id().value());
+  writer->field("id", offer.id().value());
+  writer->key("resources");
+  model(writer, Resources(offer.resources()));
+  writer->field("slave_id", offer.slave_id().value());
+  writer->endObject();
 }
 
 
-// Returns a JSON object modeled on a Framework.
-JSON::Object model(const Framework& framework)
+// Writes a JSON object modeled on a Framework.
+void model(JsonWriter* writer, const http::Snapshot::Framework& framework)
 {
-  JSON::Object object;
-  object.values["id"] = framework.id.value();
-  object.values["name"] = framework.info.name();
-  object.values["user"] = framework.info.user();
-  object.values["registered_time"] = framework.registeredTime;
-  object.values["unregistered_time"] = framework.unregisteredTime;
-  object.values["active"] = framework.active;
-  object.values["resources"] = model(framework.resources);
+  writer->beginObject();
+  writer->field("active", framework.active);
 
-  // TODO(benh): Consider making reregisteredTime an Option.
-  if (framework.registeredTime != framework.reregisteredTime) {
-    object.values["reregistered_time"] = framework.reregisteredTime;
+  // Model all of the completed tasks of a framework.
+  writer->key("completed_tasks");
+  writer->beginArray();
+  foreach (const Task& task, framework.completedTasks) {
+    model(writer, task);
   }
+  writer->endArray();
 
-  // Model all of the tasks associated with a framework.
-  {
-    JSON::Array array;
-    foreachvalue (Task* task, framework.tasks) {
-      array.values.push_back(model(*task));
-    }
+  writer->field("id", framework.id.value());
+  writer->field("name", framework.info.name());
 
-    object.values["tasks"] = array;
+  // Model all of the offers associated with a framework.
+  writer->key("offers");
+  writer->beginArray();
+  foreach (const Offer& offer, framework.offers) {
+    model(writer, offer);
   }
+  writer->endArray();
 
-  // Model all of the completed tasks of a framework.
-  {
-    JSON::Array array;
-    foreach (const Task& task, framework.completedTasks) {
-      array.values.push_back(model(task));
-    }
+  writer->field("registered_time", framework.registeredTime);
 
-    object.values["completed_tasks"] = array;
+  // TODO(benh): Consider making reregisteredTime an Option.
+  if (framework.registeredTime != framework.reregisteredTime) {
+    writer->field("reregistered_time", framework.reregisteredTime);
   }
 
-  // Model all of the offers associated with a framework.
-  {
-    JSON::Array array;
-    foreach (Offer* offer, framework.offers) {
-      array.values.push_back(model(*offer));
-    }
+  writer->key("resources");
+  model(writer, framework.resources);
 
-    object.values["offers"] = array;
+  // Model all of the tasks associated with a framework.
+  writer->key("tasks");
+  writer->beginArray();
+  foreach (const Task& task, framework.tasks) {
+    model(writer, task);
   }
+  writer->endArray();
 
-  return object;
+  writer->field("unregistered_time", framework.unregisteredTime);
+  writer->field("user", framework.info.user());
+  writer->endObject();
 }
 
 
-// Returns a JSON object modeled after a Slave.
-JSON::Object model(const Slave& slave)
+// Writes a JSON object modeled after a Slave.
+void model(JsonWriter* writer, const http::Snapshot::Slave& slave)
 {
-  JSON::Object object;
-  object.values["id"] = slave.id.value();
-  object.values["pid"] = string(slave.pid);
-  object.values["hostname"] = slave.info.hostname();
-  object.values["registered_time"] = slave.registeredTime;
-  object.values["resources"] = model(slave.info.resources());
-  object.values["attributes"] = model(slave.info.attributes());
-  return object;
+  writer->beginObject();
+  writer->key("attributes");
+  model(writer, Attributes(slave.info.attributes()));
+  writer->field("hostname", slave.info.hostname());
+  writer->field("id", slave.id.value());
+  writer->field("pid", slave.pid);
+  writer->field("registered_time", slave.registeredTime);
+  writer->key("resources");
+  model(writer, Resources(slave.info.resources()));
+  writer->endObject();
 }
 
 
@@ -251,47 +274,58 @@ Future<Response> redirect(
 }
 
 
-namespace json {
+HttpProcess::HttpProcess()
+  : ProcessBase(ID::generate("master-http"))
+{
+  rendered.version = 0;
+}
+
+
+void HttpProcess::publish(const std::tr1::shared_ptr<const Snapshot>& _snapshot)
+{
+  snapshot = _snapshot;
+}
+
 
-Future<Response> stats(
-    const Master& master,
-    const Request& request)
+Future<Response> HttpProcess::stats(
+    const Request& request,
+    const Stats& stats)
 {
   VLOG(1) << "HTTP request for '" << request.path << "'";
 
   JSON::Object object;
-  object.values["uptime"] = Clock::now() - master.startTime;
-  object.values["elected"] = master.elected; // Note: using int not bool.
-  object.values["total_schedulers"] = master.frameworks.size();
-  object.values["active_schedulers"] = master.getActiveFrameworks().size();
-  object.values["activated_slaves"] = master.slaveHostnamePorts.size();
-  object.values["connected_slaves"] = master.slaves.size();
-  object.values["staged_tasks"] = master.stats.tasks[TASK_STAGING];
-  object.values["started_tasks"] = master.stats.tasks[TASK_STARTING];
-  object.values["finished_tasks"] = master.stats.tasks[TASK_FINISHED];
-  object.values["killed_tasks"] = master.stats.tasks[TASK_KILLED];
-  object.values["failed_tasks"] = master.stats.tasks[TASK_FAILED];
-  object.values["lost_tasks"] = master.stats.tasks[TASK_LOST];
-  object.values["valid_status_updates"] = master.stats.validStatusUpdates;
-  object.values["invalid_status_updates"] = master.stats.invalidStatusUpdates;
-
-  // Get total and used (note, not offered) resources in order to
+  object.values["uptime"] = Clock::now() - stats.startTime;
+  object.values["elected"] = stats.elected; // Note: using int not bool.
+  object.values["total_schedulers"] = stats.totalFrameworks;
+  object.values["active_schedulers"] = stats.activeFrameworks;
+  object.values["activated_slaves"] = stats.activatedSlaves;
+  object.values["connected_slaves"] = stats.connectedSlaves;
+  object.values["staged_tasks"] = stats.tasks[TASK_STAGING];
+  object.values["started_tasks"] = stats.tasks[TASK_STARTING];
+  object.values["finished_tasks"] = stats.tasks[TASK_FINISHED];
+  object.values["killed_tasks"] = stats.tasks[TASK_KILLED];
+  object.values["failed_tasks"] = stats.tasks[TASK_FAILED];
+  object.values["lost_tasks"] = stats.tasks[TASK_LOST];
+  object.values["valid_status_updates"] = stats.validStatusUpdates;
+  object.values["invalid_status_updates"] = stats.invalidStatusUpdates;
+
+  object.values["offers_pool_size"] = stats.offersPool.size;
+  object.values["offers_pool_capacity"] = stats.offersPool.capacity;
+  object.values["tasks_pool_size"] = stats.tasksPool.size;
+  object.values["tasks_pool_capacity"] = stats.tasksPool.capacity;
+  object.values["frameworks_pool_size"] = stats.frameworksPool.size;
+  object.values["frameworks_pool_capacity"] = stats.frameworksPool.capacity;
+  object.values["slaves_pool_size"] = stats.slavesPool.size;
+  object.values["slaves_pool_capacity"] = stats.slavesPool.capacity;
+
+  // Use the total and used (note, not offered) resources in order to
   // compute capacity of scalar resources.
-  Resources totalResources;
-  Resources usedResources;
-  foreachvalue (Slave* slave, master.slaves) {
-    totalResources += slave->info.resources();
-    usedResources += slave->resourcesInUse;
-  }
-
-  foreach (const Resource& resource, totalResources) {
+  foreach (const Resource& resource, stats.totalResources.resources()) {
     if (resource.type() == Value::SCALAR) {
       CHECK(resource.has_scalar());
       double total = resource.scalar().value();
       object.values[resource.name() + "_total"] = total;
-      Option<Resource> option = usedResources.get(resource);
-      CHECK(!option.isSome() || option.get().has_scalar());
-      double used = option.isSome() ? option.get().scalar().value() : 0.0;
+      double used = stats.usedResources.scalar(resource.name());
       object.values[resource.name() + "_used"] = used;
       double percent = used / total;
       object.values[resource.name() + "_percent"] = percent;
@@ -302,76 +336,115 @@ Future<Response> stats(
 }
 
 
-Future<Response> state(
-    const Master& master,
-    const Request& request)
+Future<Response> HttpProcess::state(const Request& request)
 {
   VLOG(1) << "HTTP request for '" << request.path << "'";
 
-  JSON::Object object;
-  object.values["build_date"] = build::DATE;
-  object.values["build_time"] = build::TIME;
-  object.values["build_user"] = build::USER;
-  object.values["start_time"] = master.startTime;
-  object.values["id"] = master.info.id();
-  object.values["pid"] = string(master.self());
-  object.values["activated_slaves"] = master.slaveHostnamePorts.size();
-  object.values["connected_slaves"] = master.slaves.size();
-  object.values["staged_tasks"] = master.stats.tasks[TASK_STAGING];
-  object.values["started_tasks"] = master.stats.tasks[TASK_STARTING];
-  object.values["finished_tasks"] = master.stats.tasks[TASK_FINISHED];
-  object.values["killed_tasks"] = master.stats.tasks[TASK_KILLED];
-  object.values["failed_tasks"] = master.stats.tasks[TASK_FAILED];
-  object.values["lost_tasks"] = master.stats.tasks[TASK_LOST];
-
-  if (master.flags.cluster.isSome()) {
-    object.values["cluster"] = master.flags.cluster.get();
-  }
+  CHECK(snapshot);
 
-  // TODO(benh): Use an Option for the leader PID.
-  if (master.leader != UPID()) {
-    object.values["leader"] = string(master.leader);
-  }
+  // Only render the state again if it has changed since it was last
+  // rendered.
+  if (rendered.version != snapshot->version) {
+    string json;
+    JsonWriter writer(&json);
 
-  if (master.flags.log_dir.isSome()) {
-    object.values["log_dir"] = master.flags.log_dir.get();
-  }
+    writer.beginObject();
+    writer.field("activated_slaves", snapshot->stats.activatedSlaves);
+    writer.field("build_date", build::DATE);
+    writer.field("build_time", build::TIME);
+    writer.field("build_user", build::USER);
 
-  // Model all of the slaves.
-  {
-    JSON::Array array;
-    foreachvalue (Slave* slave, master.slaves) {
-      array.values.push_back(model(*slave));
+    if (snapshot->cluster.isSome()) {
+      writer.field("cluster", snapshot->cluster.get());
     }
 
-    object.values["slaves"] = array;
-  }
+    // Model all of the completed frameworks.
+    writer.key("completed_frameworks");
+    writer.beginArray();
+    foreach (const Snapshot::Framework& framework,
+             *snapshot->completedFrameworks) {
+      model(&writer, framework);
+    }
+    writer.endArray();
+
+    writer.field("connected_slaves", snapshot->slaves.size());
+    writer.field("failed_tasks", snapshot->stats.tasks[TASK_FAILED]);
+    writer.field("finished_tasks", snapshot->stats.tasks[TASK_FINISHED]);
+
+    // Model all of the frameworks.
+    writer.key("frameworks");
+    writer.beginArray();
+    foreach (const Snapshot::Framework& framework, snapshot->frameworks) {
+      model(&writer, framework);
+    }
+    writer.endArray();
 
-  // Model all of the frameworks.
-  {
-    JSON::Array array;
-    foreachvalue (Framework* framework, master.frameworks) {
-      array.values.push_back(model(*framework));
+    writer.field("id", snapshot->id);
+    writer.field("killed_tasks", snapshot->stats.tasks[TASK_KILLED]);
+
+    if (snapshot->leader.isSome()) {
+      writer.field("leader", snapshot->leader.get());
+    }
+
+    if (snapshot->logDir.isSome()) {
+      writer.field("log_dir", snapshot->logDir.get());
     }
 
-    object.values["frameworks"] = array;
+    writer.field("lost_tasks", snapshot->stats.tasks[TASK_LOST]);
+    writer.field("pid", snapshot->pid);
+
+    // Model all of the slaves.
+    writer.key("slaves");
+    writer.beginArray();
+    foreach (const Snapshot::Slave& slave, snapshot->slaves) {
+      model(&writer, slave);
+    }
+    writer.endArray();
+
+    writer.field("staged_tasks", snapshot->stats.tasks[TASK_STAGING]);
+    writer.field("start_time", snapshot->stats.startTime);
+    writer.field("started_tasks", snapshot->stats.tasks[TASK_STARTING]);
+    writer.endObject();
+
+    rendered.version = snapshot->version;
+    rendered.json.swap(json);
+    rendered.gzipped = Option<string>::none();
   }
 
-  // Model all of the completed frameworks.
-  {
-    JSON::Array array;
+  Option<string> jsonp = request.query.get("jsonp");
 
-    foreach (const Framework& framework, master.completedFrameworks) {
-      array.values.push_back(model(framework));
+  if (jsonp.isSome()) {
+    OK response(jsonp.get() + "(" + rendered.json + ");");
+    response.headers["Content-Type"] = "text/javascript";
+    return response;
+  }
+
+  // Clients that accept gzip get the compressed state, which (like
+  // the state itself) only gets compressed once per snapshot.
+  Option<string> encoding = request.headers.get("Accept-Encoding");
+  if (encoding.isSome() && strings::contains(encoding.get(), "gzip")) {
+    if (rendered.gzipped.isNone()) {
+      Try<string> compressed = gzip::compress(rendered.json);
+      if (compressed.isError()) {
+        LOG(WARNING) << "Failed to gzip state: " << compressed.error();
+      } else {
+        rendered.gzipped = Option<string>::some(compressed.get());
+      }
     }
 
-    object.values["completed_frameworks"] = array;
+    if (rendered.gzipped.isSome()) {
+      OK response(rendered.gzipped.get());
+      response.headers["Content-Type"] = "application/json";
+      response.headers["Content-Encoding"] = "gzip";
+      return response;
+    }
   }
 
-  return OK(object, request.query.get("jsonp"));
+  OK response(rendered.json);
+  response.headers["Content-Type"] = "application/json";
+  return response;
 }
 
-} // namespace json {
 } // namespace http {
 } // namespace master {
 } // namespace internal {
@@ -19,8 +19,23 @@
 #ifndef __MASTER_HTTP_HPP__
 #define __MASTER_HTTP_HPP__
 
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <tr1/memory>
+
+#include <mesos/mesos.hpp>
+
 #include <process/future.hpp>
 #include <process/http.hpp>
+#include <process/process.hpp>
+
+#include <stout/option.hpp>
+
+#include "common/resource_vector.hpp"
+#include "common/resources.hpp"
 
 namespace mesos {
 namespace internal {
@@ -43,20 +58,119 @@ process::Future<process::http::Response> redirect(
     const Master& master,
     const process::http::Request& request);
 
-namespace json {
+// The counters of the master exposed via stats.json (and
+// state.json), cheap enough for the master to copy for every request.
+struct Stats
+{
+  double startTime;
+  bool elected;
 
-// Returns current statistics of the master.
-process::Future<process::http::Response> stats(
-    const Master& master,
-    const process::http::Request& request);
+  size_t totalFrameworks;
+  size_t activeFrameworks;
+  size_t activatedSlaves;
+  size_t connectedSlaves;
+  uint64_t tasks[TaskState_ARRAYSIZE];
+  uint64_t validStatusUpdates;
+  uint64_t invalidStatusUpdates;
 
+  // Total and used (note, not offered) resources of all slaves.
+  ResourceVector totalResources;
+  ResourceVector usedResources;
 
-// Returns current state of the cluster that the master knows about.
-process::Future<process::http::Response> state(
-    const Master& master,
-    const process::http::Request& request);
+  // Occupancy of the pools the master's objects are created from.
+  struct Occupancy
+  {
+    size_t size;
+    size_t capacity;
+  };
+
+  Occupancy offersPool;
+  Occupancy tasksPool;
+  Occupancy frameworksPool;
+  Occupancy slavesPool;
+};
+
+
+// A read-only copy of the parts of the master's state exposed via
+// state.json. The master publishes a new snapshot to the HttpProcess
+// (below) only when that state has changed since the last one and an
+// HTTP request needs it, and at most once per STATE_SNAPSHOT_INTERVAL
+// (in between requests get the previous snapshot). Snapshots never
+// change after they have been published, so parts that rarely change
+// (like the completed frameworks) get shared between snapshots.
+struct Snapshot
+{
+  struct Framework
+  {
+    FrameworkID id;
+    FrameworkInfo info;
+    bool active;
+    double registeredTime;
+    double reregisteredTime;
+    double unregisteredTime;
+    Resources resources;
+    std::vector<Task> tasks;
+    std::vector<Task> completedTasks;
+    std::vector<Offer> offers;
+  };
+
+  struct Slave
+  {
+    SlaveID id;
+    SlaveInfo info;
+    std::string pid;
+    double registeredTime;
+  };
+
+  uint64_t version;
+
+  std::string id;
+  std::string pid;
+  Option<std::string> leader;
+  Option<std::string> cluster;
+  Option<std::string> logDir;
+
+  Stats stats;
+
+  std::vector<Slave> slaves;
+  std::vector<Framework> frameworks;
+  std::tr1::shared_ptr<const std::vector<Framework> > completedFrameworks;
+};
+
+
+// Serves stats.json from the counters passed along with each request
+// and state.json from the latest snapshot published by the master,
+// so that rendering (and compressing) JSON for an HTTP request never
+// delays the events the master needs to handle (e.g., status updates
+// and launching tasks).
+class HttpProcess : public process::Process<HttpProcess>
+{
+public:
+  HttpProcess();
+
+  void publish(const std::tr1::shared_ptr<const Snapshot>& snapshot);
+
+  // Returns the specified statistics of the master.
+  process::Future<process::http::Response> stats(
+      const process::http::Request& request,
+      const Stats& stats);
+
+  // Returns current state of the cluster that the master knows about.
+  process::Future<process::http::Response> state(
+      const process::http::Request& request);
+
+private:
+  std::tr1::shared_ptr<const Snapshot> snapshot;
+
+  // The last rendered state.json, rendered (and compressed) at most
+  // once per snapshot.
+  struct {
+    uint64_t version;
+    std::string json;
+    Option<std::string> gzipped;
+  } rendered;
+};
 
-} // namespace json {
 } // namespace http {
 } // namespace master {
 } // namespace internal {
@@ -25,9 +25,11 @@
 #include <process/delay.hpp>
 #include <process/id.hpp>
 #include <process/run.hpp>
+#include <process/statistics.hpp>
 
 #include <stout/os.hpp>
 #include <stout/path.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/utils.hpp>
 #include <stout/uuid.hpp>
 
@@ -199,7 +201,8 @@ struct SlaveRegistrar
 
   static bool run(Slave* slave,
                   const PID<Master>& master,
-                  const PID<SlavesManager>& slavesManager)
+                  const PID<SlavesManager>& slavesManager,
+                  Pool<Slave>* pool)
   {
     Future<bool> added = dispatch(slavesManager, &SlavesManager::add,
                                   slave->info.hostname(), slave->pid.port);
@@ -210,7 +213,7 @@ struct SlaveRegistrar
       // TODO(benh): This could be because our acknowledgement to the
       // slave was dropped, so they retried, and now we should
       // probably send another acknowledgement.
-      delete slave;
+      pool->destroy(slave);
       return false;
     }
 
@@ -237,7 +240,8 @@ struct SlaveReregistrar
                   const vector<ExecutorInfo>& executorInfos,
                   const vector<Task>& tasks,
                   const PID<Master>& master,
-                  const PID<SlavesManager>& slavesManager)
+                  const PID<SlavesManager>& slavesManager,
+                  Pool<Slave>* pool)
   {
     Future<bool> added = dispatch(slavesManager, &SlavesManager::add,
                                   slave->info.hostname(), slave->pid.port);
@@ -248,7 +252,7 @@ struct SlaveReregistrar
       // TODO(benh): This could be because our acknowledgement to the
       // slave was dropped, so they retried, and now we should
       // probably send another acknowledgement.
-      delete slave;
+      pool->destroy(slave);
       return false;
     }
 
@@ -261,7 +265,9 @@ Master::Master(AllocatorProcess* _allocator, Files* _files)
   : ProcessBase("master"),
     flags(),
     allocator(_allocator),
-    files(_files) {}
+    files(_files),
+    launchTasksTime("master/launch_tasks_time_ms"),
+    statusUpdateTime("master/status_update_time_ms") {}
 
 
 Master::Master(AllocatorProcess* _allocator,
@@ -270,7 +276,9 @@ Master::Master(AllocatorProcess* _allocator,
   : ProcessBase("master"),
     flags(_flags),
     allocator(_allocator),
-    files(_files) {}
+    files(_files),
+    launchTasksTime("master/launch_tasks_time_ms"),
+    statusUpdateTime("master/status_update_time_ms") {}
 
 
 Master::~Master()
@@ -296,6 +304,11 @@ Master::~Master()
   wait(whitelistWatcher);
 
   delete whitelistWatcher;
+
+  terminate(httpProcess);
+  wait(httpProcess);
+
+  delete httpProcess;
 }
 
 
@@ -351,6 +364,21 @@ void Master::initialize()
 
   startTime = Clock::now();
 
+  version = 1;
+  published = 0;
+  publishedTime = 0;
+
+  completedFrameworksSnapshot.reset(
+      new vector<http::Snapshot::Framework>());
+
+  // Spawn the process serving stats.json and state.json.
+  httpProcess = new http::HttpProcess();
+  spawn(httpProcess);
+
+  // Start measuring the event queue.
+  served = 0;
+  delay(EVENT_QUEUE_PROBE_INTERVAL, self(), &Master::probe);
+
   // Install handler functions for certain messages.
   install<SubmitSchedulerRequest>(
       &Master::submitScheduler,
@@ -445,8 +473,8 @@ void Master::initialize()
   // Setup HTTP request handlers.
   route("/redirect", bind(&http::redirect, cref(*this), params::_1));
   route("/vars", bind(&http::vars, cref(*this), params::_1));
-  route("/stats.json", bind(&http::json::stats, cref(*this), params::_1));
-  route("/state.json", bind(&http::json::state, cref(*this), params::_1));
+  route("/stats.json", bind(&Master::observeStats, this, params::_1));
+  route("/state.json", bind(&Master::observeState, this, params::_1));
 
   // Provide HTTP assets from a "webui" directory. This is either
   // specified via flags (which is necessary for running out of the
@@ -490,6 +518,7 @@ void Master::exited(const UPID& pid)
 
       // Stop sending offers here for now.
       framework->active = false;
+      version++;
 
       // Tell the allocator to stop allocating resources to this framework.
       dispatch(allocator, &AllocatorProcess::frameworkDeactivated, framework->id);
@@ -527,6 +556,167 @@ void Master::exited(const UPID& pid)
 }
 
 
+// Returns a snapshot of a framework (see http::Snapshot).
+static http::Snapshot::Framework snapshot(const Framework& framework)
+{
+  http::Snapshot::Framework result;
+  result.id = framework.id;
+  result.info = framework.info;
+  result.active = framework.active;
+  result.registeredTime = framework.registeredTime;
+  result.reregisteredTime = framework.reregisteredTime;
+  result.unregisteredTime = framework.unregisteredTime;
+  result.resources = framework.resources.resources();
+
+  foreachvalue (Task* task, framework.tasks) {
+    result.tasks.push_back(*task);
+  }
+
+  foreach (const Task& task, framework.completedTasks) {
+    result.completedTasks.push_back(task);
+  }
+
+  foreach (Offer* offer, framework.offers) {
+    result.offers.push_back(*offer);
+  }
+
+  return result;
+}
+
+
+// Returns a snapshot of a slave (see http::Snapshot).
+static http::Snapshot::Slave snapshot(const Slave& slave)
+{
+  http::Snapshot::Slave result;
+  result.id = slave.id;
+  result.info = slave.info;
+  result.pid = string(slave.pid);
+  result.registeredTime = slave.registeredTime;
+  return result;
+}
+
+
+http::Stats Master::counters() const
+{
+  http::Stats result;
+  result.startTime = startTime;
+  result.elected = elected;
+
+  result.totalFrameworks = frameworks.size();
+  result.activeFrameworks = 0;
+  foreachvalue (Framework* framework, frameworks) {
+    if (framework->active) {
+      result.activeFrameworks++;
+    }
+  }
+
+  result.activatedSlaves = slaveHostnamePorts.size();
+  result.connectedSlaves = slaves.size();
+  for (int i = 0; i < TaskState_ARRAYSIZE; i++) {
+    result.tasks[i] = stats.tasks[i];
+  }
+  result.validStatusUpdates = stats.validStatusUpdates;
+  result.invalidStatusUpdates = stats.invalidStatusUpdates;
+
+  result.totalResources = totalResources;
+  foreachvalue (Slave* slave, slaves) {
+    result.usedResources += slave->resourcesInUse;
+  }
+
+  result.offersPool.size = pools.offers.size();
+  result.offersPool.capacity = pools.offers.capacity();
+  result.tasksPool.size = pools.tasks.size();
+  result.tasksPool.capacity = pools.tasks.capacity();
+  result.frameworksPool.size = pools.frameworks.size();
+  result.frameworksPool.capacity = pools.frameworks.capacity();
+  result.slavesPool.size = pools.slaves.size();
+  result.slavesPool.capacity = pools.slaves.capacity();
+
+  return result;
+}
+
+
+Future<process::http::Response> Master::observeStats(
+    const process::http::Request& request)
+{
+  return dispatch(httpProcess, &http::HttpProcess::stats, request, counters());
+}
+
+
+Future<process::http::Response> Master::observeState(
+    const process::http::Request& request)
+{
+  // Taking a snapshot copies every task and offer, so do it at most
+  // once per interval even if the state keeps changing (e.g., with
+  // every offer and status update), in between requests get served
+  // the previous snapshot.
+  if (published == 0 ||
+      (published != version &&
+       Clock::now() - publishedTime >= STATE_SNAPSHOT_INTERVAL.secs())) {
+    http::Snapshot* state = new http::Snapshot();
+    state->version = version;
+    state->id = info.id();
+    state->pid = string(self());
+
+    // TODO(benh): Use an Option for the leader PID.
+    if (leader != UPID()) {
+      state->leader = Option<string>::some(string(leader));
+    }
+
+    state->cluster = flags.cluster;
+    state->logDir = flags.log_dir;
+
+    state->stats = counters();
+
+    foreachvalue (Slave* slave, slaves) {
+      state->slaves.push_back(snapshot(*slave));
+    }
+
+    foreachvalue (Framework* framework, frameworks) {
+      state->frameworks.push_back(snapshot(*framework));
+    }
+
+    if (!completedFrameworksSnapshot) {
+      vector<http::Snapshot::Framework>* completed =
+        new vector<http::Snapshot::Framework>();
+      foreach (const Framework& framework, completedFrameworks) {
+        completed->push_back(snapshot(framework));
+      }
+      completedFrameworksSnapshot.reset(completed);
+    }
+
+    state->completedFrameworks = completedFrameworksSnapshot;
+
+    dispatch(httpProcess,
+             &http::HttpProcess::publish,
+             std::tr1::shared_ptr<const http::Snapshot>(state));
+
+    published = version;
+    publishedTime = Clock::now();
+  }
+
+  return dispatch(httpProcess, &http::HttpProcess::state, request);
+}
+
+
+void Master::probe()
+{
+  dispatch(self(), &Master::probed, Clock::now(), served);
+}
+
+
+void Master::probed(double enqueued, uint64_t before)
+{
+  // Every event served after the probe (except this one) had been
+  // queued in front of it.
+  process::statistics->set("master/event_queue_size", served - before - 1);
+  process::statistics->set(
+      "master/event_queue_latency_ms", (Clock::now() - enqueued) * 1000);
+
+  delay(EVENT_QUEUE_PROBE_INTERVAL, self(), &Master::probe);
+}
+
+
 void Master::fileAttached(const Future<Nothing>& result, const string& path)
 {
   CHECK(!result.isDiscarded());
@@ -555,6 +745,7 @@ void Master::newMasterDetected(const UPID& pid)
   // or (4) still elected master.
 
   leader = pid;
+  version++;
 
   if (leader != self() && !elected) {
     LOG(INFO) << "Waiting to be master!";
@@ -600,7 +791,8 @@ void Master::registerFramework(const FrameworkInfo& frameworkInfo)
   }
 
   Framework* framework =
-    new Framework(frameworkInfo, newFrameworkId(), from, Clock::now());
+    pools.frameworks.create(
+      frameworkInfo, newFrameworkId(), from, Clock::now());
 
   LOG(INFO) << "Registering framework " << framework->id << " at " << from;
 
@@ -612,7 +804,7 @@ void Master::registerFramework(const FrameworkInfo& frameworkInfo)
     FrameworkErrorMessage message;
     message.set_message("User 'root' is not allowed to run frameworks");
     reply(message);
-    delete framework;
+    pools.frameworks.destroy(framework);
     return;
   }
 
@@ -684,23 +876,24 @@ void Master::reregisterFramework(const FrameworkInfo& frameworkInfo,
     // failed-over one is connecting. Create a Framework object and add
     // any tasks it has that have been reported by reconnecting slaves.
     Framework* framework =
-      new Framework(frameworkInfo, frameworkInfo.id(), from, Clock::now());
+      pools.frameworks.create(
+        frameworkInfo, frameworkInfo.id(), from, Clock::now());
 
     // TODO(benh): Check for root submissions like above!
 
     // Add any running tasks reported by slaves for this framework.
-    foreachvalue (Slave* slave, slaves) {
-      foreachvalue (Task* task, slave->tasks) {
-        if (framework->id == task->framework_id()) {
-          framework->addTask(task);
-          // Also add the task's executor for resource accounting.
-          if (task->has_executor_id()) {
-            if (!framework->hasExecutor(slave->id, task->executor_id())) {
-              CHECK(slave->hasExecutor(framework->id, task->executor_id()));
-              const ExecutorInfo& executorInfo =
-                slave->executors[framework->id][task->executor_id()];
-              framework->addExecutor(slave->id, executorInfo);
-            }
+    if (frameworkTasks.contains(framework->id)) {
+      foreach (Task* task, frameworkTasks[framework->id]) {
+        Slave* slave = getSlave(task->slave_id());
+        CHECK(slave != NULL);
+        framework->addTask(task);
+        // Also add the task's executor for resource accounting.
+        if (task->has_executor_id()) {
+          if (!framework->hasExecutor(slave->id, task->executor_id())) {
+            CHECK(slave->hasExecutor(framework->id, task->executor_id()));
+            const ExecutorInfo& executorInfo =
+              slave->executors[framework->id][task->executor_id()];
+            framework->addExecutor(slave->id, executorInfo);
           }
         }
       }
@@ -714,11 +907,10 @@ void Master::reregisterFramework(const FrameworkInfo& frameworkInfo,
 
   CHECK(frameworks.count(frameworkInfo.id()) > 0);
 
-  // Broadcast the new framework pid to all the slaves. We have to
-  // broadcast because an executor might be running on a slave but
-  // it currently isn't running any tasks. This could be a
-  // potential scalability issue ...
-  foreachvalue (Slave* slave, slaves) {
+  // Send the new framework pid to all the slaves running its tasks
+  // or executors (an executor might be running on a slave even
+  // though it currently isn't running any tasks).
+  foreach (Slave* slave, getSlaves(frameworkInfo.id())) {
     UpdateFrameworkMessage message;
     message.mutable_framework_id()->MergeFrom(frameworkInfo.id());
     message.set_pid(from);
@@ -752,6 +944,7 @@ void Master::deactivateFramework(const FrameworkID& frameworkId)
       LOG(INFO) << "Deactivating framework " << frameworkId
                 << " as requested by " << from;
       framework->active = false;
+      version++;
     } else {
       LOG(WARNING) << from << " tried to deactivate framework; "
                    << "expecting " << framework->pid;
@@ -772,6 +965,9 @@ void Master::launchTasks(const FrameworkID& frameworkId,
                          const vector<TaskInfo>& tasks,
                          const Filters& filters)
 {
+  Stopwatch stopwatch;
+  stopwatch.start();
+
   Framework* framework = getFramework(frameworkId);
   if (framework != NULL) {
     // TODO(benh): Support offer "hoarding" and allow multiple offers
@@ -805,6 +1001,8 @@ void Master::launchTasks(const FrameworkID& frameworkId,
       }
     }
   }
+
+  launchTasksTime.record(stopwatch.elapsed());
 }
 
 
@@ -910,18 +1108,18 @@ void Master::registerSlave(const SlaveInfo& slaveInfo)
   }
 
   // Check if this slave is already registered (because it retries).
-  foreachvalue (Slave* slave, slaves) {
-    if (slave->pid == from) {
-      LOG(INFO) << "Slave " << slave->id << " (" << slave->info.hostname()
-                << ") already registered, resending acknowledgement";
-      SlaveRegisteredMessage message;
-      message.mutable_slave_id()->MergeFrom(slave->id);
-      reply(message);
-      return;
-    }
+  if (slavePids.contains(from)) {
+    Slave* slave = slavePids[from];
+    LOG(INFO) << "Slave " << slave->id << " (" << slave->info.hostname()
+              << ") already registered, resending acknowledgement";
+    SlaveRegisteredMessage message;
+    message.mutable_slave_id()->MergeFrom(slave->id);
+    reply(message);
+    return;
   }
 
-  Slave* slave = new Slave(slaveInfo, newSlaveId(), from, Clock::now());
+  Slave* slave =
+    pools.slaves.create(slaveInfo, newSlaveId(), from, Clock::now());
 
   LOG(INFO) << "Attempting to register slave on " << slave->info.hostname()
             << " at " << slave->pid;
@@ -935,7 +1133,8 @@ void Master::registerSlave(const SlaveInfo& slaveInfo)
 //   if (slaveHostnamePorts.contains(slaveInfo.hostname(), from.port)) {
 //     run(&SlaveRegistrar::run, slave, self());
 //   } else if (flags.slaves == "*") {
-//     run(&SlaveRegistrar::run, slave, self(), slavesManager->self());
+//     run(&SlaveRegistrar::run,
+//         slave, self(), slavesManager->self(), &pools.slaves);
 //   } else {
 //     LOG(WARNING) << "Cannot register slave at "
 //                  << slaveInfo.hostname() << ":" << from.port
@@ -977,7 +1176,8 @@ void Master::reregisterSlave(const SlaveID& slaveId,
       message.mutable_slave_id()->MergeFrom(slave->id);
       reply(message);
     } else {
-      Slave* slave = new Slave(slaveInfo, slaveId, from, Clock::now());
+      Slave* slave =
+        pools.slaves.create(slaveInfo, slaveId, from, Clock::now());
 
       LOG(INFO) << "Attempting to re-register slave " << slave->id << " at "
                 << slave->pid << " (" << slave->info.hostname() << ")";
@@ -992,7 +1192,8 @@ void Master::reregisterSlave(const SlaveID& slaveId,
 //         run(&SlaveReregistrar::run, slave, executorInfos, tasks, self());
 //       } else if (flags.slaves == "*") {
 //         run(&SlaveReregistrar::run,
-//             slave, executorInfos, tasks, self(), slavesManager->self());
+//             slave, executorInfos, tasks, self(), slavesManager->self(),
+//             &pools.slaves);
 //       } else {
 //         LOG(WARNING) << "Cannot re-register slave at "
 //                      << slaveInfo.hostname() << ":" << from.port
@@ -1019,8 +1220,13 @@ void Master::unregisterSlave(const SlaveID& slaveId)
 
 void Master::statusUpdate(const StatusUpdate& update, const UPID& pid)
 {
+  Stopwatch stopwatch;
+  stopwatch.start();
+
   const TaskStatus& status = update.status();
 
+  version++;
+
   LOG(INFO) << "Status update from " << from
             << ": task " << status.task_id()
             << " of framework " << update.framework_id()
@@ -1070,6 +1276,8 @@ void Master::statusUpdate(const StatusUpdate& update, const UPID& pid)
                  << update.slave_id();
     stats.invalidStatusUpdates++;
   }
+
+  statusUpdateTime.record(stopwatch.elapsed());
 }
 
 
@@ -1135,6 +1343,13 @@ void Master::exitedExecutor(const SlaveID& slaveId,
 
       // Remove executor from slave and framework.
       slave->removeExecutor(frameworkId, executorId);
+      version++;
+      if (!slave->executors.contains(frameworkId)) {
+        frameworkExecutorSlaves[frameworkId].erase(slave->id);
+        if (frameworkExecutorSlaves[frameworkId].empty()) {
+          frameworkExecutorSlaves.erase(frameworkId);
+        }
+      }
     } else {
       LOG(WARNING) << "Ignoring unknown exited executor "
                    << executorId << " on slave " << slaveId
@@ -1162,6 +1377,7 @@ void Master::activatedSlaveHostnamePort(const string& hostname, uint16_t port)
   LOG(INFO) << "Master now considering a slave at "
             << hostname << ":" << port << " as active";
   slaveHostnamePorts.put(hostname, port);
+  version++;
 }
 
 
@@ -1170,20 +1386,19 @@ void Master::deactivatedSlaveHostnamePort(const string& hostname,
 {
   if (slaveHostnamePorts.contains(hostname, port)) {
     // Look for a connected slave and remove it.
-    foreachvalue (Slave* slave, slaves) {
-      if (slave->info.hostname() == hostname && slave->pid.port == port) {
-        LOG(WARNING) << "Removing slave " << slave->id << " at "
-                     << hostname << ":" << port
-                     << " because it has been deactivated";
-        send(slave->pid, ShutdownMessage());
-        removeSlave(slave);
-        break;
-      }
+    foreach (Slave* slave, slaveAddresses.get(std::make_pair(hostname, port))) {
+      LOG(WARNING) << "Removing slave " << slave->id << " at "
+                   << hostname << ":" << port
+                   << " because it has been deactivated";
+      send(slave->pid, ShutdownMessage());
+      removeSlave(slave);
+      break;
     }
 
     LOG(INFO) << "Master now considering a slave at "
 	            << hostname << ":" << port << " as inactive";
     slaveHostnamePorts.remove(hostname, port);
+    version++;
   }
 }
 
@@ -1216,7 +1431,10 @@ void Master::offer(const FrameworkID& frameworkId,
     return;
   }
 
-  // Create an offer for each slave and add it to the message.
+  // Create an offer for each slave and add it to the message. Each
+  // offer only gets created (i.e., its resources and attributes
+  // copied) once: the message just borrows the offers (which are
+  // owned by 'offers') until it has been sent.
   ResourceOffersMessage message;
 
   Framework* framework = frameworks[frameworkId];
@@ -1233,7 +1451,7 @@ void Master::offer(const FrameworkID& frameworkId,
 
     Slave* slave = slaves[slaveId];
 
-    Offer* offer = new Offer();
+    Offer* offer = pools.offers.create();
     offer->mutable_id()->MergeFrom(newOfferId());
     offer->mutable_framework_id()->MergeFrom(framework->id);
     offer->mutable_slave_id()->MergeFrom(slave->id);
@@ -1255,8 +1473,10 @@ void Master::offer(const FrameworkID& frameworkId,
     framework->addOffer(offer);
     slave->addOffer(offer);
 
+    version++;
+
     // Add the offer *AND* the corresponding slave's PID.
-    message.add_offers()->MergeFrom(*offer);
+    message.mutable_offers()->AddAllocated(offer);
     message.add_pids(slave->pid);
   }
 
@@ -1268,6 +1488,11 @@ void Master::offer(const FrameworkID& frameworkId,
             << " offers to framework " << framework->id;
 
   send(framework->pid, message);
+
+  // Give the offers back before the message gets destroyed.
+  while (message.offers().size() > 0) {
+    message.mutable_offers()->ReleaseLast();
+  }
 }
 
 
@@ -1542,6 +1767,8 @@ Resources Master::launchTask(const TaskInfo& task,
                              Framework* framework,
                              Slave* slave)
 {
+  version++;
+
   CHECK(framework != NULL);
   CHECK(slave != NULL);
 
@@ -1557,6 +1784,7 @@ Resources Master::launchTask(const TaskInfo& task,
       CHECK(!framework->hasExecutor(slave->id, task.executor().executor_id()));
       slave->addExecutor(framework->id, task.executor());
       framework->addExecutor(slave->id, task.executor());
+      frameworkExecutorSlaves[framework->id].insert(slave->id);
       resources += task.executor().resources();
     }
 
@@ -1564,7 +1792,7 @@ Resources Master::launchTask(const TaskInfo& task,
   }
 
   // Add the task to the framework and slave.
-  Task* t = new Task();
+  Task* t = pools.tasks.create();
   t->mutable_framework_id()->MergeFrom(framework->id);
   t->set_state(TASK_STAGING);
   t->set_name(task.name());
@@ -1580,6 +1808,8 @@ Resources Master::launchTask(const TaskInfo& task,
 
   slave->addTask(t);
 
+  frameworkTasks[framework->id].insert(t);
+
   resources += task.resources();
 
   // Tell the slave to launch the task!
@@ -1602,6 +1832,8 @@ Resources Master::launchTask(const TaskInfo& task,
 
 void Master::addFramework(Framework* framework)
 {
+  version++;
+
   CHECK(frameworks.count(framework->id) == 0);
 
   frameworks[framework->id] = framework;
@@ -1614,7 +1846,7 @@ void Master::addFramework(Framework* framework)
   send(framework->pid, message);
 
   dispatch(allocator, &AllocatorProcess::frameworkAdded,
-           framework->id, framework->info, framework->resources);
+           framework->id, framework->info, framework->resources.resources());
 }
 
 
@@ -1622,6 +1854,8 @@ void Master::addFramework(Framework* framework)
 // event of a scheduler failover.
 void Master::failoverFramework(Framework* framework, const UPID& newPid)
 {
+  version++;
+
   const UPID& oldPid = framework->pid;
 
   {
@@ -1668,13 +1902,15 @@ void Master::failoverFramework(Framework* framework, const UPID& newPid)
 
 void Master::removeFramework(Framework* framework)
 {
+  version++;
+
   if (framework->active) {
     // Tell the allocator to stop allocating resources to this framework.
     dispatch(allocator, &AllocatorProcess::frameworkDeactivated, framework->id);
   }
 
-  // Tell slaves to shutdown the framework.
-  foreachvalue (Slave* slave, slaves) {
+  // Tell the slaves running the framework to shut it down.
+  foreach (Slave* slave, getSlaves(framework->id)) {
     ShutdownFrameworkMessage message;
     message.mutable_framework_id()->MergeFrom(framework->id);
     send(slave->pid, message);
@@ -1711,6 +1947,13 @@ void Master::removeFramework(Framework* framework)
                  executorInfo.resources());
         slave->removeExecutor(framework->id, executorId);
       }
+
+      if (!slave->executors.contains(framework->id)) {
+        frameworkExecutorSlaves[framework->id].erase(slave->id);
+        if (frameworkExecutorSlaves[framework->id].empty()) {
+          frameworkExecutorSlaves.erase(framework->id);
+        }
+      }
     }
   }
 
@@ -1726,16 +1969,20 @@ void Master::removeFramework(Framework* framework)
     completedFrameworks.pop_front();
   }
 
+  completedFrameworksSnapshot.reset(); // Taken again when next published.
+
   // Delete it.
   frameworks.erase(framework->id);
   dispatch(allocator, &AllocatorProcess::frameworkRemoved, framework->id);
 
-  delete framework;
+  pools.frameworks.destroy(framework);
 }
 
 
 void Master::addSlave(Slave* slave, bool reregister)
 {
+  version++;
+
   CHECK(slave != NULL);
 
   LOG(INFO) << "Adding slave " << slave->id
@@ -1743,6 +1990,10 @@ void Master::addSlave(Slave* slave, bool reregister)
             << " with " << slave->info.resources();
 
   slaves[slave->id] = slave;
+  slavePids[slave->pid] = slave;
+  totalResources += slave->info.resources();
+  slaveAddresses.put(std::make_pair(slave->info.hostname(), slave->pid.port),
+                     slave);
 
   link(slave->pid);
 
@@ -1793,6 +2044,7 @@ void Master::readdSlave(Slave* slave,
     if (!slave->hasExecutor(executorInfo.framework_id(),
                             executorInfo.executor_id())) {
       slave->addExecutor(executorInfo.framework_id(), executorInfo);
+      frameworkExecutorSlaves[executorInfo.framework_id()].insert(slave->id);
     }
 
     Framework* framework = getFramework(executorInfo.framework_id());
@@ -1806,10 +2058,11 @@ void Master::readdSlave(Slave* slave,
   }
 
   foreach (const Task& task, tasks) {
-    Task* t = new Task(task);
+    Task* t = pools.tasks.create(task);
 
     // Add the task to the slave.
     slave->addTask(t);
+    frameworkTasks[task.framework_id()].insert(t);
 
     // Try and add the task to the framework too, but since the
     // framework might not yet be connected we won't be able to
@@ -1845,6 +2098,8 @@ void Master::readdSlave(Slave* slave,
 // Lose all of a slave's tasks and delete the slave object
 void Master::removeSlave(Slave* slave)
 {
+  version++;
+
   // Remove pointers to slave's tasks in frameworks, and send status updates
   foreachvalue (Task* task, utils::copy(slave->tasks)) {
     Framework* framework = getFramework(task->framework_id());
@@ -1887,6 +2142,11 @@ void Master::removeSlave(Slave* slave)
         framework->removeExecutor(slave->id, executorId);
       }
     }
+
+    frameworkExecutorSlaves[frameworkId].erase(slave->id);
+    if (frameworkExecutorSlaves[frameworkId].empty()) {
+      frameworkExecutorSlaves.erase(frameworkId);
+    }
   }
 
   // Send lost-slave message to all frameworks (this helps them re-run
@@ -1912,13 +2172,19 @@ void Master::removeSlave(Slave* slave)
 
   // Delete it.
   slaves.erase(slave->id);
+  slavePids.erase(slave->pid);
+  totalResources -= slave->info.resources();
+  slaveAddresses.remove(
+      std::make_pair(slave->info.hostname(), slave->pid.port), slave);
   dispatch(allocator, &AllocatorProcess::slaveRemoved, slave->id);
-  delete slave;
+  pools.slaves.destroy(slave);
 }
 
 
 void Master::removeTask(Task* task)
 {
+  version++;
+
   // Remove from framework.
   Framework* framework = getFramework(task->framework_id());
   if (framework != NULL) { // A framework might not be re-connected yet.
@@ -1930,18 +2196,25 @@ void Master::removeTask(Task* task)
   CHECK(slave != NULL);
   slave->removeTask(task);
 
+  frameworkTasks[task->framework_id()].erase(task);
+  if (frameworkTasks[task->framework_id()].empty()) {
+    frameworkTasks.erase(task->framework_id());
+  }
+
   // Tell the allocator about the recovered resources.
   dispatch(allocator, &AllocatorProcess::resourcesRecovered,
            task->framework_id(),
            task->slave_id(),
            Resources(task->resources()));
 
-  delete task;
+  pools.tasks.destroy(task);
 }
 
 
 void Master::removeOffer(Offer* offer, bool rescind)
 {
+  version++;
+
   // Remove from framework.
   Framework* framework = getFramework(offer->framework_id());
   CHECK(framework != NULL);
@@ -1960,7 +2233,7 @@ void Master::removeOffer(Offer* offer, bool rescind)
 
   // Delete it.
   offers.erase(offer->id());
-  delete offer;
+  pools.offers.destroy(offer);
 }
 
 
@@ -1994,6 +2267,30 @@ Offer* Master::getOffer(const OfferID& offerId)
 }
 
 
+hashset<Slave*> Master::getSlaves(const FrameworkID& frameworkId)
+{
+  hashset<Slave*> result;
+
+  if (frameworkTasks.contains(frameworkId)) {
+    foreach (Task* task, frameworkTasks[frameworkId]) {
+      Slave* slave = getSlave(task->slave_id());
+      CHECK(slave != NULL);
+      result.insert(slave);
+    }
+  }
+
+  if (frameworkExecutorSlaves.contains(frameworkId)) {
+    foreach (const SlaveID& slaveId, frameworkExecutorSlaves[frameworkId]) {
+      Slave* slave = getSlave(slaveId);
+      CHECK(slave != NULL);
+      result.insert(slave);
+    }
+  }
+
+  return result;
+}
+
+
 // Create a new framework ID. We format the ID as MASTERID-FWID, where
 // MASTERID is the ID of the master (launch date plus fault tolerant ID)
 // and FWID is an increasing integer.
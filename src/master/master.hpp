@@ -23,9 +23,12 @@
 #include <string>
 #include <vector>
 
+#include <tr1/memory>
+
 #include <process/http.hpp>
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
+#include <process/statistics.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/hashmap.hpp>
@@ -33,6 +36,8 @@
 #include <stout/multihashmap.hpp>
 #include <stout/option.hpp>
 
+#include "common/pool.hpp"
+#include "common/resource_vector.hpp"
 #include "common/resources.hpp"
 #include "common/type_utils.hpp"
 #include "common/units.hpp"
@@ -65,6 +70,17 @@ class SlaveObserver;
 class WhitelistWatcher;
 
 
+// Pools used to create (and destroy) a master's bookkeeping objects,
+// see Master::counters for their occupancy (exposed via stats.json).
+struct Pools
+{
+  Pool<Offer> offers;
+  Pool<Task> tasks;
+  Pool<Framework> frameworks;
+  Pool<Slave> slaves;
+};
+
+
 class Master : public ProtobufProcess<Master>
 {
 public:
@@ -124,6 +140,35 @@ protected:
   virtual void finalize();
   virtual void exited(const UPID& pid);
 
+  // Counts the events served (see Master::probe).
+  virtual void serve(const Event& event)
+  {
+    served++;
+    ProtobufProcess<Master>::serve(event);
+  }
+
+  // Measures how many events are queued in front of an event (and
+  // how long they take) by dispatching to 'probed' every
+  // EVENT_QUEUE_PROBE_INTERVAL.
+  void probe();
+  void probed(double enqueued, uint64_t before);
+
+  // Returns the current counters exposed via stats.json and
+  // state.json (see http::Stats).
+  http::Stats counters() const;
+
+  // Lets the HTTP process handle a stats.json request with the
+  // current counters (which never requires a snapshot).
+  Future<process::http::Response> observeStats(
+      const process::http::Request& request);
+
+  // Publishes a snapshot of the current state to the HTTP process
+  // (unless the state hasn't changed since the last snapshot, or the
+  // last snapshot was published less than STATE_SNAPSHOT_INTERVAL
+  // ago) and then lets the HTTP process handle the request.
+  Future<process::http::Response> observeState(
+      const process::http::Request& request);
+
   void fileAttached(const Future<Nothing>& result, const std::string& path);
 
   // Return connected frameworks that are not in the process of being removed
@@ -175,6 +220,10 @@ protected:
   Slave* getSlave(const SlaveID& slaveId);
   Offer* getOffer(const OfferID& offerId);
 
+  // Returns the slaves running tasks or executors of the framework
+  // (whether or not the framework is currently registered).
+  hashset<Slave*> getSlaves(const FrameworkID& frameworkId);
+
   FrameworkID newFrameworkId();
   OfferID newOfferId();
   SlaveID newSlaveId();
@@ -194,14 +243,6 @@ private:
       const Master& master,
       const process::http::Request& request);
 
-  friend Future<process::http::Response> http::json::stats(
-      const Master& master,
-      const process::http::Request& request);
-
-  friend Future<process::http::Response> http::json::state(
-      const Master& master,
-      const process::http::Request& request);
-
   const flags::Flags<logging::Flags, master::Flags> flags;
 
   UPID leader; // Current leading master.
@@ -217,10 +258,25 @@ private:
 
   multihashmap<std::string, uint16_t> slaveHostnamePorts;
 
+  // Owned by (rather than shared between) masters so that the
+  // occupancy in stats.json is this master's. Every object gets
+  // returned in Master::~Master, i.e., before the pools are destroyed.
+  Pools pools;
+
   hashmap<FrameworkID, Framework*> frameworks;
   hashmap<SlaveID, Slave*> slaves;
   hashmap<OfferID, Offer*> offers;
 
+  // Secondary indices, maintained alongside the maps above, so that
+  // operations on a framework (or a slave identified by its pid or
+  // hostname:port) don't need to scan every slave. Note that tasks
+  // and executors are indexed even if their framework hasn't
+  // (re-)registered yet, e.g., after a master failover.
+  hashmap<FrameworkID, hashset<Task*> > frameworkTasks;
+  hashmap<FrameworkID, hashset<SlaveID> > frameworkExecutorSlaves;
+  hashmap<UPID, Slave*> slavePids;
+  multihashmap<std::pair<std::string, uint16_t>, Slave*> slaveAddresses;
+
   std::list<Framework> completedFrameworks;
 
   int64_t nextFrameworkId; // Used to give each framework a unique ID.
@@ -236,7 +292,32 @@ private:
     uint64_t invalidFrameworkMessages;
   } stats;
 
+  // Time spent handling the operations on the scheduling hot path.
+  process::Histogram launchTasksTime;
+  process::Histogram statusUpdateTime;
+
   double startTime; // Start time used to calculate uptime.
+
+  // Version of the state exposed via stats.json and state.json
+  // (frameworks, slaves, tasks, offers, leader and statistics),
+  // incremented whenever that state changes so that a snapshot of it
+  // only gets published to the HTTP process (and rendered and
+  // compressed there) at most once per version (and interval, see
+  // STATE_SNAPSHOT_INTERVAL) rather than once per request.
+  uint64_t version;
+  uint64_t published; // Version of the last published snapshot.
+  double publishedTime; // When the last snapshot was published.
+
+  // Total resources of all slaves (see http::Stats).
+  ResourceVector totalResources;
+
+  // Shared by snapshots until a framework completes.
+  std::tr1::shared_ptr<const std::vector<http::Snapshot::Framework> >
+    completedFrameworksSnapshot;
+
+  http::HttpProcess* httpProcess;
+
+  uint64_t served; // Number of events served (see Master::serve).
 };
 
 
@@ -258,14 +339,12 @@ struct Slave
 
   Task* getTask(const FrameworkID& frameworkId, const TaskID& taskId)
   {
-    foreachvalue (Task* task, tasks) {
-      if (task->framework_id() == frameworkId &&
-          task->task_id() == taskId) {
-        return task;
-      }
+    std::pair<FrameworkID, TaskID> key = std::make_pair(frameworkId, taskId);
+    if (tasks.count(key) > 0) {
+      return tasks[key];
+    } else {
+      return NULL;
     }
-
-    return NULL;
   }
 
   void addTask(Task* task)
@@ -339,9 +418,10 @@ struct Slave
     }
   }
 
-  Resources resourcesFree()
+  ResourceVector resourcesFree()
   {
-    Resources resources = info.resources() - (resourcesOffered + resourcesInUse);
+    ResourceVector resources =
+      ResourceVector(info.resources()) - (resourcesOffered + resourcesInUse);
     VLOG(1) << "Calculating resources free on slave " << id << std::endl
             << "    Resources: " << info.resources() << std::endl
             << "    Resources Offered: " << resourcesOffered << std::endl
@@ -358,8 +438,8 @@ struct Slave
   double registeredTime;
   double lastHeartbeat;
 
-  Resources resourcesOffered; // Resources offered.
-  Resources resourcesInUse;   // Resources used by tasks and executors.
+  ResourceVector resourcesOffered; // Resources offered.
+  ResourceVector resourcesInUse;   // Resources used by tasks and executors.
 
   // Executors running on this slave.
   hashmap<FrameworkID, hashmap<ExecutorID, ExecutorInfo> > executors;
@@ -482,11 +562,12 @@ struct Framework
 
   hashset<Offer*> offers; // Active offers for framework.
 
-  Resources resources; // Total resources (tasks + offers + executors).
+  ResourceVector resources; // Total resources (tasks + offers + executors).
 
   hashmap<SlaveID, hashmap<ExecutorID, ExecutorInfo> > executors;
 };
 
+
 } // namespace master {
 } // namespace internal {
 } // namespace mesos {
@@ -19,6 +19,8 @@
 #ifndef __SORTER_HPP__
 #define __SORTER_HPP__
 
+#include "common/resource_vector.hpp"
+
 #include "master/master.hpp"
 
 
@@ -28,7 +30,11 @@ namespace master {
 
 // Sorters implement the logic for determining the
 // order in which users or frameworks should receive
-// resource allocations.
+// resource allocations. Sorters used by the
+// HierarchicalAllocatorProcess must also provide a
+// 'const_iterator' (and 'begin' and 'end') for iterating
+// over the clients in sorted order without copying them
+// (see DRFSorter).
 class Sorter
 {
 public:
@@ -51,23 +57,23 @@ public:
   // Specify that resources have been allocated to the
   // given client.
   virtual void allocated(const std::string& client,
-			 const Resources& resources) = 0;
+			 const ResourceVector& resources) = 0;
 
   // Specify that resources have been unallocated from
   // the given client.
   virtual void unallocated(const std::string& client,
-			   const Resources& resources) = 0;
+			   const ResourceVector& resources) = 0;
 
   // Returns the resources that have been allocated to
   // this client.
-  virtual Resources allocation(const std::string& client) = 0;
+  virtual ResourceVector allocation(const std::string& client) = 0;
 
   // Add resources to the total pool of resources this
   // Sorter should consider.
-  virtual void add(const Resources& resources) = 0;
+  virtual void add(const ResourceVector& resources) = 0;
 
   // Remove resources from the total pool.
-  virtual void remove(const Resources& resources) = 0;
+  virtual void remove(const ResourceVector& resources) = 0;
 
   // Returns a list of all clients, in the order that they
   // should be allocated to, according to this Sorter's policy.
@@ -33,6 +33,7 @@
 #include <stout/os.hpp>
 #include <stout/path.hpp>
 #include <stout/numify.hpp>
+#include <stout/stopwatch.hpp>
 #include <stout/strings.hpp>
 #include <stout/try.hpp>
 #include <stout/utils.hpp>
@@ -70,7 +71,9 @@ Slave::Slave(const Resources& _resources,
     local(_local),
     resources(_resources),
     isolationModule(_isolationModule),
-    files(_files) {}
+    files(_files),
+    runTaskTime("slave/run_task_time_ms"),
+    statusUpdateTime("slave/status_update_time_ms") {}
 
 
 Slave::Slave(const flags::Flags<logging::Flags, slave::Flags>& _flags,
@@ -81,7 +84,9 @@ Slave::Slave(const flags::Flags<logging::Flags, slave::Flags>& _flags,
     flags(_flags),
     local(_local),
     isolationModule(_isolationModule),
-    files(_files)
+    files(_files),
+    runTaskTime("slave/run_task_time_ms"),
+    statusUpdateTime("slave/status_update_time_ms")
 {
   if (flags.resources.isNone()) {
     // TODO(benh): Move this computation into Flags as the "default".
@@ -471,6 +476,9 @@ void Slave::runTask(const FrameworkInfo& frameworkInfo,
                     const string& pid,
                     const TaskInfo& task)
 {
+  Stopwatch stopwatch;
+  stopwatch.start();
+
   LOG(INFO) << "Got assigned task " << task.task_id()
             << " for framework " << frameworkId;
 
@@ -556,6 +564,8 @@ void Slave::runTask(const FrameworkInfo& frameworkInfo,
              framework->id, framework->info, executor->info,
              executor->directory, executor->resources);
   }
+
+  runTaskTime.record(stopwatch.elapsed());
 }
 
 
@@ -826,6 +836,9 @@ void Slave::registerExecutor(const FrameworkID& frameworkId,
 
 void Slave::statusUpdate(const StatusUpdate& update)
 {
+  Stopwatch stopwatch;
+  stopwatch.start();
+
   const TaskStatus& status = update.status();
 
   LOG(INFO) << "Status update: task " << status.task_id()
@@ -875,6 +888,8 @@ void Slave::statusUpdate(const StatusUpdate& update)
                  << "framework " << update.framework_id();
     stats.invalidStatusUpdates++;
   }
+
+  statusUpdateTime.record(stopwatch.elapsed());
 }
 
 
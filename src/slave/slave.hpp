@@ -25,6 +25,7 @@
 #include <process/http.hpp>
 #include <process/process.hpp>
 #include <process/protobuf.hpp>
+#include <process/statistics.hpp>
 
 #include <stout/hashmap.hpp>
 #include <stout/os.hpp>
@@ -210,6 +211,10 @@ private:
     uint64_t invalidFrameworkMessages;
   } stats;
 
+  // Time spent handling tasks and their status updates.
+  process::Histogram runTaskTime;
+  process::Histogram statusUpdateTime;
+
   double startTime;
 
   bool connected; // Flag to indicate if slave is registered.
@@ -0,0 +1,481 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <process/clock.hpp>
+#include <process/dispatch.hpp>
+#include <process/future.hpp>
+#include <process/process.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/hashset.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+
+#include "common/resources.hpp"
+
+#include "configurator/configurator.hpp"
+#include "configurator/configuration.hpp"
+
+#include "flags/flags.hpp"
+
+#include "logging/flags.hpp"
+#include "logging/logging.hpp"
+
+#include "master/drf_sorter.hpp"
+#include "master/flags.hpp"
+#include "master/hierarchical_allocator_process.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::master;
+
+using namespace process;
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::list;
+using std::string;
+using std::vector;
+
+// This benchmark is not run as part of 'make check', but rather is
+// intended to be run by hand (e.g., './mesos-allocator-benchmark
+// --slaves=10000 --frameworks=1000') when evaluating changes to the
+// allocator. It drives the hierarchical DRF allocator directly (i.e.,
+// without a master or any slaves) through a number of allocation
+// cycles. In between cycles the (simulated) frameworks decline some
+// of the resources they were offered (optionally filtering the slave)
+// and launch tasks using the rest, which get recovered after a number
+// of cycles. The clock is paused and advanced between cycles so that
+// filters expire deterministically.
+
+
+// Options that describe the simulated cluster and its frameworks.
+struct Cluster
+{
+  int slaves;
+  int frameworks;
+  int users;
+  int cycles;
+  Resources resources;  // Per slave.
+  double decline;       // Fraction of offers that get declined.
+  double refuse;        // Seconds to filter a slave after declining.
+  int duration;         // Number of cycles a launched task runs for.
+  double whitelisted;   // Fraction of slaves that are whitelisted.
+  Duration interval;    // Simulated time between cycles.
+  unsigned int seed;
+};
+
+
+// Resources used on a slave by a framework to launch tasks.
+struct Launched
+{
+  FrameworkID frameworkId;
+  SlaveID slaveId;
+  Resources resources;
+  int finish; // Cycle after which the task finishes.
+};
+
+
+class BenchmarkAllocatorProcess
+  : public HierarchicalAllocatorProcess<DRFSorter, DRFSorter>
+{
+public:
+  BenchmarkAllocatorProcess(const Cluster& _cluster)
+    : cluster(_cluster),
+      cycles(0),
+      offers(0),
+      declines(0),
+      seed(_cluster.seed) {}
+
+  virtual ~BenchmarkAllocatorProcess() {}
+
+  // Responds to the outstanding offers, recovers the resources of
+  // tasks that have finished and then performs an allocation,
+  // returning the number of seconds it took to allocate.
+  double cycle()
+  {
+    cycles++;
+
+    foreach (const Offered& offered, outstanding) {
+      foreachpair (const SlaveID& slaveId,
+                   const Resources& resources,
+                   offered.second) {
+        if (rand_r(&seed) < cluster.decline * RAND_MAX) {
+          Filters refusal;
+          refusal.set_refuse_seconds(cluster.refuse);
+          resourcesUnused(offered.first, slaveId, resources, refusal);
+          declines++;
+        } else {
+          Launched task;
+          task.frameworkId = offered.first;
+          task.slaveId = slaveId;
+          task.resources = resources;
+          task.finish = cycles + cluster.duration;
+          tasks.push_back(task);
+        }
+      }
+    }
+
+    outstanding.clear();
+
+    list<Launched>::iterator iterator = tasks.begin();
+    while (iterator != tasks.end()) {
+      if (iterator->finish <= cycles) {
+        resourcesRecovered(
+            iterator->frameworkId, iterator->slaveId, iterator->resources);
+        iterator = tasks.erase(iterator);
+      } else {
+        ++iterator;
+      }
+    }
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    allocate();
+
+    return stopwatch.elapsed().secs();
+  }
+
+  // Returns the number of offers made (per slave) and declined.
+  std::pair<size_t, size_t> counts()
+  {
+    return std::make_pair(offers, declines);
+  }
+
+protected:
+  virtual void offer(const FrameworkID& frameworkId,
+                     const hashmap<SlaveID, Resources>& offerable)
+  {
+    outstanding.push_back(Offered(frameworkId, offerable));
+    offers += offerable.size();
+  }
+
+private:
+  typedef std::pair<FrameworkID, hashmap<SlaveID, Resources> > Offered;
+
+  const Cluster cluster;
+
+  int cycles;
+  size_t offers;
+  size_t declines;
+  unsigned int seed;
+
+  vector<Offered> outstanding;
+  list<Launched> tasks;
+};
+
+
+// Returns the peak resident set size of this process in megabytes.
+static double memory()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) < 0) {
+    return -1;
+  }
+
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0); // Bytes.
+#else
+  return usage.ru_maxrss / 1024.0; // Kilobytes.
+#endif
+}
+
+
+// Returns the specified percentile of the (sorted) values.
+static double percentile(const vector<double>& values, double p)
+{
+  size_t index = (size_t) (p * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+
+void usage(const char* argv0, const Configurator& configurator)
+{
+  cerr << "Usage: " << os::basename(argv0).get() << " [...]" << endl
+       << endl
+       << "Supported options:" << endl
+       << configurator.getUsage();
+}
+
+
+int main(int argc, char** argv)
+{
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  flags::Flags<logging::Flags> flags;
+
+  int slaves;
+  flags.add(&slaves,
+            "slaves",
+            "Number of slaves in the cluster",
+            1000);
+
+  int frameworks;
+  flags.add(&frameworks,
+            "frameworks",
+            "Number of frameworks in the cluster",
+            10);
+
+  int users;
+  flags.add(&users,
+            "users",
+            "Number of users the frameworks are spread across",
+            10);
+
+  int cycles;
+  flags.add(&cycles,
+            "cycles",
+            "Number of allocation cycles to time",
+            100);
+
+  string resources;
+  flags.add(&resources,
+            "resources",
+            "Resources of each slave",
+            "cpus:16;mem:65536");
+
+  double decline;
+  flags.add(&decline,
+            "decline",
+            "Fraction of offered slaves that frameworks decline\n"
+            "(the rest get used to launch tasks)",
+            0.5);
+
+  double refuse;
+  flags.add(&refuse,
+            "refuse_seconds",
+            "Seconds frameworks filter a slave for after declining it\n"
+            "(0 means no filters get created)",
+            5.0);
+
+  int duration;
+  flags.add(&duration,
+            "task_cycles",
+            "Number of cycles launched tasks run for",
+            5);
+
+  double whitelisted;
+  flags.add(&whitelisted,
+            "whitelisted",
+            "Fraction of slaves in the whitelist\n"
+            "(1 means no whitelist is used)",
+            1.0);
+
+  Duration interval;
+  flags.add(&interval,
+            "interval",
+            "Amount of (simulated) time between allocation cycles",
+            Seconds(1.0));
+
+  unsigned int seed;
+  flags.add(&seed,
+            "seed",
+            "Seed used to decide which offers get declined",
+            1);
+
+  bool verbose;
+  flags.add(&verbose,
+            "verbose",
+            "Log all severity levels to stderr",
+            false);
+
+  bool help;
+  flags.add(&help,
+            "help",
+            "Prints this help message",
+            false);
+
+  Configurator configurator(flags);
+  Configuration configuration;
+  try {
+    configuration = configurator.load(argc, argv);
+  } catch (ConfigurationException& e) {
+    cerr << "Configuration error: " << e.what() << endl;
+    usage(argv[0], configurator);
+    exit(1);
+  }
+
+  flags.load(configuration.getMap());
+
+  if (help) {
+    usage(argv[0], configurator);
+    exit(1);
+  }
+
+  if (slaves <= 0 || frameworks <= 0 || users <= 0 || cycles <= 0) {
+    cerr << "Expecting a positive number of slaves, frameworks, users and"
+         << " cycles" << endl;
+    exit(1);
+  }
+
+  process::initialize();
+
+  // Logging every allocation would drown out the results.
+  if (!verbose) {
+    flags.quiet = true;
+  }
+
+  logging::initialize(argv[0], flags);
+
+  Cluster cluster;
+  cluster.slaves = slaves;
+  cluster.frameworks = frameworks;
+  cluster.users = std::min(users, frameworks);
+  cluster.cycles = cycles;
+  cluster.resources = Resources::parse(resources);
+  cluster.decline = decline;
+  cluster.refuse = refuse;
+  cluster.duration = duration;
+  cluster.whitelisted = whitelisted;
+  cluster.interval = interval;
+  cluster.seed = seed;
+
+  cout << "Allocating " << cluster.resources << " on each of "
+       << cluster.slaves << " slaves to " << cluster.frameworks
+       << " frameworks (" << cluster.users << " users) for "
+       << cluster.cycles << " cycles" << endl;
+
+  // The clock stays paused so that filters only expire when we
+  // advance it between cycles.
+  Clock::pause();
+
+  BenchmarkAllocatorProcess allocator(cluster);
+  PID<BenchmarkAllocatorProcess> pid = spawn(allocator);
+
+  // Never do batch allocations, we do the allocations ourselves.
+  master::Flags _flags;
+  _flags.allocation_interval = Weeks(52);
+
+  dispatch(allocator, &AllocatorProcess::initialize, _flags, PID<Master>());
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  // Add the slaves before the frameworks so that we don't do an
+  // allocation for each slave.
+  hashset<string> whitelist;
+
+  for (int i = 0; i < cluster.slaves; i++) {
+    SlaveInfo slaveInfo;
+    slaveInfo.set_hostname("host" + stringify(i));
+    slaveInfo.set_webui_hostname(slaveInfo.hostname());
+    slaveInfo.mutable_resources()->MergeFrom(cluster.resources);
+
+    SlaveID slaveId;
+    slaveId.set_value("slave" + stringify(i));
+
+    dispatch(allocator, &AllocatorProcess::slaveAdded,
+             slaveId, slaveInfo, hashmap<FrameworkID, Resources>());
+
+    if (i < cluster.whitelisted * cluster.slaves) {
+      whitelist.insert(slaveInfo.hostname());
+    }
+  }
+
+  if (cluster.whitelisted < 1.0) {
+    dispatch(allocator, &AllocatorProcess::updateWhitelist,
+             Option<hashset<string> >::some(whitelist));
+  }
+
+  for (int i = 0; i < cluster.frameworks; i++) {
+    FrameworkInfo frameworkInfo;
+    frameworkInfo.set_user("user" + stringify(i % cluster.users));
+    frameworkInfo.set_name("framework" + stringify(i));
+
+    FrameworkID frameworkId;
+    frameworkId.set_value("framework" + stringify(i));
+
+    dispatch(allocator, &AllocatorProcess::frameworkAdded,
+             frameworkId, frameworkInfo, Resources());
+  }
+
+  // Wait for the allocator to process everything.
+  dispatch(pid, &BenchmarkAllocatorProcess::counts).await();
+
+  stopwatch.stop();
+
+  cout << "Added slaves and frameworks in " << stopwatch.elapsed()
+       << " (peak memory " << std::fixed << std::setprecision(1)
+       << memory() << " MB)" << endl;
+
+  vector<double> latencies;
+  latencies.reserve(cluster.cycles);
+
+  for (int i = 0; i < cluster.cycles; i++) {
+    Future<double> latency =
+      dispatch(pid, &BenchmarkAllocatorProcess::cycle);
+
+    latency.await();
+
+    CHECK(latency.isReady());
+
+    latencies.push_back(latency.get());
+
+    Clock::advance(cluster.interval.secs());
+    Clock::settle();
+  }
+
+  Future<std::pair<size_t, size_t> > counts =
+    dispatch(pid, &BenchmarkAllocatorProcess::counts);
+
+  counts.await();
+
+  CHECK(counts.isReady());
+
+  terminate(allocator);
+  wait(allocator);
+
+  double total = 0;
+  foreach (double latency, latencies) {
+    total += latency;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  cout << "Made " << counts.get().first << " offers ("
+       << counts.get().second << " declined)" << endl;
+
+  cout << "allocate() latency (ms):" << std::fixed << std::setprecision(3)
+       << " mean " << total / latencies.size() * 1000
+       << " min " << latencies.front() * 1000
+       << " p50 " << percentile(latencies, 0.50) * 1000
+       << " p90 " << percentile(latencies, 0.90) * 1000
+       << " p99 " << percentile(latencies, 0.99) * 1000
+       << " max " << latencies.back() * 1000 << endl;
+
+  cout << "Peak memory: " << std::setprecision(1) << memory() << " MB"
+       << endl;
+
+  return 0;
+}
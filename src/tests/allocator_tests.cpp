@@ -1296,3 +1296,111 @@ TYPED_TEST(AllocatorTest, WhitelistSlave)
 
   os::rm(path);
 }
+
+
+// Records the offers made by the allocator instead of sending them
+// to a master.
+class RecordingAllocatorProcess
+  : public master::HierarchicalAllocatorProcess<master::DRFSorter,
+                                                master::DRFSorter>
+{
+public:
+  typedef std::pair<FrameworkID, SlaveID> Offer;
+
+  void allocate()
+  {
+    master::HierarchicalAllocatorProcess<master::DRFSorter,
+                                         master::DRFSorter>::allocate();
+  }
+
+  virtual void offer(const FrameworkID& frameworkId,
+                     const hashmap<SlaveID, Resources>& offerable)
+  {
+    foreachkey (const SlaveID& slaveId, offerable) {
+      offers[frameworkId.value() + ":" + slaveId.value()] =
+        std::make_pair(frameworkId, slaveId);
+    }
+  }
+
+  // Keyed by "framework:slave" so that offers can be declined in the
+  // same order no matter what order they were made in.
+  map<string, Offer> offers;
+};
+
+
+// Checks that allocations only consider the slaves and frameworks
+// that have changed since the last allocation.
+TEST(AllocatorTest, Incremental)
+{
+  RecordingAllocatorProcess allocator;
+
+  master::Flags flags;
+  flags.allocation_interval = Weeks(52);
+
+  allocator.initialize(flags, PID<Master>());
+
+  Resources resources = Resources::parse("cpus:2;mem:1024");
+
+  for (int i = 0; i < 10; i++) {
+    SlaveInfo slaveInfo;
+    slaveInfo.set_hostname("host" + stringify(i));
+    slaveInfo.mutable_resources()->MergeFrom(resources);
+
+    SlaveID slaveId;
+    slaveId.set_value("slave" + stringify(i));
+
+    allocator.slaveAdded(
+        slaveId, slaveInfo, hashmap<FrameworkID, Resources>());
+  }
+
+  FrameworkInfo frameworkInfo1;
+  frameworkInfo1.set_user("user1");
+  frameworkInfo1.set_name("framework1");
+
+  FrameworkID frameworkId1;
+  frameworkId1.set_value("framework1");
+
+  allocator.frameworkAdded(frameworkId1, frameworkInfo1, Resources());
+
+  EXPECT_EQ(10u, allocator.offers.size());
+
+  // Decline every offer, filtering half of the slaves.
+  map<string, RecordingAllocatorProcess::Offer> declined;
+  declined.swap(allocator.offers);
+
+  int i = 0;
+  foreachvalue (const RecordingAllocatorProcess::Offer& offer, declined) {
+    Filters filters;
+    filters.set_refuse_seconds(i++ % 2 == 0 ? 1000 : 0);
+
+    allocator.resourcesUnused(offer.first, offer.second, resources, filters);
+  }
+
+  // Only the unfiltered slaves get offered again.
+  allocator.allocate();
+
+  EXPECT_EQ(5u, allocator.offers.size());
+  allocator.offers.clear();
+
+  // Nothing changed so nothing gets offered.
+  allocator.allocate();
+
+  EXPECT_EQ(0u, allocator.offers.size());
+
+  // A new framework gets offered the (clean) filtered slaves.
+  FrameworkInfo frameworkInfo2;
+  frameworkInfo2.set_user("user2");
+  frameworkInfo2.set_name("framework2");
+
+  FrameworkID frameworkId2;
+  frameworkId2.set_value("framework2");
+
+  allocator.frameworkAdded(frameworkId2, frameworkInfo2, Resources());
+
+  EXPECT_EQ(5u, allocator.offers.size());
+
+  foreachvalue (const RecordingAllocatorProcess::Offer& offer,
+                allocator.offers) {
+    EXPECT_EQ(frameworkId2, offer.first);
+  }
+}
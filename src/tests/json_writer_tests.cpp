@@ -0,0 +1,99 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <string>
+
+#include <stout/json.hpp>
+
+#include "common/json_writer.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using std::string;
+
+
+// Returns the JSON::render rendering of a JSON value.
+static string render(const JSON::Value& value)
+{
+  std::ostringstream out;
+  JSON::render(out, value);
+  return out.str();
+}
+
+
+TEST(JsonWriterTest, Empty)
+{
+  string out;
+  JsonWriter writer(&out);
+  writer.beginObject();
+  writer.endObject();
+
+  EXPECT_EQ(render(JSON::Object()), out);
+
+  out.clear();
+  writer.beginArray();
+  writer.endArray();
+
+  EXPECT_EQ(render(JSON::Array()), out);
+}
+
+
+TEST(JsonWriterTest, Render)
+{
+  JSON::Object inner;
+  inner.values["cpus"] = 2.5;
+  inner.values["ports"] = "[31000-32000]";
+
+  JSON::Array array;
+  array.values.push_back(inner);
+  array.values.push_back(1350000000.123456);
+  array.values.push_back("\"quoted\"\n\t/\\");
+
+  JSON::Object object;
+  object.values["array"] = array;
+  object.values["bool"] = true;
+  object.values["empty"] = JSON::Array();
+  object.values["integer"] = 42;
+  object.values["string"] = "value";
+
+  string out;
+  JsonWriter writer(&out);
+  writer.beginObject();
+  writer.key("array");
+  writer.beginArray();
+  writer.beginObject();
+  writer.field("cpus", 2.5);
+  writer.field("ports", "[31000-32000]");
+  writer.endObject();
+  writer.value(1350000000.123456);
+  writer.value("\"quoted\"\n\t/\\");
+  writer.endArray();
+  writer.field("bool", true);
+  writer.key("empty");
+  writer.beginArray();
+  writer.endArray();
+  writer.field("integer", 42);
+  writer.field("string", string("value"));
+  writer.endObject();
+
+  EXPECT_EQ(render(object), out);
+}
@@ -0,0 +1,350 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <stdlib.h>
+
+#include <algorithm>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <process/future.hpp>
+#include <process/pid.hpp>
+#include <process/process.hpp>
+#include <process/timeout.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/nothing.hpp>
+#include <stout/option.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+#include <stout/try.hpp>
+
+#include "configurator/configurator.hpp"
+#include "configurator/configuration.hpp"
+
+#include "flags/flags.hpp"
+
+#include "log/log.hpp"
+#include "log/replica.hpp"
+
+#include "logging/flags.hpp"
+#include "logging/logging.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+using namespace mesos::internal::log;
+
+using namespace process;
+
+using std::cerr;
+using std::cout;
+using std::deque;
+using std::endl;
+using std::list;
+using std::pair;
+using std::set;
+using std::string;
+using std::vector;
+
+// This benchmark is not run as part of 'make check', but rather is
+// intended to be run by hand (e.g., './mesos-log-benchmark
+// --replicas=5 --window=64') when evaluating changes to the
+// replicated log. A writer appends entries to a log whose replicas
+// all run in this process (each backed by its own directory) while
+// keeping up to a window of appends outstanding, i.e., a window of 1
+// corresponds to appending synchronously. Use --synchronous to
+// compare against Log::Writer::append and --storage to compare the
+// replica storage backends on the same workload. Use --catchup to
+// also measure how long it takes to catch up a new (empty) replica
+// to the end of the log afterwards, i.e., getting a writer elected
+// with it.
+
+
+// Returns the specified percentile of the (sorted) values.
+static double percentile(const vector<double>& values, double p)
+{
+  size_t index = (size_t) (p * (values.size() - 1) + 0.5);
+  return values[std::min(index, values.size() - 1)];
+}
+
+
+void usage(const char* argv0, const Configurator& configurator)
+{
+  cerr << "Usage: " << os::basename(argv0).get() << " [...]" << endl
+       << endl
+       << "Supported options:" << endl
+       << configurator.getUsage();
+}
+
+
+int main(int argc, char** argv)
+{
+  GOOGLE_PROTOBUF_VERIFY_VERSION;
+
+  flags::Flags<logging::Flags> flags;
+
+  int replicas;
+  flags.add(&replicas,
+            "replicas",
+            "Number of replicas (the quorum is a majority of them)",
+            3);
+
+  int appends;
+  flags.add(&appends,
+            "appends",
+            "Number of entries to append",
+            10000);
+
+  int size;
+  flags.add(&size,
+            "size",
+            "Size of each entry in bytes",
+            1024);
+
+  int window;
+  flags.add(&window,
+            "window",
+            "Maximum number of outstanding appends",
+            64);
+
+  bool synchronous;
+  flags.add(&synchronous,
+            "synchronous",
+            "Append synchronously (i.e., one append at a time)",
+            false);
+
+  Duration timeout;
+  flags.add(&timeout,
+            "timeout",
+            "Amount of time to wait for an append",
+            Seconds(10.0));
+
+  string storage;
+  flags.add(&storage,
+            "storage",
+            "Storage backend of the replicas (leveldb or segmented)",
+            "leveldb");
+
+  string path;
+  flags.add(&path,
+            "path",
+            "Directory to keep the replicas in (gets removed)",
+            os::getcwd() + "/.log_benchmark");
+
+  bool catchup;
+  flags.add(&catchup,
+            "catchup",
+            "Measure catching up a new replica after appending",
+            false);
+
+  bool verbose;
+  flags.add(&verbose,
+            "verbose",
+            "Log all severity levels to stderr",
+            false);
+
+  bool help;
+  flags.add(&help,
+            "help",
+            "Prints this help message",
+            false);
+
+  Configurator configurator(flags);
+  Configuration configuration;
+  try {
+    configuration = configurator.load(argc, argv);
+  } catch (ConfigurationException& e) {
+    cerr << "Configuration error: " << e.what() << endl;
+    usage(argv[0], configurator);
+    exit(1);
+  }
+
+  flags.load(configuration.getMap());
+
+  if (help) {
+    usage(argv[0], configurator);
+    exit(1);
+  }
+
+  if (replicas <= 0 || appends <= 0 || size < 0 || window <= 0) {
+    cerr << "Expecting a positive number of replicas, appends and window"
+         << endl;
+    exit(1);
+  }
+
+  if (storage != "leveldb" && storage != "segmented") {
+    cerr << "Expecting a storage of either leveldb or segmented" << endl;
+    exit(1);
+  }
+
+  process::initialize();
+
+  // Logging every append would drown out the results.
+  if (!verbose) {
+    flags.quiet = true;
+  }
+
+  logging::initialize(argv[0], flags);
+
+  const int quorum = replicas / 2 + 1;
+
+  cout << "Appending " << appends << " entries of " << size
+       << " bytes to a log with " << replicas << " replicas (quorum "
+       << quorum << ", " << (synchronous ? "synchronous" : "window ")
+       << (synchronous ? "" : stringify(window)) << ") using "
+       << storage << " storage" << endl;
+
+  os::rmdir(path);
+
+  Try<Nothing> mkdir = os::mkdir(path);
+  if (mkdir.isError()) {
+    cerr << "Failed to create " << path << ": " << mkdir.error() << endl;
+    exit(1);
+  }
+
+  // The log has its own replica, the others are standalone.
+  list<Replica*> others;
+  set<UPID> pids;
+  for (int i = 1; i < replicas; i++) {
+    Replica* replica = new Replica(path + "/replica" + stringify(i), storage);
+    others.push_back(replica);
+    pids.insert(replica->pid());
+  }
+
+  Log* log = new Log(quorum, path + "/replica0", pids, storage);
+
+  Log::Writer* writer = new Log::Writer(log, timeout, 3, window);
+
+  const string data(size, 'x');
+
+  vector<double> latencies;
+  latencies.reserve(appends);
+
+  Option<Log::Position> last;
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  if (synchronous) {
+    for (int i = 0; i < appends; i++) {
+      double start = stopwatch.elapsed().secs();
+      Result<Log::Position> position = writer->append(data, timeout);
+      if (!position.isSome()) {
+        cerr << "Failed to append: "
+             << (position.isError() ? position.error() : "timed out")
+             << endl;
+        exit(1);
+      }
+      latencies.push_back(stopwatch.elapsed().secs() - start);
+      last = position.get();
+    }
+  } else {
+    // Since appends get committed in order, waiting for the oldest
+    // outstanding append measures its latency (give or take).
+    deque<pair<Future<Log::Position>, double> > outstanding;
+    for (int i = 0; i < appends || !outstanding.empty();) {
+      if (i < appends && outstanding.size() < (size_t) window) {
+        double start = stopwatch.elapsed().secs();
+        outstanding.push_back(
+            std::make_pair(writer->appendAsync(data, timeout), start));
+        i++;
+        continue;
+      }
+
+      Future<Log::Position> position = outstanding.front().first;
+      position.await();
+      if (!position.isReady()) {
+        cerr << "Failed to append: "
+             << (position.isFailed() ? position.failure() : "discarded")
+             << endl;
+        exit(1);
+      }
+      latencies.push_back(
+          stopwatch.elapsed().secs() - outstanding.front().second);
+      outstanding.pop_front();
+      last = position.get();
+    }
+  }
+
+  stopwatch.stop();
+
+  delete writer;
+  delete log;
+
+  Stopwatch catchupwatch;
+
+  if (catchup) {
+    // The new replica takes the place of the log's previous replica
+    // (so the same number of replicas are available).
+    const string replica = path + "/replica" + stringify(replicas);
+
+    catchupwatch.start();
+    log = new Log(quorum, replica, pids, storage);
+    writer = new Log::Writer(log, timeout, 3, window);
+    catchupwatch.stop();
+
+    Log::Reader reader(log);
+    if (!(reader.ending() >= last.get())) {
+      cerr << "Failed to catch up the new replica" << endl;
+      exit(1);
+    }
+
+    delete writer;
+    delete log;
+  }
+
+  foreach (Replica* replica, others) {
+    delete replica;
+  }
+
+  os::rmdir(path);
+
+  double total = 0;
+  foreach (double latency, latencies) {
+    total += latency;
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+
+  cout << "Appended " << appends << " entries in " << stopwatch.elapsed()
+       << " (" << std::fixed << std::setprecision(1)
+       << appends / stopwatch.elapsed().secs() << " appends/sec)" << endl;
+
+  cout << "append latency (ms):" << std::fixed << std::setprecision(3)
+       << " mean " << total / latencies.size() * 1000
+       << " min " << latencies.front() * 1000
+       << " p50 " << percentile(latencies, 0.50) * 1000
+       << " p90 " << percentile(latencies, 0.90) * 1000
+       << " p99 " << percentile(latencies, 0.99) * 1000
+       << " max " << latencies.back() * 1000 << endl;
+
+  if (catchup) {
+    cout << "Caught up a new replica with " << appends << " entries in "
+         << catchupwatch.elapsed() << " (" << std::fixed << std::setprecision(1)
+         << appends / catchupwatch.elapsed().secs() << " entries/sec)" << endl;
+  }
+
+  return 0;
+}
@@ -18,6 +18,9 @@
 
 #include <gmock/gmock.h>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 #include <set>
 #include <string>
 
@@ -35,6 +38,7 @@
 #include "log/coordinator.hpp"
 #include "log/log.hpp"
 #include "log/replica.hpp"
+#include "log/segmented_storage.hpp"
 
 #include "messages/messages.hpp"
 
@@ -267,6 +271,446 @@ TEST(ReplicaTest, Recover)
 }
 
 
+TEST(ReplicaTest, GroupCommit)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  Replica replica1(path);
+
+  const uint64_t id = 1;
+
+  PromiseRequest request;
+  request.set_id(id);
+
+  Future<PromiseResponse> future = protocol::promise(replica1.pid(), request);
+
+  future.await(Seconds(2.0));
+  ASSERT_TRUE(future.isReady());
+  EXPECT_TRUE(future.get().okay());
+
+  // Concurrent writes get made durable together but each of them
+  // still gets a response (once it's durable).
+  std::list<Future<WriteResponse> > futures;
+  for (uint64_t position = 1; position <= 20; position++) {
+    WriteRequest request;
+    request.set_id(id);
+    request.set_position(position);
+    request.set_type(Action::APPEND);
+    request.mutable_append()->set_bytes(stringify(position));
+    futures.push_back(protocol::write(replica1.pid(), request));
+  }
+
+  uint64_t position = 1;
+  foreach (Future<WriteResponse>& future, futures) {
+    future.await(Seconds(2.0));
+    ASSERT_TRUE(future.isReady());
+    EXPECT_TRUE(future.get().okay());
+    EXPECT_EQ(position++, future.get().position());
+  }
+
+  Replica replica2(path);
+
+  Future<std::list<Action> > actions = replica2.read(1, 20);
+  ASSERT_TRUE(actions.await(Seconds(2.0)));
+  ASSERT_TRUE(actions.isReady());
+  ASSERT_EQ(20u, actions.get().size());
+
+  foreach (const Action& action, actions.get()) {
+    ASSERT_TRUE(action.has_type());
+    ASSERT_EQ(Action::APPEND, action.type());
+    EXPECT_EQ(stringify(action.position()), action.append().bytes());
+  }
+
+  os::rmdir(path);
+}
+
+
+// Storage that fails to sync while 'failing' is set.
+class FailingStorage : public SegmentedStorage
+{
+public:
+  FailingStorage() : failing(true), failures(0) {}
+
+  virtual Try<Nothing> sync()
+  {
+    if (failing) {
+      failures++;
+      return Try<Nothing>::error("Injected sync failure");
+    }
+    return SegmentedStorage::sync();
+  }
+
+  volatile bool failing;
+  volatile int failures;
+};
+
+
+TEST(ReplicaTest, SyncFailure)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  FailingStorage* storage = new FailingStorage();
+
+  Replica replica(path, storage); // Takes ownership of the storage.
+
+  const uint64_t id = 1;
+
+  PromiseRequest request;
+  request.set_id(id);
+
+  Future<PromiseResponse> future1 = protocol::promise(replica.pid(), request);
+
+  // A promise that isn't durable must not be made (and neither can
+  // any response that follows it).
+  EXPECT_FALSE(future1.await(Seconds(0.5)));
+  EXPECT_LT(0, storage->failures);
+
+  Future<PromiseResponse> future2 = protocol::promise(replica.pid(), request);
+
+  EXPECT_FALSE(future2.await(Seconds(0.5)));
+
+  // Once a retried sync succeeds the responses get sent.
+  storage->failing = false;
+
+  ASSERT_TRUE(future1.await(Seconds(2.0)));
+  ASSERT_TRUE(future1.isReady());
+  EXPECT_TRUE(future1.get().okay());
+
+  ASSERT_TRUE(future2.await(Seconds(2.0)));
+  ASSERT_TRUE(future2.isReady());
+  EXPECT_FALSE(future2.get().okay());
+
+  os::rmdir(path);
+}
+
+
+TEST(ReplicaTest, Catchup)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+  const std::string path3 = os::getcwd() + "/.log3";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+  os::rmdir(path3);
+
+  Replica replica1(path1);
+
+  const uint64_t id = 1;
+
+  PromiseRequest request;
+  request.set_id(id);
+
+  Future<PromiseResponse> future = protocol::promise(replica1.pid(), request);
+
+  future.await(Seconds(2.0));
+  ASSERT_TRUE(future.isReady());
+  EXPECT_TRUE(future.get().okay());
+
+  // More positions than fit in a single chunk, all but one of them
+  // learned.
+  std::list<Future<WriteResponse> > futures;
+  for (uint64_t position = 1; position <= 1500; position++) {
+    WriteRequest request;
+    request.set_id(id);
+    request.set_position(position);
+    request.set_learned(position != 1000);
+    request.set_type(Action::APPEND);
+    request.mutable_append()->set_bytes(stringify(position));
+    futures.push_back(protocol::write(replica1.pid(), request));
+  }
+
+  foreach (Future<WriteResponse>& future, futures) {
+    future.await(Seconds(10.0));
+    ASSERT_TRUE(future.isReady());
+    EXPECT_TRUE(future.get().okay());
+  }
+
+  UPID unavailable;
+
+  {
+    Replica replica3(path3);
+    unavailable = replica3.pid();
+  }
+
+  Replica replica2(path2);
+
+  // The chunks get requested from the peers in turn, so one of them
+  // has to be retried after timing out on the unavailable peer.
+  std::set<UPID> peers;
+  peers.insert(replica1.pid());
+  peers.insert(unavailable);
+
+  Future<uint64_t> caughtup = replica2.catchup(peers, 1500, Seconds(1.0));
+  ASSERT_TRUE(caughtup.await(Seconds(10.0)));
+  ASSERT_TRUE(caughtup.isReady());
+  EXPECT_EQ(1499u, caughtup.get());
+
+  // The unlearned position still needs to get filled.
+  Future<std::set<uint64_t> > missing = replica2.missing(1500);
+  ASSERT_TRUE(missing.await(Seconds(2.0)));
+  ASSERT_TRUE(missing.isReady());
+  EXPECT_EQ(1u, missing.get().count(1000));
+  EXPECT_EQ(0u, missing.get().count(999));
+
+  Future<std::list<Action> > actions = replica2.read(1, 1500);
+  ASSERT_TRUE(actions.await(Seconds(2.0)));
+  ASSERT_TRUE(actions.isReady());
+  ASSERT_EQ(1499u, actions.get().size());
+
+  foreach (const Action& action, actions.get()) {
+    EXPECT_TRUE(action.learned());
+    ASSERT_TRUE(action.has_type());
+    ASSERT_EQ(Action::APPEND, action.type());
+    EXPECT_EQ(stringify(action.position()), action.append().bytes());
+  }
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+  os::rmdir(path3);
+}
+
+
+TEST(SegmentedStorageTest, PersistRecover)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  {
+    SegmentedStorage storage;
+
+    Try<State> state = storage.recover(path);
+    ASSERT_SOME(state);
+    EXPECT_EQ(0u, state.get().coordinator);
+    EXPECT_EQ(0u, state.get().end);
+
+    Promise promise;
+    promise.set_id(1);
+    ASSERT_SOME(storage.persist(promise));
+
+    for (uint64_t position = 0; position < 10; position++) {
+      Action action;
+      action.set_position(position);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(stringify(position));
+      ASSERT_SOME(storage.persist(action));
+    }
+
+    // Learn one of the positions (i.e., rewrite it).
+    Try<Action> read = storage.read(5);
+    ASSERT_SOME(read);
+    Action action = read.get();
+    action.set_learned(true);
+    ASSERT_SOME(storage.persist(action));
+
+    ASSERT_SOME(storage.sync());
+  }
+
+  SegmentedStorage storage;
+
+  Try<State> state = storage.recover(path);
+  ASSERT_SOME(state);
+  EXPECT_EQ(1u, state.get().coordinator);
+  EXPECT_EQ(0u, state.get().begin);
+  EXPECT_EQ(9u, state.get().end);
+  EXPECT_EQ(1u, state.get().learned.size());
+  EXPECT_EQ(1u, state.get().learned.count(5));
+  EXPECT_EQ(9u, state.get().unlearned.size());
+
+  for (uint64_t position = 0; position < 10; position++) {
+    Try<Action> action = storage.read(position);
+    ASSERT_SOME(action);
+    EXPECT_EQ(stringify(position), action.get().append().bytes());
+    EXPECT_EQ(position == 5, action.get().learned());
+  }
+
+  os::rmdir(path);
+}
+
+
+TEST(SegmentedStorageTest, Truncate)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  size_t segments = 0;
+
+  {
+    // Use small segments so the actions are spread across many.
+    SegmentedStorage storage(1024);
+
+    ASSERT_SOME(storage.recover(path));
+
+    Promise promise;
+    promise.set_id(1);
+    ASSERT_SOME(storage.persist(promise));
+
+    for (uint64_t position = 0; position < 100; position++) {
+      Action action;
+      action.set_position(position);
+      action.set_promised(1);
+      action.set_performed(1);
+      action.set_learned(true);
+      action.set_type(Action::APPEND);
+      action.mutable_append()->set_bytes(std::string(100, 'a'));
+      ASSERT_SOME(storage.persist(action));
+    }
+
+    ASSERT_SOME(storage.sync());
+
+    segments = os::ls(path).size();
+    EXPECT_LT(10u, segments);
+
+    Action action;
+    action.set_position(100);
+    action.set_promised(1);
+    action.set_performed(1);
+    action.set_learned(true);
+    action.set_type(Action::TRUNCATE);
+    action.mutable_truncate()->set_to(90);
+    ASSERT_SOME(storage.persist(action));
+
+    ASSERT_SOME(storage.sync());
+
+    // Only the segments with positions after the truncation remain.
+    EXPECT_GT(segments / 2, os::ls(path).size());
+
+    EXPECT_ERROR(storage.read(10));
+    EXPECT_SOME(storage.read(95));
+  }
+
+  SegmentedStorage storage(1024);
+
+  Try<State> state = storage.recover(path);
+  ASSERT_SOME(state);
+  EXPECT_EQ(1u, state.get().coordinator); // The promise survived.
+  EXPECT_EQ(90u, state.get().begin);
+  EXPECT_EQ(100u, state.get().end);
+  EXPECT_EQ(11u, state.get().learned.size());
+  EXPECT_EQ(0u, state.get().unlearned.size());
+
+  EXPECT_ERROR(storage.read(10));
+  EXPECT_SOME(storage.read(95));
+
+  os::rmdir(path);
+}
+
+
+// Writes 'data' at the specified offset of the file at 'path'.
+static void overwrite(
+    const std::string& path,
+    off_t offset,
+    const std::string& data)
+{
+  int fd = ::open(path.c_str(), O_WRONLY | O_CREAT, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ((ssize_t) data.size(),
+            pwrite(fd, data.data(), data.size(), offset));
+  ::close(fd);
+}
+
+
+// Persists the promise (if any) and actions for the positions in
+// [from, to) using small segments so that they span many segments.
+static void persist(
+    const std::string& path,
+    const Option<uint64_t>& promised,
+    uint64_t from,
+    uint64_t to)
+{
+  SegmentedStorage storage(1024);
+
+  ASSERT_SOME(storage.recover(path));
+
+  if (promised.isSome()) {
+    Promise promise;
+    promise.set_id(promised.get());
+    ASSERT_SOME(storage.persist(promise));
+  }
+
+  for (uint64_t position = from; position < to; position++) {
+    Action action;
+    action.set_position(position);
+    action.set_promised(1);
+    action.set_performed(1);
+    action.set_type(Action::APPEND);
+    action.mutable_append()->set_bytes(std::string(100, 'a'));
+    ASSERT_SOME(storage.persist(action));
+  }
+
+  ASSERT_SOME(storage.sync());
+}
+
+
+TEST(SegmentedStorageTest, TornLastSegment)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  persist(path, Option<uint64_t>::some(1), 0, 30);
+
+  // A segment that was just created when we crashed, with a torn
+  // record (i.e., a record header but not the record).
+  size_t segments = os::ls(path).size();
+  overwrite(path + "/segment-" + stringify(segments), 1023, std::string(1, 0));
+  overwrite(path + "/segment-" + stringify(segments), 0, "torn");
+
+  {
+    SegmentedStorage storage(1024);
+
+    Try<State> state = storage.recover(path);
+    ASSERT_SOME(state);
+    EXPECT_EQ(1u, state.get().coordinator);
+    EXPECT_EQ(29u, state.get().end);
+  }
+
+  // Append after the torn segment, which thus isn't the last segment
+  // anymore when recovering again.
+  persist(path, Option<uint64_t>::none(), 30, 40);
+
+  SegmentedStorage storage(1024);
+
+  Try<State> state = storage.recover(path);
+  ASSERT_SOME(state);
+  EXPECT_EQ(1u, state.get().coordinator);
+  EXPECT_EQ(39u, state.get().end);
+  EXPECT_EQ(40u, state.get().unlearned.size());
+
+  os::rmdir(path);
+}
+
+
+TEST(SegmentedStorageTest, CorruptedSegment)
+{
+  const std::string path = os::getcwd() + "/.log";
+
+  os::rmdir(path);
+
+  persist(path, Option<uint64_t>::some(1), 0, 30);
+
+  ASSERT_LT(1u, os::ls(path).size());
+
+  // Corrupt the promise (i.e., the first record after its 8 byte
+  // header) in the first segment, which has been synced.
+  overwrite(path + "/segment-0", 8, "corrupted");
+
+  SegmentedStorage storage(1024);
+
+  EXPECT_ERROR(storage.recover(path));
+
+  os::rmdir(path);
+}
+
+
 TEST(CoordinatorTest, Elect)
 {
   const std::string path1 = os::getcwd() + "/.log1";
@@ -812,6 +1256,114 @@ TEST(CoordinatorTest, MultipleAppends)
 }
 
 
+TEST(CoordinatorTest, AppendAsync)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+
+  Replica replica1(path1);
+  Replica replica2(path2);
+
+  Network network;
+
+  network.add(replica1.pid());
+  network.add(replica2.pid());
+
+  Coordinator coord(2, &replica1, &network, 4);
+
+  {
+    Result<uint64_t> result = coord.elect(Timeout(Seconds(2.0)));
+    ASSERT_SOME(result);
+    EXPECT_EQ(0u, result.get());
+  }
+
+  std::list<Future<uint64_t> > futures;
+  for (uint64_t position = 1; position <= 10; position++) {
+    futures.push_back(coord.appendAsync(stringify(position), Seconds(2.0)));
+  }
+
+  uint64_t position = 1;
+  foreach (const Future<uint64_t>& future, futures) {
+    ASSERT_TRUE(future.await(Seconds(2.0)));
+    ASSERT_TRUE(future.isReady());
+    EXPECT_EQ(position++, future.get());
+  }
+
+  // A synchronous append goes after the asynchronous ones.
+  {
+    Result<uint64_t> result =
+      coord.append(stringify(11), Timeout(Seconds(2.0)));
+    ASSERT_SOME(result);
+    EXPECT_EQ(11u, result.get());
+  }
+
+  {
+    Future<std::list<Action> > actions = replica1.read(1, 11);
+    ASSERT_TRUE(actions.await(Seconds(2.0)));
+    ASSERT_TRUE(actions.isReady());
+    EXPECT_EQ(11u, actions.get().size());
+    foreach (const Action& action, actions.get()) {
+      ASSERT_TRUE(action.has_type());
+      ASSERT_EQ(Action::APPEND, action.type());
+      EXPECT_EQ(stringify(action.position()), action.append().bytes());
+    }
+  }
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+}
+
+
+TEST(CoordinatorTest, AppendAsyncNoQuorum)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+
+  Replica replica1(path1);
+  Replica replica2(path2);
+
+  Network network;
+
+  network.add(replica1.pid());
+  network.add(replica2.pid());
+
+  Coordinator coord(2, &replica1, &network);
+
+  {
+    Result<uint64_t> result = coord.elect(Timeout(Seconds(2.0)));
+    ASSERT_SOME(result);
+    EXPECT_EQ(0u, result.get());
+  }
+
+  network.remove(replica2.pid());
+
+  Future<uint64_t> future1 = coord.appendAsync("hello", Seconds(0.1));
+  Future<uint64_t> future2 = coord.appendAsync("world", Seconds(2.0));
+
+  ASSERT_TRUE(future1.await(Seconds(2.0)));
+  EXPECT_TRUE(future1.isFailed());
+
+  // The appends after a failed append fail too.
+  ASSERT_TRUE(future2.await(Seconds(2.0)));
+  EXPECT_TRUE(future2.isFailed());
+
+  {
+    Result<uint64_t> result =
+      coord.append("hello world", Timeout(Seconds(2.0)));
+    EXPECT_TRUE(result.isError());
+  }
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+}
+
+
 TEST(CoordinatorTest, MultipleAppendsNotLearnedFill)
 {
   EXPECT_MESSAGE(Eq(LearnedMessage().GetTypeName()), _, _)
@@ -1146,6 +1698,155 @@ TEST(LogTest, WriteRead)
 }
 
 
+TEST(LogTest, AppendAsync)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+  const std::string path3 = os::getcwd() + "/.log3";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+  os::rmdir(path3);
+
+  Replica replica1(path1);
+  Replica replica2(path2);
+
+  std::set<UPID> pids;
+  pids.insert(replica1.pid());
+  pids.insert(replica2.pid());
+
+  Log log(2, path3, pids);
+
+  Log::Writer writer(&log, Seconds(2.0), 3, 8);
+
+  std::list<Future<Log::Position> > positions;
+  for (int i = 0; i < 32; i++) {
+    positions.push_back(writer.appendAsync(stringify(i), Seconds(2.0)));
+  }
+
+  foreach (const Future<Log::Position>& position, positions) {
+    ASSERT_TRUE(position.await(Seconds(2.0)));
+    ASSERT_TRUE(position.isReady());
+  }
+
+  Log::Reader reader(&log);
+
+  Result<std::list<Log::Entry> > entries = reader.read(
+      positions.front().get(),
+      positions.back().get(),
+      Timeout(Seconds(2.0)));
+
+  ASSERT_SOME(entries);
+  ASSERT_EQ(32u, entries.get().size());
+
+  int i = 0;
+  foreach (const Log::Entry& entry, entries.get()) {
+    EXPECT_EQ(stringify(i++), entry.data);
+  }
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+  os::rmdir(path3);
+}
+
+
+TEST(LogTest, Cursor)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+
+  Replica replica1(path1);
+
+  std::set<UPID> pids;
+  pids.insert(replica1.pid());
+
+  Log log(2, path2, pids);
+
+  Log::Writer writer(&log, Seconds(2.0));
+
+  for (int i = 0; i < 10; i++) {
+    ASSERT_SOME(writer.append(stringify(i), Timeout(Seconds(2.0))));
+  }
+
+  Log::Reader reader(&log);
+
+  // Read in batches smaller than the log (which also includes the
+  // no-op from electing the writer).
+  Log::Cursor cursor = reader.cursor(reader.beginning(), 3);
+
+  for (int i = 0; i < 10; i++) {
+    Result<Log::Entry> entry = cursor.next(Timeout(Seconds(2.0)));
+    ASSERT_SOME(entry);
+    EXPECT_EQ(stringify(i), entry.get().data);
+  }
+
+  // Nothing more to read until something gets appended.
+  EXPECT_TRUE(cursor.next(Timeout(Seconds(2.0))).isNone());
+
+  Result<Log::Position> position =
+    writer.append("tail", Timeout(Seconds(2.0)));
+
+  ASSERT_SOME(position);
+
+  EXPECT_EQ(position.get(), cursor.position());
+
+  Result<Log::Entry> entry = cursor.next(Timeout(Seconds(2.0)));
+  ASSERT_SOME(entry);
+  EXPECT_EQ(position.get(), entry.get().position);
+  EXPECT_EQ("tail", entry.get().data);
+
+  // Reading entries that get truncated is an error.
+  cursor = reader.cursor(reader.beginning());
+
+  ASSERT_SOME(writer.truncate(position.get(), Timeout(Seconds(2.0))));
+
+  EXPECT_TRUE(cursor.next(Timeout(Seconds(2.0))).isError());
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+}
+
+
+TEST(LogTest, SegmentedStorage)
+{
+  const std::string path1 = os::getcwd() + "/.log1";
+  const std::string path2 = os::getcwd() + "/.log2";
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+
+  Replica replica1(path1, "segmented");
+
+  std::set<UPID> pids;
+  pids.insert(replica1.pid());
+
+  Log log(2, path2, pids, "segmented");
+
+  Log::Writer writer(&log, Seconds(2.0));
+
+  Result<Log::Position> position =
+    writer.append("hello world", Timeout(Seconds(2.0)));
+
+  ASSERT_SOME(position);
+
+  Log::Reader reader(&log);
+
+  Result<std::list<Log::Entry> > entries =
+    reader.read(position.get(), position.get(), Timeout(Seconds(2.0)));
+
+  ASSERT_SOME(entries);
+  ASSERT_EQ(1u, entries.get().size());
+  EXPECT_EQ(position.get(), entries.get().front().position);
+  EXPECT_EQ("hello world", entries.get().front().data);
+
+  os::rmdir(path1);
+  os::rmdir(path2);
+}
+
+
 TEST(LogTest, Position)
 {
   const std::string path1 = os::getcwd() + "/.log1";
@@ -52,6 +52,7 @@ using mesos::internal::master::FrameworksManager;
 using mesos::internal::master::FrameworksStorage;
 
 using mesos::internal::master::Master;
+using mesos::internal::master::STATE_SNAPSHOT_INTERVAL;
 
 using mesos::internal::slave::Slave;
 
@@ -788,6 +789,84 @@ TEST(MasterTest, MasterInfoOnReElection)
 }
 
 
+TEST(MasterTest, StateEndpoint)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  TestAllocatorProcess a;
+  Files files;
+  Master m(&a, &files);
+  PID<Master> master = process::spawn(&m);
+
+  Future<process::http::Response> response =
+    process::http::get(master, "state.json");
+
+  ASSERT_FUTURE_WILL_SUCCEED(response);
+  EXPECT_NE(string::npos, response.get().body.find("\"connected_slaves\":0"));
+
+  MockExecutor exec;
+
+  map<ExecutorID, Executor*> execs;
+  execs[DEFAULT_EXECUTOR_ID] = &exec;
+
+  TestingIsolationModule isolationModule(execs);
+
+  Resources resources = Resources::parse("cpus:2;mem:1024");
+
+  Slave s(resources, true, &isolationModule, &files);
+  PID<Slave> slave = process::spawn(&s);
+
+  BasicMasterDetector detector(master, slave, true);
+
+  MockScheduler sched;
+  MesosSchedulerDriver driver(&sched, DEFAULT_FRAMEWORK_INFO, master);
+
+  trigger resourceOffersCall;
+
+  EXPECT_CALL(sched, registered(&driver, _, _))
+    .Times(1);
+
+  EXPECT_CALL(sched, resourceOffers(&driver, _))
+    .WillOnce(Trigger(&resourceOffersCall))
+    .WillRepeatedly(Return());
+
+  driver.start();
+
+  WAIT_UNTIL(resourceOffersCall);
+
+  // The counters in stats.json never come from a snapshot, so they
+  // are always current.
+  response = process::http::get(master, "stats.json");
+
+  ASSERT_FUTURE_WILL_SUCCEED(response);
+  EXPECT_NE(string::npos, response.get().body.find("\"active_schedulers\":1"));
+  EXPECT_NE(string::npos, response.get().body.find("\"connected_slaves\":1"));
+
+  // The state has changed since the last request, so once the
+  // snapshot interval has passed it should be taken (and rendered)
+  // again.
+  Clock::pause();
+  Clock::advance(&m, STATE_SNAPSHOT_INTERVAL.secs());
+
+  response = process::http::get(master, "state.json");
+
+  ASSERT_FUTURE_WILL_SUCCEED(response);
+  EXPECT_NE(string::npos, response.get().body.find("\"connected_slaves\":1"));
+  EXPECT_NE(string::npos, response.get().body.find("\"offers\":[{"));
+
+  Clock::resume();
+
+  driver.stop();
+  driver.join();
+
+  process::terminate(slave);
+  process::wait(slave);
+
+  process::terminate(master);
+  process::wait(master);
+}
+
+
 class WhitelistFixture : public ::testing::Test
 {
 protected:
@@ -0,0 +1,101 @@
+/**
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <mesos/mesos.hpp>
+
+#include "common/pool.hpp"
+
+using namespace mesos;
+using namespace mesos::internal;
+
+using std::string;
+
+
+TEST(PoolTest, CreateDestroy)
+{
+  Pool<Offer> pool(4);
+
+  EXPECT_EQ(0u, pool.size());
+  EXPECT_EQ(0u, pool.capacity());
+
+  Offer* offer1 = pool.create();
+  offer1->set_hostname("host1");
+
+  Offer offer;
+  offer.set_hostname("host2");
+
+  Offer* offer2 = pool.create(offer);
+  EXPECT_EQ("host2", offer2->hostname());
+
+  EXPECT_EQ(2u, pool.size());
+  EXPECT_EQ(4u, pool.capacity());
+
+  // Destroyed objects get reused.
+  pool.destroy(offer1);
+
+  EXPECT_EQ(1u, pool.size());
+
+  Offer* offer3 = pool.create();
+  EXPECT_EQ(offer1, offer3);
+  EXPECT_FALSE(offer3->has_hostname());
+
+  pool.destroy(offer2);
+  pool.destroy(offer3);
+
+  EXPECT_EQ(0u, pool.size());
+  EXPECT_EQ(4u, pool.capacity());
+}
+
+
+struct Constructed
+{
+  Constructed(const string& _a, int _b, double _c, bool _d)
+    : a(_a), b(_b), c(_c), d(_d) {}
+
+  string a;
+  int b;
+  double c;
+  bool d;
+};
+
+
+TEST(PoolTest, Slabs)
+{
+  Pool<Constructed> pool(2);
+
+  Constructed* objects[5];
+  for (int i = 0; i < 5; i++) {
+    objects[i] = pool.create(string("object"), i, 1.5, true);
+  }
+
+  EXPECT_EQ(5u, pool.size());
+  EXPECT_EQ(6u, pool.capacity());
+
+  for (int i = 0; i < 5; i++) {
+    EXPECT_EQ("object", objects[i]->a);
+    EXPECT_EQ(i, objects[i]->b);
+    pool.destroy(objects[i]);
+  }
+
+  EXPECT_EQ(0u, pool.size());
+  EXPECT_EQ(6u, pool.capacity());
+}
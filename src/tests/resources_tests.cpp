@@ -21,6 +21,8 @@
 
 #include <gtest/gtest.h>
 
+#include "common/resource_vector.hpp"
+
 #include "master/master.hpp"
 
 using namespace mesos;
@@ -542,3 +544,83 @@ TEST(ResourcesTest, EmptyUnequal)
 
   EXPECT_FALSE(empty == cpus2);
 }
+
+
+TEST(ResourceVectorTest, Scalars)
+{
+  ResourceVector resources = Resources::parse("cpus:45.55;mem:1024");
+
+  EXPECT_EQ(45.55, resources.scalar("cpus"));
+  EXPECT_EQ(1024, resources.scalar("mem"));
+  EXPECT_EQ(0, resources.scalar("disk"));
+
+  resources -= Resources::parse("cpus:0.55;mem:2048");
+
+  EXPECT_EQ(45, resources.scalar("cpus"));
+  EXPECT_EQ(-1024, resources.scalar("mem"));
+
+  EXPECT_EQ(Resources::parse("cpus:45"), resources.allocatable().resources());
+
+  resources += Resources::parse("mem:1024");
+
+  EXPECT_EQ(Resources::parse("cpus:45"), resources.resources());
+  EXPECT_TRUE(resources == Resources::parse("cpus:45"));
+
+  resources -= Resources::parse("cpus:45");
+
+  EXPECT_TRUE(resources.empty());
+  EXPECT_TRUE(resources == ResourceVector());
+}
+
+
+TEST(ResourceVectorTest, Ranges)
+{
+  ResourceVector resources =
+    Resources::parse("ports:[20-30, 1-10, 5-15];cpus:1");
+
+  EXPECT_TRUE(resources == Resources::parse("ports:[1-15, 20-30];cpus:1"));
+
+  resources -= Resources::parse("ports:[3-4, 10-22, 30-30]");
+
+  EXPECT_EQ(Resources::parse("ports:[1-2, 5-9, 23-29];cpus:1"),
+            resources.resources());
+
+  EXPECT_TRUE(ResourceVector(Resources::parse("ports:[5-7]")) <= resources);
+  EXPECT_FALSE(ResourceVector(Resources::parse("ports:[5-10]")) <= resources);
+
+  resources += Resources::parse("ports:[3-4, 10-22]");
+
+  EXPECT_EQ(Resources::parse("ports:[1-29];cpus:1"), resources.resources());
+}
+
+
+TEST(ResourceVectorTest, Sets)
+{
+  ResourceVector resources = Resources::parse("disks:{sda1, sda2}");
+
+  resources += Resources::parse("disks:{sda2, sda3}");
+
+  EXPECT_EQ(Resources::parse("disks:{sda1, sda2, sda3}"),
+            resources.resources());
+
+  resources -= Resources::parse("disks:{sda1}");
+
+  EXPECT_EQ(Resources::parse("disks:{sda2, sda3}"), resources.resources());
+
+  EXPECT_TRUE(ResourceVector(Resources::parse("disks:{sda3}")) <= resources);
+  EXPECT_FALSE(ResourceVector(Resources::parse("disks:{sda1}")) <= resources);
+}
+
+
+TEST(ResourceVectorTest, Comparison)
+{
+  ResourceVector small = Resources::parse("cpus:1;mem:512");
+  ResourceVector large = Resources::parse("cpus:2;mem:1024;ports:[1-10]");
+
+  EXPECT_TRUE(small <= large);
+  EXPECT_FALSE(large <= small);
+  EXPECT_FALSE(small == large);
+
+  EXPECT_TRUE(large - small == Resources::parse("cpus:1;mem:512;ports:[1-10]"));
+  EXPECT_TRUE(small + small == Resources::parse("cpus:2;mem:1024"));
+}
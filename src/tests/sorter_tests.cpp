@@ -124,3 +124,54 @@ TEST(SorterTest, DRFSorter)
 
   checkSorter(sorter, 5, "e", "b", "d", "c", "f");
 }
+
+
+TEST(SorterTest, DRFSorterIterator)
+{
+  DRFSorter sorter;
+
+  sorter.add(Resources::parse("cpus:10;mem:100"));
+
+  sorter.add("a");
+  sorter.allocated("a", Resources::parse("cpus:2;mem:10"));
+
+  sorter.add("b");
+  sorter.allocated("b", Resources::parse("cpus:1;mem:50"));
+
+  sorter.add("c");
+
+  // shares: a = .2, b = .5, c = 0
+  checkSorter(sorter, 3, "c", "a", "b");
+
+  // The iterator visits clients in the same order as sort.
+  list<string> ordering;
+  for (DRFSorter::const_iterator it = sorter.begin();
+       it != sorter.end();
+       ++it) {
+    ordering.push_back(*it);
+  }
+
+  EXPECT_EQ(sorter.sort(), ordering);
+
+  // Shares get updated incrementally (without any change to the
+  // total resources) ...
+  sorter.unallocated("b", Resources::parse("cpus:1;mem:45"));
+  sorter.allocated("c", Resources::parse("mem:30"));
+
+  // shares: a = .2, b = .05, c = .3
+  checkSorter(sorter, 3, "b", "a", "c");
+
+  // ... including for deactivated clients.
+  sorter.deactivate("a");
+  sorter.allocated("a", Resources::parse("cpus:2"));
+
+  checkSorter(sorter, 2, "b", "c");
+
+  sorter.activate("a");
+
+  // shares: a = .4, b = .05, c = .3
+  checkSorter(sorter, 3, "b", "c", "a");
+
+  EXPECT_EQ(Resources::parse("cpus:4;mem:10"),
+            sorter.allocation("a").resources());
+}
@@ -31,7 +31,7 @@ Timer delay(const Duration& duration,
                          thunk)));
 
   std::tr1::function<void(void)> dispatch =
-    std::tr1::bind(internal::dispatch, pid, dispatcher);
+    std::tr1::bind(internal::dispatch, pid, dispatcher, &typeid(method));
 
   return Timer::create(duration, dispatch);
 }
@@ -72,7 +72,7 @@ Timer delay(const Duration& duration,
                          thunk)));
 
   std::tr1::function<void(void)> dispatch =
-    std::tr1::bind(internal::dispatch, pid, dispatcher);
+    std::tr1::bind(internal::dispatch, pid, dispatcher, &typeid(method));
 
   return Timer::create(duration, dispatch);
 }
@@ -117,7 +117,7 @@ Timer delay(const Duration& duration,
                          thunk)));
 
   std::tr1::function<void(void)> dispatch =
-    std::tr1::bind(internal::dispatch, pid, dispatcher);
+    std::tr1::bind(internal::dispatch, pid, dispatcher, &typeid(method));
 
   return Timer::create(duration, dispatch);
 }
@@ -166,7 +166,7 @@ Timer delay(const Duration& duration,
                          thunk)));
 
   std::tr1::function<void(void)> dispatch =
-    std::tr1::bind(internal::dispatch, pid, dispatcher);
+    std::tr1::bind(internal::dispatch, pid, dispatcher, &typeid(method));
 
   return Timer::create(duration, dispatch);
 }
@@ -1,6 +1,8 @@
 #ifndef __PROCESS_DISPATCH_HPP__
 #define __PROCESS_DISPATCH_HPP__
 
+#include <typeinfo>
+
 #include <tr1/functional>
 #include <tr1/memory> // TODO(benh): Replace all shared_ptr with unique_ptr.
 
@@ -46,9 +48,12 @@ namespace internal {
 // function gets applied/invoked with the process as its first
 // argument. Currently we wrap the function in a shared_ptr but this
 // will probably change in the future to unique_ptr (or a variant).
+// The optional type of the dispatched method (third argument) is only
+// used for instrumentation.
 void dispatch(
     const UPID& pid,
-    const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& f);
+    const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& f,
+    const std::type_info* functionType = NULL);
 
 // For each return type (void, future, value) there is a dispatcher
 // function which should complete the picture. Given the process
@@ -124,7 +129,7 @@ void rdispatcher(
 //                          std::tr1::placeholders::_1,
 //                          thunk)));
 //
-//   internal::dispatch(pid, dispatcher);
+//   internal::dispatch(pid, dispatcher, &typeid(method));
 // }
 
 template <typename T>
@@ -142,7 +147,7 @@ void dispatch(
                          std::tr1::placeholders::_1,
                          thunk)));
 
-  internal::dispatch(pid, dispatcher);
+  internal::dispatch(pid, dispatcher, &typeid(method));
 }
 
 template <typename T>
@@ -182,7 +187,7 @@ void dispatch(
                            std::tr1::placeholders::_1,                  \
                            thunk)));                                    \
                                                                         \
-    internal::dispatch(pid, dispatcher);                                \
+    internal::dispatch(pid, dispatcher, &typeid(method));               \
   }                                                                     \
                                                                         \
   template <typename T,                                                 \
@@ -234,7 +239,7 @@ void dispatch(
 //                          std::tr1::placeholders::_1,
 //                          thunk, promise)));
 //
-//   internal::dispatch(pid, dispatcher);
+//   internal::dispatch(pid, dispatcher, &typeid(method));
 //
 //   return future;
 // }
@@ -257,7 +262,7 @@ Future<R> dispatch(
                          std::tr1::placeholders::_1,
                          thunk, promise)));
 
-  internal::dispatch(pid, dispatcher);
+  internal::dispatch(pid, dispatcher, &typeid(method));
 
   return future;
 }
@@ -303,7 +308,7 @@ Future<R> dispatch(
                            std::tr1::placeholders::_1,                  \
                            thunk, promise)));                           \
                                                                         \
-    internal::dispatch(pid, dispatcher);                                \
+    internal::dispatch(pid, dispatcher, &typeid(method));               \
                                                                         \
     return future;                                                      \
   }                                                                     \
@@ -359,7 +364,7 @@ Future<R> dispatch(
 //                          std::tr1::placeholders::_1,
 //                          thunk, promise)));
 //
-//   internal::dispatch(pid, dispatcher);
+//   internal::dispatch(pid, dispatcher, &typeid(method));
 //
 //   return future;
 // }
@@ -382,7 +387,7 @@ Future<R> dispatch(
                          std::tr1::placeholders::_1,
                          thunk, promise)));
 
-  internal::dispatch(pid, dispatcher);
+  internal::dispatch(pid, dispatcher, &typeid(method));
 
   return future;
 }
@@ -428,7 +433,7 @@ Future<R> dispatch(
                            std::tr1::placeholders::_1,                  \
                            thunk, promise)));                           \
                                                                         \
-    internal::dispatch(pid, dispatcher);                                \
+    internal::dispatch(pid, dispatcher, &typeid(method));               \
                                                                         \
     return future;                                                      \
   }                                                                     \
@@ -1,6 +1,10 @@
 #ifndef __PROCESS_EVENT_HPP__
 #define __PROCESS_EVENT_HPP__
 
+#include <stdint.h>
+
+#include <typeinfo>
+
 #include <tr1/functional>
 #include <tr1/memory> // TODO(benh): Replace all shared_ptr with unique_ptr.
 
@@ -33,6 +37,8 @@ struct EventVisitor
 
 struct Event
 {
+  Event() : next(NULL), enqueued(0) {}
+
   virtual ~Event() {}
 
   virtual void visit(EventVisitor* visitor) const = 0;
@@ -68,6 +74,15 @@ struct Event
     }
     return *result;
   }
+
+  // Intrusive link used when the event is queued for a process (see
+  // EventQueue in src/event_queue.hpp).
+  Event* next;
+
+  // Monotonic time (in nanoseconds) the event was enqueued at if it
+  // was sampled for instrumentation, otherwise 0 (see
+  // src/process_metrics.hpp).
+  uint64_t enqueued;
 };
 
 
@@ -123,8 +138,9 @@ private:
 struct DispatchEvent : Event
 {
   DispatchEvent(
-      const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& _f)
-    : f(_f) {}
+      const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& _f,
+      const std::type_info* _functionType = NULL)
+    : f(_f), functionType(_functionType) {}
 
   virtual void visit(EventVisitor* visitor) const
   {
@@ -133,6 +149,10 @@ struct DispatchEvent : Event
 
   const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> > f;
 
+  // Type of the method being dispatched (if known), used to tell
+  // dispatches apart when instrumenting them.
+  const std::type_info* functionType;
+
 private:
   // Not copyable, not assignable.
   DispatchEvent(const DispatchEvent&);
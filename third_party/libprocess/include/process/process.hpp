@@ -22,6 +22,12 @@
 
 namespace process {
 
+// Forward declarations (see src/event_queue.hpp and
+// src/process_metrics.hpp).
+class EventQueue;
+class ProcessMetrics;
+
+
 class ProcessBase : public EventVisitor
 {
 public:
@@ -184,16 +190,15 @@ private:
          BLOCKED,
 	 FINISHED } state;
 
-  // Mutex protecting internals. TODO(benh): Replace with a spinlock.
-  pthread_mutex_t m;
-  void lock() { pthread_mutex_lock(&m); }
-  void unlock() { pthread_mutex_unlock(&m); }
-
   // Enqueue the specified message, request, or function call.
   void enqueue(Event* event, bool inject = false);
 
-  // Queue of received events.
-  std::deque<Event*> events;
+  // Lock-free queue of received events. Any thread may enqueue an
+  // event but only the thread running the process may dequeue one.
+  EventQueue* events;
+
+  // Instrumentation of the events served by this process.
+  ProcessMetrics* metrics;
 
   // Delegates for messages.
   std::map<std::string, UPID> delegates;
@@ -217,6 +222,10 @@ private:
   // Active references.
   int refs;
 
+  // Index of the processing thread (and it's run queue) this process
+  // last ran on, or -1 if it has never been run.
+  int affinity;
+
   // Process PID.
   UPID pid;
 };
@@ -261,6 +270,19 @@ uint32_t ip();
 uint16_t port();
 
 
+/**
+ * Instruments the events served by the processes spawned from now on
+ * (see /statistics/snapshot.json), sampling one out of every
+ * 'period' events. A period of 0 disables the instrumentation. The
+ * default is one out of every 64 events unless
+ * LIBPROCESS_EVENT_SAMPLING is set.
+ *
+ * @param period number of events per sampled event
+ * @return the previous period
+ */
+uint32_t sample(uint32_t period);
+
+
 /**
  * Spawn a new process.
  *
@@ -1,6 +1,10 @@
 #ifndef __PROCESS_STATISTICS_HPP__
 #define __PROCESS_STATISTICS_HPP__
 
+#include <stdint.h>
+
+#include <string>
+
 #include <process/future.hpp>
 
 #include <stout/duration.hpp>
@@ -41,6 +45,113 @@ private:
   StatisticsProcess* process;
 };
 
+
+// Global statistics (created by process::initialize), which can be
+// retrieved via /statistics/snapshot.json and /statistics/series.json.
+extern Statistics* statistics;
+
+
+// Counters and histograms are meant for recording things on a hot
+// path (e.g., per message or per operation) where dispatching to the
+// statistics process for each value would be too expensive (and
+// would perturb what's being measured). Recording a value never
+// locks or dispatches: each thread updates its own (cache line
+// aligned) shard, and the shards only get aggregated when read,
+// i.e., when /statistics/snapshot.json is requested. A counter or
+// histogram shows up in the snapshot for as long as it exists, and
+// counters and histograms with the same name (e.g., one per instance
+// of some process) get aggregated together. Note that unlike the
+// values set via Statistics there is no time series of them (i.e.,
+// they can not be retrieved via /statistics/series.json).
+class Counter
+{
+public:
+  explicit Counter(const std::string& name);
+  ~Counter();
+
+  // Safe to call from any thread.
+  void increment(int64_t amount = 1);
+  void decrement(int64_t amount = 1) { increment(-amount); }
+
+  // Returns the sum of all the shards.
+  int64_t value() const;
+
+  const std::string name;
+
+private:
+  // Not copyable, not assignable.
+  Counter(const Counter&);
+  Counter& operator = (const Counter&);
+
+  struct Shard
+  {
+    volatile int64_t value;
+  } __attribute__((aligned(64)));
+
+  // Allocated separately (see 'allocate' in statistics.cpp) so that
+  // the shards are actually aligned even when a counter (or an
+  // object containing one) is allocated with 'new', which doesn't
+  // honor the alignment.
+  Shard* shards;
+};
+
+
+// A histogram of durations (e.g., the latency of an operation) in the
+// style of an HDR histogram: durations are recorded in nanoseconds
+// in logarithmic buckets (one per power of two), each of which is
+// split into 16 linear sub-buckets, so every recorded duration is
+// accurate to within 1/16th (i.e., 6.25%) while the whole range of
+// durations only needs a fixed number of buckets. The snapshot
+// includes the count, mean, 50th, 90th, 99th and 99.9th percentiles
+// and maximum (in milliseconds) as '<name>/count', '<name>/p50',
+// etc.
+class Histogram
+{
+public:
+  explicit Histogram(const std::string& name);
+  ~Histogram();
+
+  // Safe to call from any thread.
+  void record(const Duration& duration);
+
+  // Aggregates of all the shards.
+  uint64_t count() const;
+  Duration mean() const;
+  Duration max() const;
+
+  // Returns (an upper bound on) the specified percentile, e.g., 0.99,
+  // of the recorded durations (but never more than the maximum).
+  Duration percentile(double p) const;
+
+  const std::string name;
+
+  // Number of (sub-)buckets needed to cover every 64 bit value.
+  static const int BUCKETS = 61 * 16;
+
+private:
+  friend class StatisticsProcess;
+
+  // Not copyable, not assignable.
+  Histogram(const Histogram&);
+  Histogram& operator = (const Histogram&);
+
+  // Adds the buckets of every shard to 'buckets' (of size BUCKETS)
+  // and updates 'sum' and 'max'.
+  void aggregate(uint64_t* buckets, uint64_t* sum, uint64_t* max) const;
+
+  struct Shard
+  {
+    volatile uint64_t buckets[BUCKETS];
+    volatile uint64_t sum;
+    volatile uint64_t max;
+  } __attribute__((aligned(64)));
+
+  // Unlike counters, histograms are updated less frequently (but
+  // are much bigger), so we use fewer shards. Allocated separately
+  // just like the shards of a counter.
+  Shard* shards;
+};
+
 } // namespace process {
 
 #endif // __PROCESS_STATISTICS_HPP__
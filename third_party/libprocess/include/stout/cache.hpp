@@ -32,7 +32,7 @@ public:
   typedef std::tr1::unordered_map<
     Key, std::pair<Value, typename list::iterator> > map;
 
-  explicit cache(int _capacity) : capacity(_capacity) {}
+  explicit cache(size_t _capacity) : capacity(_capacity) {}
 
   void put(const Key& key, const Value& value)
   {
@@ -57,6 +57,16 @@ public:
     return Option<Value>::none();
   }
 
+  void erase(const Key& key)
+  {
+    typename map::iterator i = values.find(key);
+
+    if (i != values.end()) {
+      keys.erase((*i).second.second);
+      values.erase(i);
+    }
+  }
+
 private:
   // Not copyable, not assignable.
   cache(const cache&);
@@ -101,7 +111,7 @@ private:
   }
 
   // Size of the cache.
-  int capacity;
+  size_t capacity;
 
   // Cache of values and "pointers" into the least-recently used list.
   map values;
@@ -0,0 +1,484 @@
+#include <gmock/gmock.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <sys/wait.h>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <process/clock.hpp>
+#include <process/dispatch.hpp>
+#include <process/future.hpp>
+#include <process/process.hpp>
+#include <process/timer.hpp>
+
+#include <stout/duration.hpp>
+#include <stout/foreach.hpp>
+#include <stout/nothing.hpp>
+#include <stout/os.hpp>
+#include <stout/stopwatch.hpp>
+#include <stout/stringify.hpp>
+
+using namespace process;
+
+using std::string;
+using std::vector;
+
+// These benchmarks are not run as part of 'make check', but rather
+// are intended to be run by hand (e.g., './benchmarks') when
+// evaluating changes to libprocess internals. Because libprocess can
+// only be initialized once per (operating system) process, any
+// benchmark that needs to vary how libprocess is initialized (e.g.,
+// the number of processing threads) runs each configuration in a
+// forked child and reports the result back over a pipe. This means
+// the parent must never initialize libprocess itself!
+
+
+// Runs the specified function in a forked child with the specified
+// environment variable set (unless the variable is empty) and returns
+// the (double) result the child wrote, or -1 if the child failed.
+static double forked(
+    const std::string& variable,
+    const std::string& value,
+    double (*f)())
+{
+  int pipes[2];
+  if (pipe(pipes) < 0) {
+    return -1;
+  }
+
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    os::close(pipes[0]);
+    os::close(pipes[1]);
+    return -1;
+  } else if (pid == 0) {
+    os::close(pipes[0]);
+    if (!variable.empty()) {
+      setenv(variable.c_str(), value.c_str(), 1);
+    }
+    double result = f();
+    ssize_t length = write(pipes[1], &result, sizeof(result));
+    _exit(length == sizeof(result) ? 0 : 1);
+  }
+
+  os::close(pipes[1]);
+
+  double result = -1;
+  if (read(pipes[0], &result, sizeof(result)) != sizeof(result)) {
+    result = -1;
+  }
+
+  os::close(pipes[0]);
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+  return result;
+}
+
+
+static double forked(double (*f)())
+{
+  return forked("", "", f);
+}
+
+
+// Bounces a fixed number of dispatches back and forth with a peer.
+class PingPongProcess : public Process<PingPongProcess>
+{
+public:
+  PingPongProcess(int _remaining) : remaining(_remaining) {}
+
+  void ping()
+  {
+    if (--remaining > 0) {
+      dispatch(peer, &PingPongProcess::ping);
+    } else {
+      promise.set(Nothing());
+    }
+  }
+
+  PID<PingPongProcess> peer;
+  Promise<Nothing> promise;
+
+private:
+  int remaining;
+};
+
+
+static const int PAIRS = 256;
+static const int DISPATCHES = 10000; // Per pair.
+
+
+// Returns the number of dispatches per second when many pairs of
+// processes concurrently ping pong dispatches with one another.
+static double dispatches()
+{
+  vector<PingPongProcess*> processes;
+
+  for (int i = 0; i < PAIRS; i++) {
+    PingPongProcess* ping = new PingPongProcess(DISPATCHES / 2);
+    PingPongProcess* pong = new PingPongProcess(DISPATCHES / 2);
+
+    ping->peer = pong->self();
+    pong->peer = ping->self();
+
+    processes.push_back(ping);
+    processes.push_back(pong);
+  }
+
+  foreach (PingPongProcess* process, processes) {
+    spawn(process);
+  }
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  for (size_t i = 0; i < processes.size(); i += 2) {
+    dispatch(processes[i], &PingPongProcess::ping);
+  }
+
+  // Only the process that started the ping pong completes (it'll
+  // always receive the last dispatch).
+  for (size_t i = 0; i < processes.size(); i += 2) {
+    processes[i]->promise.future().await();
+  }
+
+  stopwatch.stop();
+
+  foreach (PingPongProcess* process, processes) {
+    terminate(process);
+    wait(process);
+    delete process;
+  }
+
+  return (PAIRS * (double) DISPATCHES) / stopwatch.elapsed().secs();
+}
+
+
+TEST(Benchmark, DispatchThroughput)
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  std::cout << "Dispatch throughput (" << PAIRS << " pairs of processes, "
+            << DISPATCHES << " dispatches per pair):" << std::endl;
+
+  double single = -1;
+
+  for (long threads = 1; threads <= std::max(4L, cpus); threads *= 2) {
+    double throughput = forked(
+        "LIBPROCESS_NUM_WORKER_THREADS",
+        stringify(threads),
+        dispatches);
+
+    ASSERT_GT(throughput, 0) << "Benchmark failed with " << threads
+                             << " processing threads";
+
+    if (single < 0) {
+      single = throughput;
+    }
+
+    std::cout << "  " << std::setw(4) << threads << " threads: "
+              << std::fixed << std::setprecision(0) << throughput
+              << " dispatches/sec ("
+              << std::setprecision(2) << throughput / single
+              << "x)" << std::endl;
+  }
+}
+
+
+static const int TIMERS = 1000000;
+
+
+// Number of timers that have fired (see 'fired').
+static int count = 0;
+
+
+static void fired()
+{
+  __sync_fetch_and_add(&count, 1);
+}
+
+
+// Creates TIMERS timers with timeouts spread across the next hour.
+static vector<Timer> create()
+{
+  vector<Timer> timers;
+  timers.reserve(TIMERS);
+
+  for (int i = 0; i < TIMERS; i++) {
+    timers.push_back(Timer::create(Seconds((i * 7919) % 3600), &fired));
+  }
+
+  return timers;
+}
+
+
+// Returns the number of timers created per second.
+static double creates()
+{
+  initialize();
+
+  Clock::pause(); // So no timer fires while we're creating them.
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  create();
+
+  stopwatch.stop();
+
+  return TIMERS / stopwatch.elapsed().secs();
+}
+
+
+// Returns the number of timers canceled per second (with TIMERS
+// timers outstanding at the start).
+static double cancels()
+{
+  initialize();
+
+  Clock::pause();
+
+  const vector<Timer>& timers = create();
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  foreach (const Timer& timer, timers) {
+    Timer::cancel(timer);
+  }
+
+  stopwatch.stop();
+
+  return TIMERS / stopwatch.elapsed().secs();
+}
+
+
+// Returns the number of timers that fire per second when advancing
+// the clock past all TIMERS outstanding timers at once.
+static double fires()
+{
+  initialize();
+
+  Clock::pause();
+
+  create();
+
+  Stopwatch stopwatch;
+  stopwatch.start();
+
+  Clock::advance(3600);
+
+  while (__sync_fetch_and_add(&count, 0) < TIMERS) {
+    usleep(1000);
+  }
+
+  stopwatch.stop();
+
+  return TIMERS / stopwatch.elapsed().secs();
+}
+
+
+TEST(Benchmark, Timers)
+{
+  std::cout << "Timers (" << TIMERS << " outstanding timers):" << std::endl;
+
+  const char* names[] = { "create", "cancel", "fire" };
+  double (*functions[])() = { creates, cancels, fires };
+
+  for (int i = 0; i < 3; i++) {
+    double rate = forked(functions[i]);
+
+    ASSERT_GT(rate, 0) << "Benchmark failed to " << names[i] << " timers";
+
+    std::cout << "  " << std::setw(6) << names[i] << ": "
+              << std::fixed << std::setprecision(0) << rate
+              << " timers/sec" << std::endl;
+  }
+}
+
+
+static const int MESSAGES = 100000;
+static const size_t MESSAGE_SIZE = 128; // Bytes per message body.
+
+
+// Counts the messages it receives and replies to the sender once it
+// has received all of them.
+class ReceiverProcess : public Process<ReceiverProcess>
+{
+public:
+  ReceiverProcess() : ProcessBase("receiver"), received(0) {}
+
+  virtual void initialize()
+  {
+    install("hello", &ReceiverProcess::hello);
+    install("ping", &ReceiverProcess::ping);
+  }
+
+  void hello(const UPID& from, const string& body)
+  {
+    send(from, "hello");
+  }
+
+  void ping(const UPID& from, const string& body)
+  {
+    if (++received == MESSAGES) {
+      send(from, "pong");
+    }
+  }
+
+private:
+  int received;
+};
+
+
+class SenderProcess : public Process<SenderProcess>
+{
+public:
+  SenderProcess(const UPID& _receiver) : receiver(_receiver) {}
+
+  virtual void initialize()
+  {
+    install("hello", &SenderProcess::hello);
+    install("pong", &SenderProcess::pong);
+
+    // Say hello first so that both sides get a chance to learn
+    // whether or not they can send each other framed messages.
+    send(receiver, "hello");
+  }
+
+  void hello(const UPID& from, const string& body)
+  {
+    ready.set(Nothing());
+  }
+
+  void start()
+  {
+    const string body(MESSAGE_SIZE, '.');
+    for (int i = 0; i < MESSAGES; i++) {
+      send(receiver, "ping", body.data(), body.size());
+    }
+  }
+
+  void pong(const UPID& from, const string& body)
+  {
+    done.set(Nothing());
+  }
+
+  Promise<Nothing> ready;
+  Promise<Nothing> done;
+
+private:
+  const UPID receiver;
+};
+
+
+// Returns the number of messages per second one process can send
+// another process in a different (operating system) process.
+static double messages()
+{
+  int pipes[2];
+  if (pipe(pipes) < 0) {
+    return -1;
+  }
+
+  // Fork the receiver before we initialize libprocess.
+  pid_t pid = fork();
+
+  if (pid < 0) {
+    os::close(pipes[0]);
+    os::close(pipes[1]);
+    return -1;
+  } else if (pid == 0) {
+    os::close(pipes[0]);
+
+    const string& receiver = stringify(spawn(new ReceiverProcess(), true));
+
+    // Tell the sender where to send messages and wait to get killed.
+    if (write(pipes[1], receiver.data(), receiver.size()) < 0) {
+      _exit(1);
+    }
+
+    os::close(pipes[1]);
+
+    while (true) {
+      pause();
+    }
+  }
+
+  os::close(pipes[1]);
+
+  char buffer[256];
+  ssize_t length = read(pipes[0], buffer, sizeof(buffer));
+
+  os::close(pipes[0]);
+
+  double result = -1;
+
+  if (length > 0) {
+    SenderProcess sender(UPID(string(buffer, length)));
+    spawn(sender);
+
+    sender.ready.future().await();
+
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    dispatch(sender, &SenderProcess::start);
+
+    sender.done.future().await();
+
+    stopwatch.stop();
+
+    terminate(sender);
+    wait(sender);
+
+    result = MESSAGES / stopwatch.elapsed().secs();
+  }
+
+  kill(pid, SIGKILL);
+
+  int status;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+  return result;
+}
+
+
+TEST(Benchmark, MessageThroughput)
+{
+  std::cout << "Message throughput (" << MESSAGES << " messages with "
+            << MESSAGE_SIZE << " byte bodies):" << std::endl;
+
+  double http = forked("LIBPROCESS_DISABLE_FRAMING", "1", messages);
+
+  ASSERT_GT(http, 0) << "Benchmark failed with HTTP messages";
+
+  double framed = forked(messages);
+
+  ASSERT_GT(framed, 0) << "Benchmark failed with framed messages";
+
+  std::cout << "    HTTP: " << std::fixed << std::setprecision(0) << http
+            << " messages/sec" << std::endl
+            << "  framed: " << std::fixed << std::setprecision(0) << framed
+            << " messages/sec (" << std::setprecision(2) << framed / http
+            << "x)" << std::endl;
+}
+
+
+int main(int argc, char** argv)
+{
+  // Initialize Google Mock/Test.
+  testing::InitGoogleMock(&argc, argv);
+
+  return RUN_ALL_TESTS();
+}
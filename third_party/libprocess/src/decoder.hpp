@@ -2,18 +2,24 @@
 #define __DECODER_HPP__
 
 #include <http_parser.h>
+#include <stdint.h>
+
+#include <arpa/inet.h>
 
 #include <deque>
 #include <string>
 #include <vector>
 
 #include <process/http.hpp>
+#include <process/message.hpp>
 #include <process/socket.hpp>
 
 #include <stout/foreach.hpp>
 #include <stout/gzip.hpp>
 #include <stout/try.hpp>
 
+#include "encoder.hpp"
+
 
 // TODO(bmahler): Upgrade our http_parser to the latest version.
 namespace process {
@@ -23,7 +29,12 @@ class DataDecoder
 {
 public:
   DataDecoder(const Socket& _s)
-    : s(_s), failure(false), request(NULL)
+    : s(_s),
+      failure(false),
+      upgrading(false),
+      upgraded(false),
+      skipping(false),
+      request(NULL)
   {
     settings.on_message_begin = &DataDecoder::on_message_begin;
     settings.on_header_field = &DataDecoder::on_header_field;
@@ -41,12 +52,40 @@ public:
     parser.data = this;
   }
 
+  ~DataDecoder()
+  {
+    foreach (Message* message, messages) {
+      delete message;
+    }
+  }
+
+  // Decodes as much of the data as possible into HTTP requests. Once
+  // the connection has been upgraded (see MessageEncoder::upgrade)
+  // all subsequent data gets decoded into framed messages instead,
+  // which are returned by 'decoded'. Note that the upgrade request
+  // itself gets returned like any other HTTP request.
   std::deque<http::Request*> decode(const char* data, size_t length)
   {
-    size_t parsed = http_parser_execute(&parser, &settings, data, length);
+    if (failure) {
+      return std::deque<http::Request*>();
+    }
 
-    if (parsed != length) {
-      failure = true;
+    if (upgraded) {
+      unframe(data, length);
+    } else {
+      size_t parsed = http_parser_execute(&parser, &settings, data, length);
+
+      if (upgrading) {
+        // Our version of http_parser doesn't include the final LF of
+        // the upgrade request in the number of bytes parsed. Since
+        // the LF might not have been received yet we skip it in
+        // 'unframe' (possibly during a later call).
+        upgraded = true;
+        skipping = true;
+        unframe(data + parsed, length - parsed);
+      } else if (parsed != length) {
+        failure = true;
+      }
     }
 
     if (!requests.empty()) {
@@ -58,6 +97,14 @@ public:
     return std::deque<http::Request*>();
   }
 
+  // Returns the framed messages decoded so far (see 'decode').
+  std::deque<Message*> decoded()
+  {
+    std::deque<Message*> result;
+    std::swap(result, messages);
+    return result;
+  }
+
   bool failed() const
   {
     return failure;
@@ -69,6 +116,69 @@ public:
   }
 
 private:
+  // Decodes as many complete framed messages as possible, buffering
+  // any partial message until more data arrives.
+  void unframe(const char* data, size_t length)
+  {
+    if (skipping && length > 0) {
+      if (data[0] == '\n') {
+        data++;
+        length--;
+      }
+      skipping = false;
+    }
+
+    buffer.append(data, length);
+
+    size_t index = 0;
+
+    while (buffer.size() - index >= MessageEncoder::FRAME_HEADER_SIZE) {
+      uint32_t header[6];
+      memcpy(header, buffer.data() + index, MessageEncoder::FRAME_HEADER_SIZE);
+
+      const size_t name = ntohl(header[0]);
+      const size_t from = ntohl(header[1]);
+      const size_t to = ntohl(header[4]);
+      const size_t body = ntohl(header[5]);
+
+      // Compute the size in 64 bits so that it can't overflow.
+      const uint64_t size = (uint64_t) MessageEncoder::FRAME_HEADER_SIZE
+        + name + from + to + body;
+
+      // Don't buffer (possibly forever) for a bogus header (e.g.,
+      // from a peer that isn't actually sending frames), just give up
+      // on the socket.
+      if (size > MAX_FRAME_SIZE) {
+        failure = true;
+        break;
+      }
+
+      if (buffer.size() - index < size) {
+        break; // Wait for the rest of the message.
+      }
+
+      const char* field = buffer.data() + index
+        + MessageEncoder::FRAME_HEADER_SIZE;
+
+      Message* message = new Message();
+      message->name.assign(field, name);
+      field += name;
+      message->from.id.assign(field, from);
+      message->from.ip = header[2];
+      message->from.port = ntohl(header[3]);
+      field += from;
+      message->to.id.assign(field, to);
+      field += to;
+      message->body.assign(field, body);
+
+      messages.push_back(message);
+
+      index += size;
+    }
+
+    buffer.erase(0, index);
+  }
+
   static int on_message_begin(http_parser* p)
   {
     DataDecoder* decoder = (DataDecoder*) p->data;
@@ -104,6 +214,15 @@ private:
 
     decoder->request->method = http_method_str((http_method) decoder->parser.method);
     decoder->request->keepAlive = http_should_keep_alive(&decoder->parser);
+
+    // Check if we're being asked to switch to framed messages (the
+    // parser stops once it's done with the upgrade request).
+    if (decoder->parser.upgrade &&
+        decoder->request->headers.get("Upgrade") ==
+        Option<std::string>::some(LIBPROCESS_FRAMING)) {
+      decoder->upgrading = true;
+    }
+
     return 0;
   }
 
@@ -203,10 +322,17 @@ private:
     return 0;
   }
 
+  // Frames larger than this are considered malformed.
+  static const uint64_t MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
   const Socket s; // The socket this decoder is associated with.
 
   bool failure;
 
+  bool upgrading; // Set once we've seen the upgrade request.
+  bool upgraded; // Set once the HTTP parser is done for good.
+  bool skipping; // Set until the LF ending the upgrade request is skipped.
+
   http_parser parser;
   http_parser_settings settings;
 
@@ -222,6 +348,10 @@ private:
   http::Request* request;
 
   std::deque<http::Request*> requests;
+
+  std::string buffer; // Partially received framed message.
+
+  std::deque<Message*> messages;
 };
 
 
@@ -2,8 +2,15 @@
 #define __ENCODER_HPP__
 
 #include <ev.h>
+#include <stdint.h>
 
+#include <arpa/inet.h>
+
+#include <sys/uio.h>
+
+#include <algorithm>
 #include <sstream>
+#include <vector>
 
 #include <process/http.hpp>
 #include <process/process.hpp>
@@ -30,50 +37,151 @@ public:
 };
 
 
+// Encodes data as a sequence of segments that can be sent with a
+// single (scatter/gather) system call without first copying them
+// into one contiguous buffer. Other data encoders can be coalesced
+// into this one (see 'coalesce') so that all of the data queued up
+// for a socket can get sent at once.
 class DataEncoder : public Encoder
 {
 public:
   DataEncoder(const std::string& _data)
-    : data(_data), index(0) {}
+    : data(_data), size(0), index(0)
+  {
+    append(data.data(), data.size());
+  }
 
-  virtual ~DataEncoder() {}
+  virtual ~DataEncoder()
+  {
+    foreach (DataEncoder* encoder, coalesced) {
+      delete encoder;
+    }
+  }
 
   virtual Sender sender()
   {
     return send_data;
   }
 
-  virtual const char* next(size_t* length)
+  // Fills in at most 'count' iovecs describing the data that still
+  // needs to be sent (including any coalesced data) and returns the
+  // number of iovecs filled in.
+  int next(struct iovec* iov, int count) const
   {
-    size_t temp = index;
-    index = data.size();
-    *length = data.size() - temp;
-    return data.data() + temp;
+    int filled = 0;
+
+    size_t offset = index;
+    foreach (const struct iovec& segment, segments) {
+      if (filled == count) {
+        return filled;
+      } else if (offset >= segment.iov_len) {
+        offset -= segment.iov_len;
+      } else {
+        iov[filled].iov_base = (char*) segment.iov_base + offset;
+        iov[filled].iov_len = segment.iov_len - offset;
+        filled++;
+        offset = 0;
+      }
+    }
+
+    foreach (DataEncoder* encoder, coalesced) {
+      filled += encoder->next(iov + filled, count - filled);
+    }
+
+    return filled;
   }
 
-  virtual void backup(size_t length)
+  // Records that 'length' bytes have been sent.
+  void advance(size_t length)
   {
-    if (index >= length) {
-      index -= length;
+    size_t amount = std::min(length, size - index);
+    index += amount;
+    length -= amount;
+
+    foreach (DataEncoder* encoder, coalesced) {
+      if (length == 0) {
+        break;
+      }
+      amount = std::min(length, encoder->remaining());
+      encoder->advance(amount);
+      length -= amount;
     }
   }
 
-  virtual size_t remaining() const
+  size_t remaining() const
+  {
+    size_t result = size - index;
+    foreach (DataEncoder* encoder, coalesced) {
+      result += encoder->remaining();
+    }
+    return result;
+  }
+
+  // Takes ownership of the specified encoder so that its data gets
+  // sent right after ours (and any previously coalesced data).
+  void coalesce(DataEncoder* encoder)
   {
-    return data.size() - index;
+    coalesced.push_back(encoder);
+  }
+
+  size_t coalescing() const
+  {
+    return coalesced.size();
+  }
+
+protected:
+  DataEncoder() : size(0), index(0) {}
+
+  // Adds a segment of data to send. The data must stay valid (and
+  // unchanged) for the lifetime of this encoder.
+  void append(const char* bytes, size_t length)
+  {
+    if (length > 0) {
+      struct iovec segment;
+      segment.iov_base = (void*) bytes;
+      segment.iov_len = length;
+      segments.push_back(segment);
+      size += length;
+    }
   }
 
 private:
+  // Not copyable, not assignable.
+  DataEncoder(const DataEncoder&);
+  DataEncoder& operator = (const DataEncoder&);
+
   const std::string data;
-  size_t index;
+
+  std::vector<struct iovec> segments;
+  size_t size; // Total size of all segments.
+  size_t index; // Amount of data that has been sent.
+
+  std::vector<DataEncoder*> coalesced;
 };
 
 
+// Value of the 'Upgrade' header used to switch a connection from
+// HTTP to framed messages (see MessageEncoder::upgrade).
+#define LIBPROCESS_FRAMING "libprocess-framing/1"
+
+
+// Encodes a message as an HTTP request (or as a framed message, see
+// MessageEncoder::frame). The body of the message gets sent directly
+// out of the message rather than getting copied.
 class MessageEncoder : public DataEncoder
 {
 public:
-  MessageEncoder(Message* _message)
-    : DataEncoder(encode(_message)), message(_message) {}
+  MessageEncoder(Message* _message, bool framed = false)
+    : message(_message)
+  {
+    if (message != NULL) {
+      header = head(message, framed);
+      trailer = tail(message, framed);
+      append(header.data(), header.size());
+      append(message->body.data(), message->body.size());
+      append(trailer.data(), trailer.size());
+    }
+  }
 
   virtual ~MessageEncoder()
   {
@@ -84,31 +192,108 @@ public:
 
   static std::string encode(Message* message)
   {
-    if (message != NULL) {
-      std::ostringstream out;
-
-      out << "POST /" << message->to.id << "/" << message->name
-          << " HTTP/1.0\r\n"
-          << "User-Agent: libprocess/" << message->from << "\r\n"
-          << "Connection: Keep-Alive\r\n";
-
-      if (message->body.size() > 0) {
-        out << "Transfer-Encoding: chunked\r\n\r\n"
-            << std::hex << message->body.size() << "\r\n";
-        out.write(message->body.data(), message->body.size());
-        out << "\r\n"
-            << "0\r\n"
-            << "\r\n";
-      } else {
-        out << "\r\n";
-      }
+    if (message == NULL) {
+      return "";
+    }
+
+    return head(message, false) + message->body + tail(message, false);
+  }
+
+  // Returns an HTTP request that asks the receiver to treat the rest
+  // of the connection as framed messages (see 'frame'). We only ask
+  // receivers that have advertised they can handle framed messages
+  // via the 'Libprocess-Framing' header (see 'encode').
+  static std::string upgrade(const UPID& from)
+  {
+    std::ostringstream out;
+
+    out << "POST / HTTP/1.1\r\n"
+        << "User-Agent: libprocess/" << from << "\r\n"
+        << "Connection: Upgrade\r\n"
+        << "Upgrade: " << LIBPROCESS_FRAMING << "\r\n"
+        << "\r\n";
+
+    return out.str();
+  }
 
-      return out.str();
+  // A framed message is a fixed size header of 32-bit integers (in
+  // network byte order) followed by the variable length fields:
+  //
+  //   [name size][from id size][from ip][from port][to id size]
+  //   [body size][name][from id][to id][body]
+  //
+  // Note that only the id of the receiver is included since the
+  // receiver is always local to the node that decodes the message.
+  static const size_t FRAME_HEADER_SIZE = 6 * sizeof(uint32_t);
+
+  static std::string frame(Message* message)
+  {
+    if (message == NULL) {
+      return "";
     }
+
+    return head(message, true) + message->body + tail(message, true);
   }
 
 private:
+  // Returns everything that comes before the body.
+  static std::string head(Message* message, bool framed)
+  {
+    if (framed) {
+      uint32_t sizes[6];
+      sizes[0] = htonl(message->name.size());
+      sizes[1] = htonl(message->from.id.size());
+      sizes[2] = message->from.ip; // Already in network byte order.
+      sizes[3] = htonl(message->from.port);
+      sizes[4] = htonl(message->to.id.size());
+      sizes[5] = htonl(message->body.size());
+
+      std::string out;
+
+      out.reserve(FRAME_HEADER_SIZE +
+                  message->name.size() +
+                  message->from.id.size() +
+                  message->to.id.size());
+
+      out.append((const char*) sizes, FRAME_HEADER_SIZE);
+      out.append(message->name);
+      out.append(message->from.id);
+      out.append(message->to.id);
+
+      return out;
+    }
+
+    std::ostringstream out;
+
+    out << "POST /" << message->to.id << "/" << message->name
+        << " HTTP/1.0\r\n"
+        << "User-Agent: libprocess/" << message->from << "\r\n"
+        << "Connection: Keep-Alive\r\n"
+        << "Libprocess-Framing: " << LIBPROCESS_FRAMING << "\r\n";
+
+    if (message->body.size() > 0) {
+      out << "Transfer-Encoding: chunked\r\n\r\n"
+          << std::hex << message->body.size() << "\r\n";
+    } else {
+      out << "\r\n";
+    }
+
+    return out.str();
+  }
+
+  // Returns everything that comes after the body.
+  static std::string tail(Message* message, bool framed)
+  {
+    if (!framed && message->body.size() > 0) {
+      return "\r\n0\r\n\r\n";
+    }
+    return "";
+  }
+
   Message* message;
+
+  std::string header;
+  std::string trailer;
 };
 
 
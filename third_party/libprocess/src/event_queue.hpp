@@ -0,0 +1,117 @@
+#ifndef __EVENT_QUEUE_HPP__
+#define __EVENT_QUEUE_HPP__
+
+#include <stdlib.h> // For NULL.
+
+#include <process/event.hpp>
+
+
+namespace process {
+
+// A lock-free, intrusive (via Event::next), multiple producer single
+// consumer queue of events. Any thread can enqueue an event, but only
+// the thread currently running the process that owns the queue may
+// dequeue (or check if the queue is empty).
+//
+// Producers push events onto a lock-free stack (one compare and swap
+// per event). The consumer takes the entire stack with a single
+// compare and swap, reverses it, and then serves events out of that
+// local "batch" without doing any more atomic operations until the
+// batch has been exhausted. Injected events go on a separate stack
+// that is always checked first so that they end up in front of every
+// other event, just like they would have if they had been pushed onto
+// the front of a double-ended queue.
+class EventQueue
+{
+public:
+  EventQueue() : incoming(NULL), injected(NULL), batch(NULL) {}
+
+  ~EventQueue()
+  {
+    Event* event = NULL;
+    while ((event = dequeue()) != NULL) {
+      delete event;
+    }
+  }
+
+  // Safe to call from any thread.
+  void enqueue(Event* event, bool inject = false)
+  {
+    Event* volatile* stack = inject ? &injected : &incoming;
+    Event* top = NULL;
+    do {
+      top = *stack;
+      event->next = top;
+    } while (!__sync_bool_compare_and_swap(stack, top, event));
+  }
+
+  // Must only be called by the consumer. Returns NULL if there are no
+  // events.
+  Event* dequeue()
+  {
+    // Injected events are already in the right order (i.e., the most
+    // recently injected event comes first), so we just put them in
+    // front of the current batch.
+    if (injected != NULL) {
+      Event* events = take(&injected);
+      Event* last = events;
+      while (last->next != NULL) {
+        last = last->next;
+      }
+      last->next = batch;
+      batch = events;
+    }
+
+    // Refill the batch (in FIFO order) if it's been exhausted.
+    if (batch == NULL && incoming != NULL) {
+      Event* events = take(&incoming);
+      while (events != NULL) {
+        Event* next = events->next;
+        events->next = batch;
+        batch = events;
+        events = next;
+      }
+    }
+
+    Event* event = batch;
+    if (event != NULL) {
+      batch = event->next;
+      event->next = NULL;
+    }
+
+    return event;
+  }
+
+  // Must only be called by the consumer.
+  bool empty()
+  {
+    __sync_synchronize(); // Read barrier for 'incoming' and 'injected'.
+    return batch == NULL && incoming == NULL && injected == NULL;
+  }
+
+private:
+  // Atomically takes all of the events off of the specified stack.
+  static Event* take(Event* volatile* stack)
+  {
+    Event* top = NULL;
+    do {
+      top = *stack;
+    } while (!__sync_bool_compare_and_swap(stack, top, (Event*) NULL));
+    return top;
+  }
+
+  // Not copyable, not assignable.
+  EventQueue(const EventQueue&);
+  EventQueue& operator = (const EventQueue&);
+
+  // Stacks (most recent event first) that producers push onto.
+  Event* volatile incoming;
+  Event* volatile injected;
+
+  // Events owned by the consumer (in the order they should be served).
+  Event* batch;
+};
+
+} // namespace process {
+
+#endif // __EVENT_QUEUE_HPP__
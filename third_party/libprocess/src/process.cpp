@@ -58,6 +58,7 @@
 #include <process/mime.hpp>
 #include <process/process.hpp>
 #include <process/socket.hpp>
+#include <process/statistics.hpp>
 #include <process/thread.hpp>
 #include <process/timer.hpp>
 
@@ -65,14 +66,18 @@
 #include <stout/foreach.hpp>
 #include <stout/lambda.hpp>
 #include <stout/net.hpp>
+#include <stout/numify.hpp>
 #include <stout/os.hpp>
 #include <stout/strings.hpp>
 
 #include "config.hpp"
 #include "decoder.hpp"
 #include "encoder.hpp"
+#include "event_queue.hpp"
 #include "gate.hpp"
+#include "process_metrics.hpp"
 #include "synchronized.hpp"
+#include "timer_wheel.hpp"
 
 using process::wait; // Necessary on some OS's to disambiguate.
 
@@ -297,10 +302,140 @@ private:
 };
 
 
+// An event loop (run by its own thread, see 'serve') for watching
+// sockets and other file descriptors.
+class EventLoop
+{
+public:
+  EventLoop(struct ev_loop* _loop) : loop(_loop)
+  {
+    pthread_mutex_init(&m, NULL);
+    ev_async_init(&async_watcher, handle);
+    async_watcher.data = this;
+    ev_async_start(loop, &async_watcher);
+  }
+
+  ~EventLoop()
+  {
+    pthread_mutex_destroy(&m);
+  }
+
+  // Starts the watcher on this loop (safe to call from any thread).
+  void watch(ev_io* watcher)
+  {
+    pthread_mutex_lock(&m);
+    {
+      watchers.push(watcher);
+    }
+    pthread_mutex_unlock(&m);
+
+    // Interrupt the loop.
+    ev_async_send(loop, &async_watcher);
+  }
+
+  struct ev_loop* const loop;
+
+private:
+  static void handle(struct ev_loop* loop, ev_async* watcher, int revents)
+  {
+    EventLoop* that = (EventLoop*) watcher->data;
+
+    pthread_mutex_lock(&that->m);
+    {
+      // Start all the new I/O watchers.
+      while (!that->watchers.empty()) {
+        ev_io_start(loop, that->watchers.front());
+        that->watchers.pop();
+      }
+    }
+    pthread_mutex_unlock(&that->m);
+  }
+
+  // Asynchronous watcher for interrupting the loop.
+  ev_async async_watcher;
+
+  // Queue of I/O watchers to start.
+  queue<ev_io*> watchers;
+  pthread_mutex_t m;
+};
+
+
+// Bookkeeping for all of the sockets that hash to the same event loop
+// (see 'watch'). Each shard has its own lock so that sending and
+// receiving on sockets in different shards never contends on a
+// single lock. Any state that is keyed by node (rather than socket)
+// is kept by the SocketManager itself.
+class SocketShard
+{
+public:
+  SocketShard();
+  ~SocketShard();
+
+  Socket accepted(int s);
+
+  // Adds a socket we created for communicating with a node. If
+  // 'connecting' then the first thing sent on the socket waits for
+  // the connection to get established.
+  void add(const Socket& socket, bool dispose, bool connecting);
+
+  PID<HttpProxy> proxy(int s);
+
+  // Returns false if the socket is no longer valid (in which case
+  // the caller still owns the encoder/message).
+  bool send(Encoder* encoder, int s, bool persist);
+  bool send(Message* message, int s, bool persist, bool framing);
+
+  // Returns the next encoder for the socket, if any. If the socket
+  // got disposed (because there is nothing more to send) then it's
+  // returned via 'disposed', as is any proxy that needs to be
+  // terminated via 'proxy'.
+  Encoder* next(int s, Option<Socket>* disposed, HttpProxy** proxy);
+
+  void coalesce(int s, DataEncoder* encoder);
+
+  // Removes a socket that has nothing left to send (e.g., an idle
+  // temporary socket) and returns it, or none if the socket is no
+  // longer valid or is still sending.
+  Option<Socket> release(int s);
+
+  // Returns false if the socket was not active. Returns any proxy
+  // that needs to be terminated via 'proxy'.
+  bool close(int s, HttpProxy** proxy);
+
+private:
+  // Enqueues the encoder, starting a watcher if necessary. Expects
+  // the shard to be locked.
+  void enqueue(Encoder* encoder, int s);
+
+  // Collection of all actice sockets.
+  map<int, Socket> sockets;
+
+  // Collection of sockets that should be disposed when they are
+  // finished being used (e.g., when there is no more data to send on
+  // them).
+  set<int> dispose;
+
+  // Sockets that are still getting connected.
+  set<int> connecting;
+
+  // Map from socket to outgoing queue.
+  map<int, queue<Encoder*> > outgoing;
+
+  // Sockets that have been upgraded to send framed messages.
+  set<int> upgraded;
+
+  // HTTP proxies.
+  map<int, HttpProxy*> proxies;
+
+  // Protects instance variables.
+  synchronizable(this);
+};
+
+
 class SocketManager
 {
 public:
-  SocketManager();
+  SocketManager(int shards);
   ~SocketManager();
 
   Socket accepted(int s);
@@ -315,30 +450,47 @@ public:
 
   Encoder* next(int s);
 
+  void coalesce(int s, DataEncoder* encoder);
+
   void close(int s);
 
   void exited(const Node& node);
   void exited(ProcessBase* process);
 
+  // Invoked when we learn that a node can receive framed messages.
+  void framing(const Node& node);
+
+  // Invoked (via a timer) to dispose of a temporary socket if it has
+  // been idle for long enough.
+  void expire(int s);
+
 private:
-  // Map from UPID (local/remote) to process.
-  map<UPID, set<ProcessBase*> > links;
+  SocketShard* shard(int s)
+  {
+    return shards[s % shards.size()];
+  }
 
-  // Collection of all actice sockets.
-  map<int, Socket> sockets;
+  // Per socket bookkeeping (see SocketShard).
+  vector<SocketShard*> shards;
 
-  // Collection of sockets that should be disposed when they are
-  // finished being used (e.g., when there is no more data to send on
-  // them).
-  set<int> dispose;
+  // Map from UPID (local/remote) to process.
+  map<UPID, set<ProcessBase*> > links;
 
   // Map from socket to node (ip, port).
   map<int, Node> nodes;
 
   // Maps from node (ip, port) to temporary sockets (i.e., they will
-  // get closed once there is no more data to send on them).
+  // get closed once there has been no more data to send on them for
+  // the idle timeout, see 'idle_timeout').
   map<Node, int> temps;
 
+  // Map from idle temporary socket to the time it became idle. Any
+  // temporary socket in here can be reused without connecting again.
+  map<int, double> idles;
+
+  // Temporary sockets with an outstanding timer to expire them.
+  set<int> expiring;
+
   // Maps from node (ip, port) to persistent sockets (i.e., they will
   // remain open even if there is no more data to send on them).  We
   // distinguish these from the 'temps' collection so we can tell when
@@ -346,21 +498,52 @@ private:
   // ExitedEvents).
   map<Node, int> persists;
 
-  // Map from socket to outgoing queue.
-  map<int, queue<Encoder*> > outgoing;
-
-  // HTTP proxies.
-  map<int, HttpProxy*> proxies;
+  // Nodes that can receive framed messages (i.e., that have
+  // advertised as much, see MessageEncoder::encode).
+  set<Node> framed;
 
-  // Protects instance variables.
+  // Protects instance variables (but not the shards). Always acquired
+  // before any shard lock.
   synchronizable(this);
 };
 
 
+// A queue of processes that are ready to be resumed. Each processing
+// thread has its own run queue so that the threads don't all contend
+// on a single lock (see ProcessManager::enqueue and
+// ProcessManager::dequeue for how processes get distributed and
+// stolen across the run queues).
+class RunQueue
+{
+public:
+  RunQueue(int _id) : id(_id)
+  {
+    pthread_mutex_init(&m, NULL);
+  }
+
+  ~RunQueue()
+  {
+    pthread_mutex_destroy(&m);
+  }
+
+  void lock() { pthread_mutex_lock(&m); }
+  void unlock() { pthread_mutex_unlock(&m); }
+
+  // Index of the processing thread that owns this run queue.
+  const int id;
+
+  // Runnable processes (protected by 'lock').
+  deque<ProcessBase*> processes;
+
+private:
+  pthread_mutex_t m;
+};
+
+
 class ProcessManager
 {
 public:
-  ProcessManager(const string& delegate);
+  ProcessManager(const string& delegate, int threads);
   ~ProcessManager();
 
   ProcessReference use(const UPID& pid);
@@ -369,6 +552,10 @@ public:
       const Socket& socket,
       Request* request);
 
+  bool handle(
+      const Socket& socket,
+      Message* message);
+
   bool deliver(
       ProcessBase* receiver,
       Event* event,
@@ -387,7 +574,7 @@ public:
   bool wait(const UPID& pid);
 
   void enqueue(ProcessBase* process);
-  ProcessBase* dequeue();
+  ProcessBase* dequeue(int thread);
 
   void settle();
 
@@ -402,9 +589,8 @@ private:
   // Gates for waiting threads (protected by synchronizable(processes)).
   map<ProcessBase*, Gate*> gates;
 
-  // Queue of runnable processes (implemented using list).
-  list<ProcessBase*> runq;
-  synchronizable(runq);
+  // Run queues of runnable processes, one per processing thread.
+  vector<RunQueue*> runqs;
 
   // Number of running processes, to support Clock::settle operation.
   int running;
@@ -429,7 +615,8 @@ static SocketManager* socket_manager = NULL;
 // Active ProcessManager (eventually will probably be thread-local).
 static ProcessManager* process_manager = NULL;
 
-// Event loop.
+// Event loop for timers. Sockets are watched by separate event loops
+// (see 'loops') so that lots of I/O can't hold up any timers.
 static struct ev_loop* loop = NULL;
 
 // Asynchronous watcher for interrupting loop.
@@ -438,28 +625,105 @@ static ev_async async_watcher;
 // Watcher for timeouts.
 static ev_timer timeouts_watcher;
 
-// Server watcher for accepting connections.
+// Server watcher for accepting connections (on the first I/O loop).
 static ev_io server_watcher;
 
-// Queue of I/O watchers.
-static queue<ev_io*>* watchers = new queue<ev_io*>();
-static synchronizable(watchers) = SYNCHRONIZED_INITIALIZER;
+// Event loops for I/O.
+static vector<EventLoop*>* loops = new vector<EventLoop*>();
+
+
+// Starts the (initialized) watcher on the I/O loop that its file
+// descriptor hashes to. All watchers for the same file descriptor
+// end up on the same loop, and thus get run by the same thread.
+static void watch(ev_io* watcher)
+{
+  (*loops)[watcher->fd % loops->size()]->watch(watcher);
+}
+
+
+// Turns off Nagle (TCP_NODELAY) so small messages don't wait and
+// turns on TCP keepalives so we eventually notice peers that went
+// away without closing long lived (persistent or pooled) sockets.
+static Try<Nothing> tune(int s)
+{
+  int on = 1;
+  if (setsockopt(s, SOL_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
+    return Try<Nothing>::error(
+        string("Failed to turn off the Nagle algorithm: ") + strerror(errno));
+  }
+
+  if (setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on)) < 0) {
+    return Try<Nothing>::error(
+        string("Failed to turn on keepalives: ") + strerror(errno));
+  }
+
+#ifdef __linux__
+  // Start probing after a minute of inactivity, and give up after
+  // six unanswered probes sent ten seconds apart.
+  int idle = 60;
+  int interval = 10;
+  int count = 6;
+  if (setsockopt(s, SOL_TCP, TCP_KEEPIDLE, &idle, sizeof(idle)) < 0 ||
+      setsockopt(s, SOL_TCP, TCP_KEEPINTVL, &interval, sizeof(interval)) < 0 ||
+      setsockopt(s, SOL_TCP, TCP_KEEPCNT, &count, sizeof(count)) < 0) {
+    return Try<Nothing>::error(
+        string("Failed to configure keepalives: ") + strerror(errno));
+  }
+#endif // __linux__
+
+  return Nothing();
+}
 
-// We store the timers in a map of lists indexed by the timeout of the
-// timer so that we can have two timers that have the same timeout. We
-// exploit that the map is SORTED!
-static map<double, list<Timer> >* timeouts =
-  new map<double, list<Timer> >();
+// We store the timers in a (hierarchical) timer wheel indexed by the
+// id of the timer so that adding and canceling a timer is O(1).
+static TimerWheel<Timer>* timeouts = new TimerWheel<Timer>();
 static synchronizable(timeouts) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
 
-// For supporting Clock::settle(), true if timers have been removed
-// from 'timeouts' but may not have been executed yet. Protected by
-// the timeouts lock. This is only used when the clock is paused.
-static bool pending_timers = false;
+// Batches of timers that have timed out but have not been executed
+// yet. The timers get executed on their own thread (see 'execute')
+// so that we don't tie up the event loop. Protected by the timeouts
+// lock.
+static queue<list<Timer> >* expired = new queue<list<Timer> >();
+
+// Gate the timer executing thread waits at when there is nothing to
+// execute.
+static Gate* expired_gate = new Gate();
+
+// For supporting Clock::settle(), the number of batches of timers
+// that have been removed from 'timeouts' but have not been executed
+// yet. Protected by the timeouts lock. This is only used when the
+// clock is paused.
+static int pending_timers = 0;
 
 // Flag to indicate whether or to update the timer on async interrupt.
 static bool update_timer = false;
 
+// Whether or not to send framed messages (instead of HTTP requests)
+// to nodes that can receive them. We can always receive framed
+// messages regardless.
+static bool enable_framing = true;
+
+// Seconds a temporary socket may stay idle (i.e., have nothing to
+// send) before we close it, or 0 to close it right away.
+static double idle_timeout = 30.0;
+
+// Instrument one out of every 'event_sampling' events served by
+// processes, or none if 0 (see ProcessMetrics). Events that aren't
+// sampled only cost an atomic increment, so this is cheap enough to
+// leave on.
+static uint32_t event_sampling = 64;
+
+// Socket statistics, updated atomically and periodically published
+// to the global statistics (see 'publish').
+static struct
+{
+  uint64_t connects; // Connections made to other nodes.
+  uint64_t reuses; // Sends that reused an idle temporary socket.
+  uint64_t sockets; // Sockets connected or accepted.
+  uint64_t sent; // Bytes sent.
+  uint64_t received; // Bytes received.
+} counters = { 0, 0, 0, 0, 0 };
+
 // Scheduling gate that threads wait at when there is nothing to run.
 static Gate* gate = new Gate();
 
@@ -713,20 +977,11 @@ static Message* parse(Request* request)
 
 void handle_async(struct ev_loop* loop, ev_async* _, int revents)
 {
-  synchronized (watchers) {
-    // Start all the new I/O watchers.
-    while (!watchers->empty()) {
-      ev_io* watcher = watchers->front();
-      watchers->pop();
-      ev_io_start(loop, watcher);
-    }
-  }
-
   synchronized (timeouts) {
     if (update_timer) {
       if (!timeouts->empty()) {
 	// Determine when the next timer should fire.
-	timeouts_watcher.repeat = timeouts->begin()->first - Clock::now();
+	timeouts_watcher.repeat = timeouts->next().get() - Clock::now();
 
         if (timeouts_watcher.repeat <= 0) {
 	  // Feed the event now!
@@ -753,42 +1008,33 @@ void handle_async(struct ev_loop* loop, ev_async* _, int revents)
 
 void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
 {
-  list<Timer> timedout;
-
   synchronized (timeouts) {
     double now = Clock::now();
 
     VLOG(3) << "Handling timeouts up to "
             << std::fixed << std::setprecision(9) << now;
 
-    double timeout;
-    foreachkey (timeout, *timeouts) {
-      if (timeout > now) {
-        break;
-      }
+    const list<Timer>& timedout = timeouts->advance(now);
 
-      VLOG(3) << "Have timeout(s) at "
-              << std::fixed << std::setprecision(9) << timeout;
+    if (!timedout.empty()) {
+      VLOG(3) << "Have " << timedout.size() << " timeout(s)";
 
       // Record that we have pending timers to execute so the
       // Clock::settle() operation can wait until we're done.
-      pending_timers = true;
+      pending_timers++;
 
-      foreach (const Timer& timer, (*timeouts)[timeout]) {
-        timedout.push_back(timer);
-      }
+      // Hand the timers off to get executed (in order).
+      expired->push(timedout);
+      expired_gate->open();
     }
 
-    // Now erase the range of timeouts that timed out.
-    timeouts->erase(timeouts->begin(), timeouts->upper_bound(now));
-
     // Okay, so the timeout for the next timer should not have fired.
-    CHECK(timeouts->empty() || (timeouts->begin()->first > now));
+    CHECK(timeouts->empty() || (timeouts->next().get() > now));
 
     // Update the timer as necessary.
     if (!timeouts->empty()) {
       // Determine when the next timer should fire.
-      timeouts_watcher.repeat = timeouts->begin()->first - Clock::now();
+      timeouts_watcher.repeat = timeouts->next().get() - Clock::now();
 
       if (timeouts_watcher.repeat <= 0) {
         // Feed the event now!
@@ -809,37 +1055,64 @@ void handle_timeouts(struct ev_loop* loop, ev_timer* _, int revents)
 
     update_timer = false; // Since we might have a queued update_timer.
   }
+}
 
-  // Update current time of process (if it's present/valid). It might
-  // be necessary to actually add some more synchronization around
-  // this so that, for example, pausing and resuming the clock doesn't
-  // cause some processes to get thier current times updated and
-  // others not. Since ProcessManager::use acquires the 'processes'
-  // lock we had to move this out of the synchronized (timeouts) above
-  // since there was a deadlock with acquring 'processes' then
-  // 'timeouts' (reverse order) in ProcessManager::cleanup. Note that
-  // current time may be greater than the timeout if a local message
-  // was received (and happens-before kicks in).
-  if (Clock::paused()) {
-    foreach (const Timer& timer, timedout) {
-      if (ProcessReference process = process_manager->use(timer.creator())) {
-        Clock::update(process, timer.timeout().value());
+
+void* execute(void* arg)
+{
+  do {
+    Gate::state_t old = expired_gate->approach();
+
+    bool empty = true;
+    list<Timer> timedout;
+
+    synchronized (timeouts) {
+      if (!expired->empty()) {
+        empty = false;
+        timedout = expired->front();
+        expired->pop();
       }
     }
-  }
 
-  // Invoke the timers that timed out (TODO(benh): Do this
-  // asynchronously so that we don't tie up the event thread!).
-  foreach (const Timer& timer, timedout) {
-    timer();
-  }
+    if (empty) {
+      expired_gate->arrive(old); // Wait at gate if idle.
+      continue;
+    }
 
-  // Mark ourselves as done executing the timers since it's now safe
-  // for a call to Clock::settle() to check if there will be any
-  // future timeouts reached.
-  synchronized (timeouts) {
-    pending_timers = false;
-  }
+    expired_gate->leave();
+
+    // Update current time of process (if it's present/valid). It
+    // might be necessary to actually add some more synchronization
+    // around this so that, for example, pausing and resuming the
+    // clock doesn't cause some processes to get thier current times
+    // updated and others not. Since ProcessManager::use acquires the
+    // 'processes' lock we can't do this while holding the 'timeouts'
+    // lock since there would be a deadlock with acquring 'processes'
+    // then 'timeouts' (reverse order) in ProcessManager::cleanup.
+    // Note that current time may be greater than the timeout if a
+    // local message was received (and happens-before kicks in).
+    if (Clock::paused()) {
+      foreach (const Timer& timer, timedout) {
+        if (ProcessReference process = process_manager->use(timer.creator())) {
+          Clock::update(process, timer.timeout().value());
+        }
+      }
+    }
+
+    // Invoke the timers that timed out.
+    foreach (const Timer& timer, timedout) {
+      timer();
+    }
+
+    // Mark ourselves as done executing the timers since it's now safe
+    // for a call to Clock::settle() to check if there will be any
+    // future timeouts reached.
+    synchronized (timeouts) {
+      pending_timers--;
+    }
+  } while (true);
+
+  return NULL;
 }
 
 
@@ -879,14 +1152,26 @@ void recv_data(struct ev_loop* loop, ev_io* watcher, int revents)
     } else {
       CHECK(length > 0);
 
-      // Decode as much of the data as possible into HTTP requests.
+      __sync_fetch_and_add(&counters.received, length);
+
+      // Decode as much of the data as possible into HTTP requests
+      // (or framed messages if the connection has been upgraded).
       const deque<Request*>& requests = decoder->decode(data, length);
+      const deque<Message*>& messages = decoder->decoded();
 
-      if (!requests.empty()) {
-        foreach (Request* request, requests) {
-          process_manager->handle(decoder->socket(), request);
-        }
-      } else if (requests.empty() && decoder->failed()) {
+      foreach (Request* request, requests) {
+        process_manager->handle(decoder->socket(), request);
+      }
+      foreach (Message* message, messages) {
+        process_manager->handle(decoder->socket(), message);
+      }
+
+      // Note that a decoder can fail after having decoded some
+      // messages (e.g., a malformed frame following valid ones), but
+      // we don't close the socket yet if there are HTTP requests that
+      // still need to be responded to (we'll close it on the next
+      // receive since a failed decoder doesn't decode anymore).
+      if (requests.empty() && decoder->failed()) {
         VLOG(1) << "Decoder error while receiving";
         socket_manager->close(s);
         delete decoder;
@@ -905,22 +1190,27 @@ void send_data(struct ev_loop* loop, ev_io* watcher, int revents)
 
   int s = watcher->fd;
 
+  // Pick up any other data that has been queued up for this socket in
+  // the mean time so that we can send it all with one system call.
+  socket_manager->coalesce(s, encoder);
+
   while (true) {
-    const void* data;
-    size_t size;
+    const int count = 256;
+    struct iovec iov[count];
 
-    data = encoder->next(&size);
-    CHECK(size > 0);
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = iov;
+    message.msg_iovlen = encoder->next(iov, count);
+    CHECK(message.msg_iovlen > 0);
 
-    ssize_t length = send(s, data, size, MSG_NOSIGNAL);
+    ssize_t length = sendmsg(s, &message, MSG_NOSIGNAL);
 
     if (length < 0 && (errno == EINTR)) {
       // Interrupted, try again now.
-      encoder->backup(size);
       continue;
     } else if (length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
       // Might block, try again later.
-      encoder->backup(size);
       break;
     } else if (length <= 0) {
       // Socket error or closed.
@@ -938,10 +1228,12 @@ void send_data(struct ev_loop* loop, ev_io* watcher, int revents)
     } else {
       CHECK(length > 0);
 
+      __sync_fetch_and_add(&counters.sent, length);
+
       // Update the encoder with the amount sent.
-      encoder->backup(size - length);
+      encoder->advance(length);
 
-      // See if there is any more of the message to send.
+      // See if there is any more of the message(s) to send.
       if (encoder->remaining() == 0) {
         delete encoder;
 
@@ -1005,6 +1297,8 @@ void send_file(struct ev_loop* loop, ev_io* watcher, int revents)
     } else {
       CHECK(length > 0);
 
+      __sync_fetch_and_add(&counters.sent, length);
+
       // Update the encoder with the amount sent.
       encoder->backup(size - length);
 
@@ -1111,13 +1405,15 @@ void accept(struct ev_loop* loop, ev_io* watcher, int revents)
     return;
   }
 
-  // Turn off Nagle (TCP_NODELAY) so pipelined requests don't wait.
-  int on = 1;
-  if (setsockopt(s, SOL_TCP, TCP_NODELAY, &on, sizeof(on)) < 0) {
-    const char* error = strerror(errno);
-    VLOG(1) << "Failed to turn off the Nagle algorithm: " << error;
+  // Turn off Nagle (TCP_NODELAY) so pipelined requests don't wait
+  // (and turn on keepalives).
+  Try<Nothing> tuned = tune(s);
+  if (tuned.isError()) {
+    VLOG(1) << "Failed to accept: " << tuned.error();
     close(s);
   } else {
+    __sync_fetch_and_add(&counters.sockets, 1);
+
     // Inform the socket manager for proper bookkeeping.
     const Socket& socket = socket_manager->accepted(s);
 
@@ -1128,7 +1424,10 @@ void accept(struct ev_loop* loop, ev_io* watcher, int revents)
     watcher->data = decoder;
 
     ev_io_init(watcher, recv_data, s, EV_READ);
-    ev_io_start(loop, watcher);
+
+    // Note that the socket might hash to a different loop than the
+    // one we're accepting on.
+    watch(watcher);
   }
 }
 
@@ -1154,11 +1453,14 @@ void* serve(void* arg)
 
 void* schedule(void* arg)
 {
+  // Index of this processing thread (and it's run queue).
+  int thread = (intptr_t) arg;
+
   do {
-    ProcessBase* process = process_manager->dequeue();
+    ProcessBase* process = process_manager->dequeue(thread);
     if (process == NULL) {
       Gate::state_t old = gate->approach();
-      process = process_manager->dequeue();
+      process = process_manager->dequeue(thread);
       if (process == NULL) {
 	gate->arrive(old); // Wait at gate if idle.
 	continue;
@@ -1188,6 +1490,50 @@ void* schedule(void* arg)
 // }
 
 
+// Publishes the socket statistics (if they've changed) and then
+// schedules itself to publish them again.
+static void publish()
+{
+  static const char* names[] = {
+    "libprocess/connects",
+    "libprocess/reuses",
+    "libprocess/sockets",
+    "libprocess/bytes_sent",
+    "libprocess/bytes_received"
+  };
+
+  uint64_t* values[] = {
+    &counters.connects,
+    &counters.reuses,
+    &counters.sockets,
+    &counters.sent,
+    &counters.received
+  };
+
+  // Last published values, only accessed by the timer thread.
+  static uint64_t published[] = { 0, 0, 0, 0, 0 };
+
+  bool changed = false;
+
+  for (int i = 0; i < 5; i++) {
+    uint64_t value = __sync_fetch_and_add(values[i], 0);
+    if (value != published[i]) {
+      statistics->set(names[i], value);
+      published[i] = value;
+      changed = true;
+    }
+  }
+
+  if (changed && published[2] > 0) {
+    statistics->set(
+        "libprocess/bytes_per_socket",
+        (published[3] + published[4]) / (double) published[2]);
+  }
+
+  Timer::create(Seconds(1.0), &publish);
+}
+
+
 void initialize(const string& delegate)
 {
   // TODO(benh): Return an error if attempting to initialize again
@@ -1239,24 +1585,85 @@ void initialize(const string& delegate)
   signal(SIGPIPE, SIG_IGN);
 #endif // __sun__
 
+  char* value;
+
+  // Determine the number of processing threads, defaulting to one
+  // per cpu (but at least 4).
+  long threads = std::max(4L, sysconf(_SC_NPROCESSORS_ONLN));
+
+  // Check environment for number of processing threads.
+  value = getenv("LIBPROCESS_NUM_WORKER_THREADS");
+  if (value != NULL) {
+    int result = atoi(value);
+    if (result <= 0) {
+      LOG(FATAL) << "LIBPROCESS_NUM_WORKER_THREADS=" << value
+                 << " is not a valid number of threads";
+    }
+    threads = result;
+  }
+
+  // Determine the number of I/O loops, defaulting to one per NUMA
+  // node (or just one if we can't tell how many nodes there are).
+  long io = 1;
+
+  Try<list<string> > nodes = os::glob("/sys/devices/system/node/node[0-9]*");
+  if (nodes.isSome() && !nodes.get().empty()) {
+    io = nodes.get().size();
+  }
+
+  // Check environment for number of I/O loops.
+  value = getenv("LIBPROCESS_NUM_IO_THREADS");
+  if (value != NULL) {
+    int result = atoi(value);
+    if (result <= 0) {
+      LOG(FATAL) << "LIBPROCESS_NUM_IO_THREADS=" << value
+                 << " is not a valid number of threads";
+    }
+    io = result;
+  }
+
   // Create a new ProcessManager and SocketManager.
-  process_manager = new ProcessManager(delegate);
-  socket_manager = new SocketManager();
+  process_manager = new ProcessManager(delegate, threads);
+  socket_manager = new SocketManager(io);
 
   // Setup processing threads.
-  long cpus = std::max(4L, sysconf(_SC_NPROCESSORS_ONLN));
-
-  for (int i = 0; i < cpus; i++) {
+  for (intptr_t i = 0; i < threads; i++) {
     pthread_t thread; // For now, not saving handles on our threads.
-    if (pthread_create(&thread, NULL, schedule, NULL) != 0) {
+    if (pthread_create(&thread, NULL, schedule, (void*) i) != 0) {
       LOG(FATAL) << "Failed to initialize, pthread_create";
     }
   }
 
+  // Check environment for whether or not to send framed messages.
+  value = getenv("LIBPROCESS_DISABLE_FRAMING");
+  if (value != NULL) {
+    enable_framing = false;
+  }
+
+  // Check environment for how long to keep idle temporary sockets.
+  value = getenv("LIBPROCESS_IDLE_TIMEOUT");
+  if (value != NULL) {
+    Try<double> result = numify<double>(value);
+    if (result.isError() || result.get() < 0) {
+      LOG(FATAL) << "LIBPROCESS_IDLE_TIMEOUT=" << value
+                 << " is not a valid number of seconds";
+    }
+    idle_timeout = result.get();
+  }
+
   __ip__ = 0;
   __port__ = 0;
 
-  char* value;
+  // Check environment for how many events of processes to sample.
+  value = getenv("LIBPROCESS_EVENT_SAMPLING");
+  if (value != NULL) {
+    Try<uint32_t> result = numify<uint32_t>(value);
+    if (result.isError()) {
+      LOG(FATAL) << "LIBPROCESS_EVENT_SAMPLING=" << value
+                 << " is not a valid number of events";
+    }
+    event_sampling = result.get();
+  }
 
   // Check environment for ip.
   value = getenv("LIBPROCESS_IP");
@@ -1347,21 +1754,31 @@ void initialize(const string& delegate)
     PLOG(FATAL) << "Failed to initialize, listen";
   }
 
-  // Setup event loop.
+  // Setup event loops.
 #ifdef __sun__
-  loop = ev_default_loop(EVBACKEND_POLL | EVBACKEND_SELECT);
+  const unsigned int flags = EVBACKEND_POLL | EVBACKEND_SELECT;
 #else
-  loop = ev_default_loop(EVFLAG_AUTO);
+  const unsigned int flags = EVFLAG_AUTO;
 #endif // __sun__
 
+  loop = ev_default_loop(flags);
+
   ev_async_init(&async_watcher, handle_async);
   ev_async_start(loop, &async_watcher);
 
   ev_timer_init(&timeouts_watcher, handle_timeouts, 0., 2100000.0);
   ev_timer_again(loop, &timeouts_watcher);
 
+  for (long i = 0; i < io; i++) {
+    struct ev_loop* l = ev_loop_new(flags);
+    if (l == NULL) {
+      LOG(FATAL) << "Failed to initialize, ev_loop_new";
+    }
+    loops->push_back(new EventLoop(l));
+  }
+
   ev_io_init(&server_watcher, accept, __s__, EV_READ);
-  ev_io_start(loop, &server_watcher);
+  ev_io_start(loops->front()->loop, &server_watcher);
 
 //   ev_child_init(&child_watcher, child_exited, pid, 0);
 //   ev_child_start(loop, &cw);
@@ -1383,6 +1800,17 @@ void initialize(const string& delegate)
     LOG(FATAL) << "Failed to initialize, pthread_create";
   }
 
+  foreach (EventLoop* l, *loops) {
+    if (pthread_create(&thread, NULL, serve, l->loop) != 0) {
+      LOG(FATAL) << "Failed to initialize, pthread_create";
+    }
+  }
+
+  // Start the thread that executes timers that have timed out.
+  if (pthread_create(&thread, NULL, execute, NULL) != 0) {
+    LOG(FATAL) << "Failed to initialize, pthread_create";
+  }
+
   // Need to set initialzing here so that we can actually invoke
   // 'spawn' below for the garbage collector.
   initializing = false;
@@ -1390,6 +1818,11 @@ void initialize(const string& delegate)
   // Create global garbage collector.
   gc = spawn(new GarbageCollector());
 
+  // Create global statistics (keeping a day's worth of values) and
+  // start publishing the socket statistics.
+  statistics = new Statistics(Seconds(60 * 60 * 24));
+  publish();
+
   // Initialize the mime types.
   mime::initialize();
 
@@ -1402,7 +1835,7 @@ void initialize(const string& delegate)
   }
 
   VLOG(1) << "libprocess is initialized on " << temp << ":" << __port__
-          << " for " << cpus << " cpus";
+          << " with " << threads << " processing threads";
 }
 
 
@@ -1420,6 +1853,15 @@ uint16_t port()
 }
 
 
+uint32_t sample(uint32_t period)
+{
+  process::initialize();
+  uint32_t previous = event_sampling;
+  event_sampling = period;
+  return previous;
+}
+
+
 HttpProxy::HttpProxy(const Socket& _socket)
   : ProcessBase(ID::generate("__http__")),
     socket(_socket) {}
@@ -1665,16 +2107,16 @@ void HttpProxy::stream(const Future<short>& poll, bool persist)
 }
 
 
-SocketManager::SocketManager()
+SocketShard::SocketShard()
 {
-  synchronizer(this) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
+  synchronizer(this) = SYNCHRONIZED_INITIALIZER;
 }
 
 
-SocketManager::~SocketManager() {}
+SocketShard::~SocketShard() {}
 
 
-Socket SocketManager::accepted(int s)
+Socket SocketShard::accepted(int s)
 {
   synchronized (this) {
     return sockets[s] = Socket(s);
@@ -1682,17 +2124,291 @@ Socket SocketManager::accepted(int s)
 }
 
 
-void SocketManager::link(ProcessBase* process, const UPID& to)
+void SocketShard::add(const Socket& socket, bool _dispose, bool _connecting)
 {
-  // TODO(benh): The semantics we want to support for link are such
-  // that if there is nobody to link to (local or remote) then an
-  // ExitedEvent gets generated. This functionality has only been
-  // implemented when the link is local, not remote. Of course, if
-  // there is nobody listening on the remote side, then this should
-  // work remotely ... but if there is someone listening remotely just
-  // not at that id, then it will silently continue executing.
+  synchronized (this) {
+    sockets[socket] = socket;
 
-  CHECK(process != NULL);
+    if (_dispose) {
+      dispose.insert(socket);
+    }
+
+    if (_connecting) {
+      connecting.insert(socket);
+    }
+  }
+}
+
+
+PID<HttpProxy> SocketShard::proxy(int s)
+{
+  HttpProxy* proxy = NULL;
+
+  synchronized (this) {
+    // This socket might have been asked to get closed (e.g., remote
+    // side hang up) while a process is attempting to handle an HTTP
+    // request. Thus, if there is no more socket, return an empty PID.
+    if (sockets.count(s) > 0) {
+      if (proxies.count(s) > 0) {
+        return proxies[s]->self();
+      } else {
+        proxy = new HttpProxy(sockets[s]);
+        proxies[s] = proxy;
+      }
+    }
+  }
+
+  // Now check if we need to spawn a newly created proxy. Note that we
+  // need to do this outside of the synchronized block above to avoid
+  // a possible deadlock (because spawn eventually synchronizes on
+  // ProcessManager and ProcessManager::cleanup synchronizes on
+  // ProcessManager and then SocketManager, so a deadlock results if
+  // we do spawn within the synchronized block above).
+  if (proxy != NULL) {
+    return spawn(proxy, true);
+  }
+
+  return PID<HttpProxy>();
+}
+
+
+bool SocketShard::send(Encoder* encoder, int s, bool persist)
+{
+  CHECK(encoder != NULL);
+
+  synchronized (this) {
+    if (sockets.count(s) > 0) {
+      // Update whether or not this socket should get disposed after
+      // there is no more data to send.
+      if (!persist) {
+        dispose.insert(s);
+      }
+
+      enqueue(encoder, s);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+bool SocketShard::send(Message* message, int s, bool persist, bool framing)
+{
+  CHECK(message != NULL);
+
+  synchronized (this) {
+    if (sockets.count(s) > 0) {
+      if (!persist) {
+        dispose.insert(s);
+      }
+
+      // Upgrade the socket in between messages if we've learned that
+      // the node can receive framed messages since we connected.
+      if (framing && upgraded.count(s) == 0) {
+        enqueue(new DataEncoder(MessageEncoder::upgrade(message->from)), s);
+        upgraded.insert(s);
+      }
+
+      enqueue(new MessageEncoder(message, upgraded.count(s) > 0), s);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+void SocketShard::enqueue(Encoder* encoder, int s)
+{
+  if (outgoing.count(s) > 0) {
+    outgoing[s].push(encoder);
+  } else {
+    // Initialize the outgoing queue.
+    outgoing[s];
+
+    // Allocate and initialize the watcher.
+    ev_io* watcher = new ev_io();
+    watcher->data = encoder;
+
+    if (connecting.count(s) > 0) {
+      // Wait for socket to be connected.
+      connecting.erase(s);
+      ev_io_init(watcher, sending_connect, s, EV_WRITE);
+    } else {
+      ev_io_init(watcher, encoder->sender(), s, EV_WRITE);
+    }
+
+    watch(watcher);
+  }
+}
+
+
+Encoder* SocketShard::next(int s, Option<Socket>* disposed, HttpProxy** proxy)
+{
+  synchronized (this) {
+    // We cannot assume 'sockets.count(s) > 0' here because it's
+    // possible that 's' has been removed with a a call to
+    // SocketManager::close. For example, it could be the case that a
+    // socket has gone to CLOSE_WAIT and the call to 'recv' in
+    // recv_data returned 0 causing SocketManager::close to get
+    // invoked. Later a call to 'send' or 'sendfile' (e.g., in
+    // send_data or send_file) can "succeed" (because the socket is
+    // not "closed" yet because there are still some Socket
+    // references, namely the reference being used in send_data or
+    // send_file!). However, when SocketManger::next is actually
+    // invoked we find out there there is no more data and thus stop
+    // sending.
+    // TODO(benh): Should we actually finish sending the data!?
+    if (sockets.count(s) > 0) {
+      CHECK(outgoing.count(s) > 0);
+
+      if (!outgoing[s].empty()) {
+        // More messages!
+        Encoder* encoder = outgoing[s].front();
+        outgoing[s].pop();
+        return encoder;
+      } else {
+        // No more messages ... erase the outgoing queue.
+        outgoing.erase(s);
+
+        if (dispose.count(s) > 0) {
+          // This is either a temporary socket we created or it's a
+          // socket that we were receiving data from and possibly
+          // sending HTTP responses back on. Clean up either way (the
+          // SocketManager cleans up anything related to the node).
+          if (proxies.count(s) > 0) {
+            *proxy = proxies[s];
+            proxies.erase(s);
+          }
+
+          *disposed = sockets[s];
+
+          dispose.erase(s);
+          upgraded.erase(s);
+          sockets.erase(s);
+        }
+      }
+    }
+  }
+
+  return NULL;
+}
+
+
+void SocketShard::coalesce(int s, DataEncoder* encoder)
+{
+  // Limits how much data gets coalesced so that we don't keep
+  // revisiting encoders that have already been sent.
+  static const size_t MAX_COALESCED = 64;
+
+  synchronized (this) {
+    // Note that we can only coalesce data encoders that are at the
+    // front of the queue (e.g., we can't skip over a file).
+    if (sockets.count(s) > 0 && outgoing.count(s) > 0) {
+      queue<Encoder*>& encoders = outgoing[s];
+      while (!encoders.empty() &&
+             encoders.front()->sender() == send_data &&
+             encoder->coalescing() < MAX_COALESCED) {
+        encoder->coalesce((DataEncoder*) encoders.front());
+        encoders.pop();
+      }
+    }
+  }
+}
+
+
+Option<Socket> SocketShard::release(int s)
+{
+  synchronized (this) {
+    if (sockets.count(s) > 0 && outgoing.count(s) == 0) {
+      CHECK(proxies.count(s) == 0);
+
+      Socket socket = sockets[s];
+
+      dispose.erase(s);
+      connecting.erase(s);
+      upgraded.erase(s);
+      sockets.erase(s);
+
+      return socket;
+    }
+  }
+
+  return Option<Socket>::none();
+}
+
+
+bool SocketShard::close(int s, HttpProxy** proxy)
+{
+  synchronized (this) {
+    if (sockets.count(s) > 0) {
+      // Clean up any remaining encoders for this socket.
+      if (outgoing.count(s) > 0) {
+        while (!outgoing[s].empty()) {
+          Encoder* encoder = outgoing[s].front();
+          delete encoder;
+          outgoing[s].pop();
+        }
+
+        outgoing.erase(s);
+      }
+
+      // Clean up any proxy associated with this socket.
+      if (proxies.count(s) > 0) {
+        *proxy = proxies[s];
+        proxies.erase(s);
+      }
+
+      dispose.erase(s);
+      connecting.erase(s);
+      upgraded.erase(s);
+      sockets.erase(s);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+SocketManager::SocketManager(int _shards)
+{
+  synchronizer(this) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
+
+  CHECK(_shards > 0);
+  for (int i = 0; i < _shards; i++) {
+    shards.push_back(new SocketShard());
+  }
+}
+
+
+SocketManager::~SocketManager()
+{
+  for (size_t i = 0; i < shards.size(); i++) {
+    delete shards[i];
+  }
+}
+
+
+Socket SocketManager::accepted(int s)
+{
+  return shard(s)->accepted(s);
+}
+
+
+void SocketManager::link(ProcessBase* process, const UPID& to)
+{
+  // TODO(benh): The semantics we want to support for link are such
+  // that if there is nobody to link to (local or remote) then an
+  // ExitedEvent gets generated. This functionality has only been
+  // implemented when the link is local, not remote. Of course, if
+  // there is nobody listening on the remote side, then this should
+  // work remotely ... but if there is someone listening remotely just
+  // not at that id, then it will silently continue executing.
+
+  CHECK(process != NULL);
 
   Node node(to.ip, to.port);
 
@@ -1717,9 +2433,17 @@ void SocketManager::link(ProcessBase* process, const UPID& to)
         LOG(FATAL) << "Failed to link, cloexec: " << cloexec.error();
       }
 
+      Try<Nothing> tuned = tune(s);
+      if (tuned.isError()) {
+        VLOG(1) << "Failed to tune socket for link: " << tuned.error();
+      }
+
+      __sync_fetch_and_add(&counters.connects, 1);
+      __sync_fetch_and_add(&counters.sockets, 1);
+
       Socket socket = Socket(s);
 
-      sockets[s] = socket;
+      shard(s)->add(socket, false, false);
       nodes[s] = node;
 
       persists[node] = s;
@@ -1750,13 +2474,7 @@ void SocketManager::link(ProcessBase* process, const UPID& to)
         ev_io_init(watcher, recv_data, s, EV_READ);
       }
 
-      // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
-      }
-
-      // Interrupt the loop.
-      ev_async_send(loop, &async_watcher);
+      watch(watcher);
     }
 
     links[to].insert(process);
@@ -1766,33 +2484,7 @@ void SocketManager::link(ProcessBase* process, const UPID& to)
 
 PID<HttpProxy> SocketManager::proxy(int s)
 {
-  HttpProxy* proxy = NULL;
-
-  synchronized (this) {
-    // This socket might have been asked to get closed (e.g., remote
-    // side hang up) while a process is attempting to handle an HTTP
-    // request. Thus, if there is no more socket, return an empty PID.
-    if (sockets.count(s) > 0) {
-      if (proxies.count(s) > 0) {
-        return proxies[s]->self();
-      } else {
-        proxy = new HttpProxy(sockets[s]);
-        proxies[s] = proxy;
-      }
-    }
-  }
-
-  // Now check if we need to spawn a newly created proxy. Note that we
-  // need to do this outside of the synchronized block above to avoid
-  // a possible deadlock (because spawn eventually synchronizes on
-  // ProcessManager and ProcessManager::cleanup synchronizes on
-  // ProcessManager and then SocketManager, so a deadlock results if
-  // we do spawn within the synchronized block above).
-  if (proxy != NULL) {
-    return spawn(proxy, true);
-  }
-
-  return PID<HttpProxy>();
+  return shard(s)->proxy(s);
 }
 
 
@@ -1800,36 +2492,9 @@ void SocketManager::send(Encoder* encoder, int s, bool persist)
 {
   CHECK(encoder != NULL);
 
-  synchronized (this) {
-    if (sockets.count(s) > 0) {
-      // Update whether or not this socket should get disposed after
-      // there is no more data to send.
-      if (!persist) {
-        dispose.insert(s);
-      }
-
-      if (outgoing.count(s) > 0) {
-        outgoing[s].push(encoder);
-      } else {
-        // Initialize the outgoing queue.
-        outgoing[s];
-
-        // Allocate and initialize the watcher.
-        ev_io* watcher = new ev_io();
-        watcher->data = encoder;
-
-        ev_io_init(watcher, encoder->sender(), s, EV_WRITE);
-
-        synchronized (watchers) {
-          watchers->push(watcher);
-        }
-
-        ev_async_send(loop, &async_watcher);
-      }
-    } else {
-      VLOG(1) << "Attempting to send on a no longer valid socket!";
-      delete encoder;
-    }
+  if (!shard(s)->send(encoder, s, persist)) {
+    VLOG(1) << "Attempting to send on a no longer valid socket!";
+    delete encoder;
   }
 }
 
@@ -1844,146 +2509,169 @@ void SocketManager::send(Message* message)
 {
   CHECK(message != NULL);
 
-  DataEncoder* encoder = new MessageEncoder(message);
-
   Node node(message->to.ip, message->to.port);
 
   synchronized (this) {
+    // Determine if we can send a framed message to this node.
+    bool framing = enable_framing && framed.count(node) > 0;
+
+    // Temporary sockets only get disposed right away (rather than
+    // after being idle for a while) if there is no idle timeout.
+    bool pooling = idle_timeout > 0;
+
     // Check if there is already a socket.
     bool persist = persists.count(node) > 0;
     bool temp = temps.count(node) > 0;
     if (persist || temp) {
       int s = persist ? persists[node] : temps[node];
-      send(encoder, s, persist);
-    } else {
-      // No peristant or temporary socket to the node currently
-      // exists, so we create a temporary one.
-      int s;
-
-      if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        PLOG(FATAL) << "Failed to send, socket";
+      if (shard(s)->send(message, s, persist || pooling, framing)) {
+        if (!persist && idles.erase(s) > 0) {
+          __sync_fetch_and_add(&counters.reuses, 1);
+        }
+        return;
+      } else if (persist) {
+        VLOG(1) << "Attempting to send on a no longer valid socket!";
+        delete message;
+        return;
       }
 
-      Try<Nothing> nonblock = os::nonblock(s);
-      if (nonblock.isError()) {
-        LOG(FATAL) << "Failed to send, nonblock: " << nonblock.error();
-      }
+      // The temporary socket just got disposed (but we haven't been
+      // able to clean up after it yet, see SocketManager::next), so
+      // create a new one.
+      temps.erase(node);
+      nodes.erase(s);
+      idles.erase(s);
+    }
 
-      Try<Nothing> cloexec = os::cloexec(s);
-      if (cloexec.isError()) {
-        LOG(FATAL) << "Failed to send, cloexec: " << cloexec.error();
-      }
+    // No peristant or temporary socket to the node currently exists,
+    // so we create a temporary one.
+    int s;
 
-      sockets[s] = Socket(s);
-      nodes[s] = node;
-      temps[node] = s;
+    if ((s = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      PLOG(FATAL) << "Failed to send, socket";
+    }
 
-      dispose.insert(s);
+    Try<Nothing> nonblock = os::nonblock(s);
+    if (nonblock.isError()) {
+      LOG(FATAL) << "Failed to send, nonblock: " << nonblock.error();
+    }
 
-      // Initialize the outgoing queue.
-      outgoing[s];
+    Try<Nothing> cloexec = os::cloexec(s);
+    if (cloexec.isError()) {
+      LOG(FATAL) << "Failed to send, cloexec: " << cloexec.error();
+    }
 
-      // Try and connect to the node using this socket.
-      sockaddr_in addr;
-      memset(&addr, 0, sizeof(addr));
-      addr.sin_family = PF_INET;
-      addr.sin_port = htons(message->to.port);
-      addr.sin_addr.s_addr = message->to.ip;
+    Try<Nothing> tuned = tune(s);
+    if (tuned.isError()) {
+      VLOG(1) << "Failed to tune socket for send: " << tuned.error();
+    }
 
-      // Allocate and initialize the watcher.
-      ev_io* watcher = new ev_io();
-      watcher->data = encoder;
+    __sync_fetch_and_add(&counters.connects, 1);
+    __sync_fetch_and_add(&counters.sockets, 1);
 
-      if (connect(s, (sockaddr*) &addr, sizeof(addr)) < 0) {
-        if (errno != EINPROGRESS) {
-          PLOG(FATAL) << "Failed to send, connect";
-        }
+    // Try and connect to the node using this socket.
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = PF_INET;
+    addr.sin_port = htons(message->to.port);
+    addr.sin_addr.s_addr = message->to.ip;
 
-        // Initialize watcher for connecting.
-        ev_io_init(watcher, sending_connect, s, EV_WRITE);
-      } else {
-        // Initialize watcher for sending.
-        ev_io_init(watcher, send_data, s, EV_WRITE);
-      }
+    bool connecting = false;
 
-      // Enqueue the watcher.
-      synchronized (watchers) {
-        watchers->push(watcher);
+    if (connect(s, (sockaddr*) &addr, sizeof(addr)) < 0) {
+      if (errno != EINPROGRESS) {
+        PLOG(FATAL) << "Failed to send, connect";
       }
-
-      ev_async_send(loop, &async_watcher);
+      connecting = true;
     }
+
+    nodes[s] = node;
+    temps[node] = s;
+
+    Socket socket = Socket(s);
+
+    shard(s)->add(socket, !pooling, connecting);
+
+    CHECK(shard(s)->send(message, s, pooling, framing));
+
+    // We also "receive" on the socket (just like for links) so that
+    // we notice if the node closes it (e.g., while it's idle) and
+    // clean up, rather than finding out the next time we send.
+    DataDecoder* decoder = new DataDecoder(socket);
+
+    ev_io* watcher = new ev_io();
+    watcher->data = decoder;
+
+    ev_io_init(watcher, recv_data, s, EV_READ);
+
+    watch(watcher);
   }
 }
 
 
 Encoder* SocketManager::next(int s)
 {
+  Option<Socket> disposed = Option<Socket>::none();
   HttpProxy* proxy = NULL; // Non-null if needs to be terminated.
 
-  synchronized (this) {
-    // We cannot assume 'sockets.count(s) > 0' here because it's
-    // possible that 's' has been removed with a a call to
-    // SocketManager::close. For example, it could be the case that a
-    // socket has gone to CLOSE_WAIT and the call to 'recv' in
-    // recv_data returned 0 causing SocketManager::close to get
-    // invoked. Later a call to 'send' or 'sendfile' (e.g., in
-    // send_data or send_file) can "succeed" (because the socket is
-    // not "closed" yet because there are still some Socket
-    // references, namely the reference being used in send_data or
-    // send_file!). However, when SocketManger::next is actually
-    // invoked we find out there there is no more data and thus stop
-    // sending.
-    // TODO(benh): Should we actually finish sending the data!?
-    if (sockets.count(s) > 0) {
-      CHECK(outgoing.count(s) > 0);
-
-      if (!outgoing[s].empty()) {
-        // More messages!
-        Encoder* encoder = outgoing[s].front();
-        outgoing[s].pop();
-        return encoder;
-      } else {
-        // No more messages ... erase the outgoing queue.
-        outgoing.erase(s);
-
-        if (dispose.count(s) > 0) {
-          // This is either a temporary socket we created or it's a
-          // socket that we were receiving data from and possibly
-          // sending HTTP responses back on. Clean up either way.
-          if (nodes.count(s) > 0) {
-            const Node& node = nodes[s];
-            CHECK(temps.count(node) > 0 && temps[node] == s);
-            temps.erase(node);
-            nodes.erase(s);
-          }
+  Encoder* encoder = shard(s)->next(s, &disposed, &proxy);
 
-          if (proxies.count(s) > 0) {
-            proxy = proxies[s];
-            proxies.erase(s);
+  if (encoder == NULL && disposed.isNone() && idle_timeout > 0) {
+    // Nothing more to send right now, so if this is a temporary
+    // socket keep it around (idle) for a while in case there is more
+    // to send to the node later (see SocketManager::expire).
+    synchronized (this) {
+      if (nodes.count(s) > 0) {
+        const Node& node = nodes[s];
+        if (temps.count(node) > 0 && temps[node] == s) {
+          idles[s] = Clock::now();
+          if (expiring.count(s) == 0) {
+            expiring.insert(s);
+            Timer::create(
+                Seconds(idle_timeout),
+                lambda::bind(&SocketManager::expire, this, s));
           }
+        }
+      }
+    }
+  }
 
-          dispose.erase(s);
-          sockets.erase(s);
-
-          // We don't actually close the socket (we wait for the Socket
-          // abstraction to close it once there are no more references),
-          // but we do shutdown the receiving end so any DataDecoder
-          // will get cleaned up (which might have the last reference).
-          shutdown(s, SHUT_RD);
+  if (disposed.isSome()) {
+    // Clean up after the socket if it was a temporary socket we
+    // created (unless SocketManager::send already did). Note that
+    // we're still holding on to the socket so it can't be closed
+    // (and reused) before we're done.
+    synchronized (this) {
+      if (nodes.count(s) > 0) {
+        const Node& node = nodes[s];
+        if (temps.count(node) > 0 && temps[node] == s) {
+          temps.erase(node);
         }
+        nodes.erase(s);
       }
     }
+
+    // We don't actually close the socket (we wait for the Socket
+    // abstraction to close it once there are no more references),
+    // but we do shutdown the receiving end so any DataDecoder will
+    // get cleaned up (which might have the last reference).
+    shutdown(s, SHUT_RD);
   }
 
   // We terminate the proxy outside the synchronized block to avoid
   // possible deadlock between the ProcessManager and SocketManager
-  // (see comment in SocketManager::proxy for more information).
+  // (see comment in SocketShard::proxy for more information).
   if (proxy != NULL) {
     terminate(proxy);
   }
 
-  return NULL;
+  return encoder;
+}
+
+
+void SocketManager::coalesce(int s, DataEncoder* encoder)
+{
+  shard(s)->coalesce(s, encoder);
 }
 
 
@@ -1997,18 +2685,7 @@ void SocketManager::close(int s)
     // it and then later the read side of the socket gets closed so we
     // try and close it again). Thus, ignore the request if we don't
     // know about the socket.
-    if (sockets.count(s) > 0) {
-      // Clean up any remaining encoders for this socket.
-      if (outgoing.count(s) > 0) {
-        while (!outgoing[s].empty()) {
-          Encoder* encoder = outgoing[s].front();
-          delete encoder;
-          outgoing[s].pop();
-        }
-
-        outgoing.erase(s);
-      }
-
+    if (shard(s)->close(s, &proxy)) {
       // Clean up after sockets used for node communication.
       if (nodes.count(s) > 0) {
         const Node& node = nodes[s];
@@ -2024,14 +2701,7 @@ void SocketManager::close(int s)
         nodes.erase(s);
       }
 
-      // Clean up any proxy associated with this socket.
-      if (proxies.count(s) > 0) {
-        proxy = proxies[s];
-        proxies.erase(s);
-      }
-
-      dispose.erase(s);
-      sockets.erase(s);
+      idles.erase(s);
     }
   }
 
@@ -2058,6 +2728,53 @@ void SocketManager::close(int s)
 }
 
 
+void SocketManager::expire(int s)
+{
+  Option<Socket> released = Option<Socket>::none();
+
+  synchronized (this) {
+    expiring.erase(s);
+
+    // Nothing to do if the socket is not idle anymore (we'll try
+    // again once it becomes idle again).
+    if (idles.count(s) > 0) {
+      double elapsed = Clock::now() - idles[s];
+      if (elapsed < idle_timeout) {
+        // It got used since the timer was created, check back later.
+        expiring.insert(s);
+        Timer::create(
+            Seconds(idle_timeout - elapsed),
+            lambda::bind(&SocketManager::expire, this, s));
+      } else {
+        idles.erase(s);
+
+        // Note that the socket might have started sending again
+        // before it got marked idle (see SocketManager::next), in
+        // which case we leave it be.
+        released = shard(s)->release(s);
+
+        if (released.isSome()) {
+          CHECK(nodes.count(s) > 0);
+          const Node& node = nodes[s];
+          if (temps.count(node) > 0 && temps[node] == s) {
+            temps.erase(node);
+          }
+
+          nodes.erase(s);
+        }
+      }
+    }
+  }
+
+  // Just like in SocketManager::next we don't close the socket but
+  // shutdown the receiving end so the DataDecoder will get cleaned up
+  // (and we're holding on to the socket until we've done so).
+  if (released.isSome()) {
+    shutdown(s, SHUT_RD);
+  }
+}
+
+
 void SocketManager::exited(const Node& node)
 {
   // TODO(benh): It would be cleaner if this routine could call back
@@ -2065,6 +2782,11 @@ void SocketManager::exited(const Node& node)
   // ourselves that the accesses to each Process object will always be
   // valid.
   synchronized (this) {
+    // Forget that the node can receive framed messages since it
+    // might get restarted (at the same ip and port) by a binary that
+    // can't (we'll learn again if it can from its next message).
+    framed.erase(node);
+
     list<UPID> removed;
     // Look up all linked processes.
     foreachpair (const UPID& linkee, set<ProcessBase*>& processes, links) {
@@ -2119,17 +2841,33 @@ void SocketManager::exited(ProcessBase* process)
 }
 
 
-ProcessManager::ProcessManager(const string& _delegate)
+void SocketManager::framing(const Node& node)
+{
+  synchronized (this) {
+    framed.insert(node);
+  }
+}
+
+
+ProcessManager::ProcessManager(const string& _delegate, int threads)
   : delegate(_delegate)
 {
   synchronizer(processes) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
-  synchronizer(runq) = SYNCHRONIZED_INITIALIZER_RECURSIVE;
+  CHECK(threads > 0);
+  for (int i = 0; i < threads; i++) {
+    runqs.push_back(new RunQueue(i));
+  }
   running = 0;
   __sync_synchronize(); // Ensure write to 'running' visible in other threads.
 }
 
 
-ProcessManager::~ProcessManager() {}
+ProcessManager::~ProcessManager()
+{
+  foreach (RunQueue* runq, runqs) {
+    delete runq;
+  }
+}
 
 
 ProcessReference ProcessManager::use(const UPID& pid)
@@ -2160,6 +2898,27 @@ bool ProcessManager::handle(
   if (libprocess(request)) {
     Message* message = parse(request);
     if (message != NULL) {
+      const Option<string> framing = Option<string>::some(LIBPROCESS_FRAMING);
+
+      // Remember if the sender can receive framed messages so we can
+      // upgrade our connections to it (see SocketManager::send). Note
+      // that anyone sending us an upgrade request can also receive
+      // framed messages.
+      bool upgrade = request->headers.get("Upgrade") == framing;
+
+      if (enable_framing &&
+          (upgrade || request->headers.get("Libprocess-Framing") == framing)) {
+        socket_manager->framing(Node(message->from.ip, message->from.port));
+      }
+
+      // An upgrade request doesn't carry a message (the decoder has
+      // already switched to decoding framed messages).
+      if (upgrade) {
+        delete message;
+        delete request;
+        return true;
+      }
+
       delete request;
       // TODO(benh): Use the sender PID in order to capture
       // happens-before timing relationships for testing.
@@ -2249,6 +3008,23 @@ bool ProcessManager::handle(
 }
 
 
+bool ProcessManager::handle(
+    const Socket& socket,
+    Message* message)
+{
+  CHECK(message != NULL);
+
+  // Framed messages only include the id of the receiver (which is
+  // always local).
+  message->to.ip = __ip__;
+  message->to.port = __port__;
+
+  // TODO(benh): Use the sender PID in order to capture
+  // happens-before timing relationships for testing.
+  return deliver(message->to, new MessageEvent(message));
+}
+
+
 bool ProcessManager::deliver(
     ProcessBase* receiver,
     Event* event,
@@ -2344,30 +3120,40 @@ void ProcessManager::resume(ProcessBase* process)
     process->state = ProcessBase::RUNNING;
     try { process->initialize(); }
     catch (...) { terminate = true; }
+  } else {
+    process->state = ProcessBase::RUNNING;
   }
 
   while (!terminate && !blocked) {
-    Event* event = NULL;
-
-    process->lock();
-    {
-      if (process->events.size() > 0) {
-        event = process->events.front();
-        process->events.pop_front();
-        process->state = ProcessBase::RUNNING;
-      } else {
-        process->state = ProcessBase::BLOCKED;
+    // Events are drained in batches (see EventQueue) so we only do an
+    // atomic operation once per batch rather than once per event.
+    Event* event = process->events->dequeue();
+
+    if (event == NULL) {
+      // N.B. This must happen before we set the state below since
+      // another thread might start running the process after that.
+      process->metrics->blocked();
+
+      // There are no more events so block, but only after checking
+      // that no events got enqueued after we tried to dequeue (in
+      // which case either the enqueuer saw us as BLOCKED and put us
+      // back on a run queue, or we keep running).
+      process->state = ProcessBase::BLOCKED;
+      __sync_synchronize(); // Make 'state' visible before checking.
+      if (process->events->empty() ||
+          !__sync_bool_compare_and_swap(
+              &process->state,
+              ProcessBase::BLOCKED,
+              ProcessBase::RUNNING)) {
         blocked = true;
       }
-    }
-    process->unlock();
-
-    if (!blocked) {
-      CHECK(event != NULL);
-
+    } else {
       // Determine if we should terminate.
       terminate = event->is<TerminateEvent>();
 
+      // Only sampled events get timed (see ProcessMetrics).
+      uint64_t start = process->metrics->dequeue(*event);
+
       // Now service the event.
       try {
         process->serve(*event);
@@ -2382,6 +3168,10 @@ void ProcessManager::resume(ProcessBase* process)
         terminate = true;
       }
 
+      if (start != 0) {
+        process->metrics->served(*event, start);
+      }
+
       delete event;
 
       if (terminate) {
@@ -2415,29 +3205,30 @@ void ProcessManager::cleanup(ProcessBase* process)
       __sync_synchronize();
     }
 
-    process->lock();
-    {
-      // Free any pending events.
-      while (!process->events.empty()) {
-        Event* event = process->events.front();
-        process->events.pop_front();
-        delete event;
-      }
+    // Mark the process as finished before freeing pending events so
+    // that any events enqueued from now on get deleted immediately
+    // (see ProcessBase::enqueue). Note that we can drain the event
+    // queue because we are the thread running the process.
+    process->state = ProcessBase::FINISHED;
+    __sync_synchronize(); // Make 'state' visible to enqueuers.
 
-      processes.erase(process->pid.id);
- 
-      // Lookup gate to wake up waiting threads.
-      map<ProcessBase*, Gate*>::iterator it = gates.find(process);
-      if (it != gates.end()) {
-        gate = it->second;
-        // N.B. The last thread that leaves the gate also free's it.
-        gates.erase(it);
-      }
+    // Free any pending events.
+    Event* event = NULL;
+    while ((event = process->events->dequeue()) != NULL) {
+      delete event;
+    }
 
-      CHECK(process->refs == 0);
-      process->state = ProcessBase::FINISHED;
+    processes.erase(process->pid.id);
+
+    // Lookup gate to wake up waiting threads.
+    map<ProcessBase*, Gate*>::iterator it = gates.find(process);
+    if (it != gates.end()) {
+      gate = it->second;
+      // N.B. The last thread that leaves the gate also free's it.
+      gates.erase(it);
     }
-    process->unlock();
+
+    CHECK(process->refs == 0);
 
     // Note that we don't remove the process from the clock during
     // cleanup, but rather the clock is reset for a process when it is
@@ -2549,18 +3340,31 @@ bool ProcessManager::wait(const UPID& pid)
       gate = gates[process];
       old = gate->approach();
 
-      // Check if it is runnable in order to donate this thread.
+      // Check if it is runnable in order to donate this thread. The
+      // process should be on the run queue it has affinity with, but
+      // since we don't hold that run queue's lock while reading the
+      // affinity we check the remaining run queues too.
       if (process->state == ProcessBase::BOTTOM ||
           process->state == ProcessBase::READY) {
-        synchronized (runq) {
-          list<ProcessBase*>::iterator it =
-            find(runq.begin(), runq.end(), process);
-          if (it != runq.end()) {
-            runq.erase(it);
-          } else {
-            // Another thread has resumed the process ...
-            process = NULL;
+        bool found = false;
+        int affinity = process->affinity >= 0 ? process->affinity : 0;
+        for (size_t i = 0; !found && i < runqs.size(); i++) {
+          RunQueue* runq = runqs[(affinity + i) % runqs.size()];
+          runq->lock();
+          {
+            deque<ProcessBase*>::iterator it =
+              find(runq->processes.begin(), runq->processes.end(), process);
+            if (it != runq->processes.end()) {
+              runq->processes.erase(it);
+              found = true;
+            }
           }
+          runq->unlock();
+        }
+
+        if (!found) {
+          // Another thread has resumed the process ...
+          process = NULL;
         }
       } else {
         // Process is not runnable, so no need to donate ...
@@ -2599,41 +3403,78 @@ void ProcessManager::enqueue(ProcessBase* process)
 {
   CHECK(process != NULL);
 
-  // TODO(benh): Check and see if this process has it's own thread. If
-  // it does, push it on that threads runq, and wake up that thread if
-  // it's not running. Otherwise, check and see which thread this
-  // process was last running on, and put it on that threads runq.
+  // Put the process on the run queue of the thread it last ran on
+  // (so that it keeps it's affinity with that thread). A process that
+  // has never run goes on the run queue of the thread that is
+  // enqueueing it (e.g., spawning it) if that is a processing thread,
+  // otherwise we spread such processes across all the run queues.
+  // Note that we don't need to check if the process is already on a
+  // run queue since a process only gets enqueued when it transitions
+  // from BLOCKED to READY (see ProcessBase::enqueue).
+  int affinity = process->affinity;
+
+  if (affinity < 0) {
+    if (__process__ != NULL && __process__->affinity >= 0) {
+      affinity = __process__->affinity;
+    } else {
+      static unsigned int next = 0;
+      affinity = __sync_fetch_and_add(&next, 1) % runqs.size();
+    }
+    process->affinity = affinity;
+  }
+
+  CHECK(affinity < (int) runqs.size());
 
-  synchronized (runq) {
-    CHECK(find(runq.begin(), runq.end(), process) == runq.end());
-    runq.push_back(process);
+  RunQueue* runq = runqs[affinity];
+
+  runq->lock();
+  {
+    runq->processes.push_back(process);
   }
-    
-  // Wake up the processing thread if necessary.
-  gate->open();
+  runq->unlock();
+
+  // Wake up a processing thread if necessary. We only need to wake up
+  // one thread since whichever thread wakes up will steal the process
+  // if it isn't the thread that owns the run queue.
+  gate->open(false);
 }
 
 
-ProcessBase* ProcessManager::dequeue()
+ProcessBase* ProcessManager::dequeue(int thread)
 {
-  // TODO(benh): Remove a process from this thread's runq. If there
-  // are no processes to run, and this is not a dedicated thread, then
-  // steal one from another threads runq.
+  CHECK(thread >= 0 && thread < (int) runqs.size());
 
-  ProcessBase* process = NULL;
+  // Try this thread's run queue first and then try and steal a
+  // process from the other threads' run queues (starting with the
+  // next thread so that we don't all try and steal from the same
+  // thread at once).
+  for (size_t i = 0; i < runqs.size(); i++) {
+    RunQueue* runq = runqs[(thread + i) % runqs.size()];
 
-  synchronized (runq) {
-    if (!runq.empty()) {
-      process = runq.front();
-      runq.pop_front();
-      // Increment the running count of processes in order to support
-      // the Clock::settle() operation (this must be done atomically
-      // with removing the process from the runq).
-      __sync_fetch_and_add(&running, 1);
+    ProcessBase* process = NULL;
+
+    runq->lock();
+    {
+      if (!runq->processes.empty()) {
+        process = runq->processes.front();
+        runq->processes.pop_front();
+        // Increment the running count of processes in order to
+        // support the Clock::settle() operation (this must be done
+        // atomically with removing the process from the run queue).
+        __sync_fetch_and_add(&running, 1);
+      }
+    }
+    runq->unlock();
+
+    if (process != NULL) {
+      // The process now has affinity with this thread (which is only
+      // different if we stole it).
+      process->affinity = thread;
+      return process;
     }
   }
 
-  return process;
+  return NULL;
 }
 
 
@@ -2643,30 +3484,41 @@ void ProcessManager::settle()
   do {
     usleep(10000);
     done = true;
-    // Hopefully this is the only place we acquire both these locks.
-    synchronized (runq) {
-      synchronized (timeouts) {
-        CHECK(Clock::paused()); // Since another thread could resume the clock!
+    // We acquire all of the run queue locks (always in the same
+    // order) so that no process can get enqueued or dequeued while we
+    // check. Hopefully this is the only place we acquire both the run
+    // queue locks and the timeouts lock.
+    foreach (RunQueue* runq, runqs) {
+      runq->lock();
+    }
 
-        if (!runq.empty()) {
-          done = false;
-        }
+    synchronized (timeouts) {
+      CHECK(Clock::paused()); // Since another thread could resume the clock!
 
-        __sync_synchronize(); // Read barrier for 'running'.
-        if (running > 0) {
+      foreach (RunQueue* runq, runqs) {
+        if (!runq->processes.empty()) {
           done = false;
         }
+      }
 
-        if (timeouts->size() > 0 &&
-            timeouts->begin()->first <= clock::current) {
-          done = false;
-        }
+      __sync_synchronize(); // Read barrier for 'running'.
+      if (running > 0) {
+        done = false;
+      }
 
-        if (pending_timers) {
-          done = false;
-        }
+      Option<double> next = timeouts->next();
+      if (next.isSome() && next.get() <= clock::current) {
+        done = false;
+      }
+
+      if (pending_timers > 0) {
+        done = false;
       }
     }
+
+    foreach (RunQueue* runq, runqs) {
+      runq->unlock();
+    }
   } while (!done);
 }
 
@@ -2688,16 +3540,12 @@ Timer Timer::create(
 
   // Add the timer.
   synchronized (timeouts) {
-    if (timeouts->size() == 0 ||
-        timer.timeout().value() < timeouts->begin()->first) {
+    Option<double> next = timeouts->next();
+    timeouts->add(timer.id, timer.timeout().value(), timer);
+    if (next.isNone() || timer.timeout().value() < next.get()) {
       // Need to interrupt the loop to update/set timer repeat.
-      (*timeouts)[timer.timeout().value()].push_back(timer);
       update_timer = true;
       ev_async_send(loop, &async_watcher);
-    } else {
-      // Timer repeat is adequate, just add the timeout.
-      CHECK(timeouts->size() >= 1);
-      (*timeouts)[timer.timeout().value()].push_back(timer);
     }
   }
 
@@ -2709,18 +3557,8 @@ bool Timer::cancel(const Timer& timer)
 {
   bool canceled = false;
   synchronized (timeouts) {
-    // Check if the timeout is still pending, and if so, erase it. In
-    // addition, erase an empty list if we just removed the last
-    // timeout.
-    // TODO(benh): If two timers are created with the same timeout,
-    // this will erase *both*. Fix this!
-    if (timeouts->count(timer.timeout().value()) > 0) {
-      canceled = true;
-      (*timeouts)[timer.timeout().value()].remove(timer);
-      if ((*timeouts)[timer.timeout().value()].empty()) {
-        timeouts->erase(timer.timeout().value());
-      }
-    }
+    // Check if the timer is still pending, and if so, erase it.
+    canceled = timeouts->cancel(timer.id);
   }
 
   return canceled;
@@ -2733,14 +3571,18 @@ ProcessBase::ProcessBase(const string& id)
 
   state = ProcessBase::BOTTOM;
 
-  pthread_mutex_init(&m, NULL);
+  events = new EventQueue();
 
   refs = 0;
 
+  affinity = -1;
+
   pid.id = id != "" ? id : ID::generate();
   pid.ip = __ip__;
   pid.port = __port__;
 
+  metrics = new ProcessMetrics(pid.id, event_sampling);
+
   // If using a manual clock, try and set current time of process
   // using happens before relationship between creator and createe!
   if (Clock::paused()) {
@@ -2758,7 +3600,13 @@ ProcessBase::ProcessBase(const string& id)
 }
 
 
-ProcessBase::~ProcessBase() {}
+ProcessBase::~ProcessBase()
+{
+  // Frees any events enqueued after the process was cleaned up.
+  delete events;
+
+  delete metrics;
+}
 
 
 void ProcessBase::enqueue(Event* event, bool inject)
@@ -2811,28 +3659,21 @@ void ProcessBase::enqueue(Event* event, bool inject)
     }
   }
 
-  lock();
-  {
-    if (state != FINISHED) {
-      if (!inject) {
-        events.push_back(event);
-      } else {
-        events.push_front(event);
-      }
+  if (state == FINISHED) {
+    delete event;
+    return;
+  }
 
-      if (state == BLOCKED) {
-        state = READY;
-        process_manager->enqueue(this);
-      }
+  metrics->enqueue(event);
 
-      CHECK(state == BOTTOM ||
-            state == READY ||
-            state == RUNNING);
-    } else {
-      delete event;
-    }
+  events->enqueue(event, inject);
+
+  // If the process is blocked then we're responsible for making it
+  // runnable again (see ProcessManager::resume for the other half of
+  // this handshake).
+  if (__sync_bool_compare_and_swap(&state, BLOCKED, READY)) {
+    process_manager->enqueue(this);
   }
-  unlock();
 }
 
 
@@ -3160,13 +4001,7 @@ Future<short> poll(int fd, short events)
 
   ev_io_init(watcher, polled, fd, events);
 
-  // Enqueue the watcher.
-  synchronized (watchers) {
-    watchers->push(watcher);
-  }
-
-  // Interrupt the loop.
-  ev_async_send(loop, &async_watcher);
+  watch(watcher);
 
   return future;
 }
@@ -3376,11 +4211,13 @@ namespace internal {
 
 void dispatch(
     const UPID& pid,
-    const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& f)
+    const std::tr1::shared_ptr<std::tr1::function<void(ProcessBase*)> >& f,
+    const std::type_info* functionType)
 {
   process::initialize();
 
-  process_manager->deliver(pid, new DispatchEvent(f), __process__);
+  process_manager->deliver(
+      pid, new DispatchEvent(f, functionType), __process__);
 }
 
 } // namespace internal {
@@ -0,0 +1,270 @@
+#ifndef __PROCESS_METRICS_HPP__
+#define __PROCESS_METRICS_HPP__
+
+#include <cxxabi.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <map>
+#include <string>
+
+#include <process/event.hpp>
+#include <process/statistics.hpp>
+
+#include <stout/duration.hpp>
+
+
+namespace process {
+
+// Instrumentation of the events served by a process. Processes are
+// aggregated by type, i.e., by their id without the '(N)' suffix
+// added by ID::generate (so that, e.g., every slave observer shares
+// the same metrics), using counters and histograms (see
+// process/statistics.hpp) that show up in /statistics/snapshot.json
+// as:
+//
+//   libprocess/<type>/event_queue_size
+//   libprocess/<type>/event_queue_latency/{count,mean,p50,...}
+//   libprocess/<type>/handler_time/<handler>/{count,mean,p50,...}
+//
+// where the queue size is summed over the instances, the latency is
+// the time an event waited in the queue before it got served and a
+// handler is a message name, the type of a dispatched method,
+// "http", "exited" or "terminate". Since there is one set of
+// metrics per type (and handler) of process, and they have no time
+// series, they never grow with the number of processes or with time.
+//
+// The instrumentation can be disabled (see process::sample), but is
+// meant to be left on: only one out of every 'period' events (64 by
+// default) gets timestamped (and hence timed),
+// so the common case costs one atomic increment per enqueued event
+// (used for both the queue size and the sampling). Everything else
+// is only accessed by the thread running the process (see
+// ProcessManager::resume).
+class ProcessMetrics
+{
+public:
+  // A zero period disables the instrumentation.
+  ProcessMetrics(const std::string& id, uint32_t _period)
+    : period(_period),
+      type(_period != 0 ? Type::get(id) : NULL),
+      enqueued(0),
+      dequeued(0),
+      size(0) {}
+
+  ~ProcessMetrics()
+  {
+    if (size != 0) {
+      type->size.decrement(size);
+    }
+  }
+
+  // Safe to call from any thread.
+  void enqueue(Event* event)
+  {
+    if (period != 0 &&
+        __sync_fetch_and_add(&enqueued, 1) % period == 0) {
+      event->enqueued = now();
+    }
+  }
+
+  // Invoked by the thread running the process before the event gets
+  // served. Returns the time serving started for sampled events, 0
+  // otherwise.
+  uint64_t dequeue(const Event& event)
+  {
+    dequeued++;
+    return event.enqueued != 0 ? now() : 0;
+  }
+
+  // Invoked by the thread running the process after a sampled event
+  // has been served (but before it gets deleted).
+  void served(const Event& event, uint64_t start)
+  {
+    uint64_t stop = now();
+
+    type->latency.record(
+        Nanoseconds(start > event.enqueued ? start - event.enqueued : 0));
+
+    const std::string key = ProcessMetrics::key(event);
+    std::map<std::string, Histogram*>::iterator it = handlers.find(key);
+    if (it == handlers.end()) {
+      it = handlers.insert(std::make_pair(key, type->handler(key))).first;
+    }
+    it->second->record(Nanoseconds(stop - start));
+
+    update(__sync_fetch_and_add(&enqueued, 0) - dequeued);
+  }
+
+  // Invoked by the thread running the process when it is about to
+  // block (i.e., its queue is empty), so that the queue size doesn't
+  // get stuck at the last sampled value.
+  void blocked()
+  {
+    if (period != 0) {
+      update(0);
+    }
+  }
+
+private:
+  // The metrics shared by every process of a type. These are never
+  // deleted, but there is only a bounded number of them (one per
+  // type of process).
+  struct Type
+  {
+    explicit Type(const std::string& _prefix)
+      : prefix(_prefix),
+        size(prefix + "/event_queue_size"),
+        latency(prefix + "/event_queue_latency") {}
+
+    // Returns the metrics for the type of the process with the
+    // specified id.
+    static Type* get(const std::string& id)
+    {
+      // Strip the '(N)' suffix added by ID::generate.
+      std::string name = id;
+      if (!name.empty() && name[name.size() - 1] == ')') {
+        size_t index = name.rfind('(');
+        if (index != std::string::npos) {
+          name = name.substr(0, index);
+        }
+      }
+
+      if (name.empty()) {
+        name = "anonymous";
+      }
+
+      pthread_mutex_lock(&mutex);
+
+      static std::map<std::string, Type*>* types =
+        new std::map<std::string, Type*>();
+
+      Type*& type = (*types)[name];
+      if (type == NULL) {
+        type = new Type("libprocess/" + name);
+      }
+
+      pthread_mutex_unlock(&mutex);
+
+      return type;
+    }
+
+    // Returns the histogram for the handler with the specified key.
+    // Processes cache the result, so this only locks the first time
+    // a process serves an event with the handler.
+    Histogram* handler(const std::string& key)
+    {
+      pthread_mutex_lock(&mutex);
+
+      Histogram*& histogram = handlers[key];
+      if (histogram == NULL) {
+        histogram = new Histogram(prefix + "/handler_time/" + demangle(key));
+      }
+
+      pthread_mutex_unlock(&mutex);
+
+      return histogram;
+    }
+
+    const std::string prefix;
+    Counter size;
+    Histogram latency;
+    std::map<std::string, Histogram*> handlers;
+
+    static pthread_mutex_t mutex;
+  };
+
+  // Returns the key of the handler that serves the event.
+  static std::string key(const Event& event)
+  {
+    std::string key;
+
+    struct KeyVisitor : EventVisitor
+    {
+      KeyVisitor(std::string* _key) : key(_key) {}
+
+      virtual void visit(const MessageEvent& event)
+      {
+        *key = event.message->name;
+      }
+
+      virtual void visit(const DispatchEvent& event)
+      {
+        *key = event.functionType != NULL
+          ? event.functionType->name()
+          : "dispatch";
+      }
+
+      virtual void visit(const HttpEvent& event) { *key = "http"; }
+      virtual void visit(const ExitedEvent& event) { *key = "exited"; }
+      virtual void visit(const TerminateEvent& event) { *key = "terminate"; }
+
+      std::string* key;
+    } visitor(&key);
+
+    event.visit(&visitor);
+
+    return key;
+  }
+
+  // Returns the demangled name if it's a mangled type name,
+  // otherwise the name itself.
+  static std::string demangle(const std::string& name)
+  {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name.c_str(), NULL, NULL, &status);
+    if (status != 0 || demangled == NULL) {
+      return name;
+    }
+    std::string result(demangled);
+    free(demangled);
+    return result;
+  }
+
+  // Adds the change in the queue size of this process to the queue
+  // size of its type.
+  void update(uint64_t current)
+  {
+    if (current != size) {
+      type->size.increment((int64_t) current - (int64_t) size);
+      size = current;
+    }
+  }
+
+  // Returns the monotonic time in nanoseconds (unaffected by the
+  // libprocess Clock being paused or advanced).
+  static uint64_t now()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  }
+
+  // Not copyable, not assignable.
+  ProcessMetrics(const ProcessMetrics&);
+  ProcessMetrics& operator = (const ProcessMetrics&);
+
+  // Events are sampled one out of every 'period'.
+  const uint32_t period;
+
+  Type* const type;
+
+  // Events enqueued (atomically updated) and dequeued.
+  volatile uint64_t enqueued;
+  uint64_t dequeued;
+
+  // Queue size last added to the queue size of the type.
+  uint64_t size;
+
+  // Handler histograms of the type, cached by key.
+  std::map<std::string, Histogram*> handlers;
+};
+
+
+pthread_mutex_t ProcessMetrics::Type::mutex = PTHREAD_MUTEX_INITIALIZER;
+
+} // namespace process {
+
+#endif // __PROCESS_METRICS_HPP__
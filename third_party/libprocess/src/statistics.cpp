@@ -1,8 +1,15 @@
 #include <float.h> // For DBL_MAX.
+#include <limits.h> // For INT_MAX.
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
 
 #include <glog/logging.h>
 
+#include <algorithm>
 #include <map>
+#include <new>
 #include <string>
 #include <vector>
 
@@ -10,6 +17,7 @@
 #include <process/dispatch.hpp>
 #include <process/future.hpp>
 #include <process/http.hpp>
+#include <process/id.hpp>
 #include <process/process.hpp>
 #include <process/statistics.hpp>
 
@@ -31,11 +39,96 @@ using std::vector;
 
 namespace process {
 
+// Global statistics.
+Statistics* statistics = NULL;
+
+
+// Counters and histograms that currently exist (by name), see
+// Counter and Histogram. Created on demand (rather than statically)
+// since counters and histograms might get created during static
+// initialization.
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::multimap<string, Counter*>* counters = NULL;
+static std::multimap<string, Histogram*>* histograms = NULL;
+
+
+// Returns the index of the calling thread, used to pick the shard of
+// a counter or histogram it updates. Threads get consecutive indices
+// (the first time they update something) so that the first threads
+// each get their own shard.
+static int threadIndex()
+{
+  static int next = 0;
+  static __thread int index = -1;
+  if (index == -1) {
+    index = __sync_fetch_and_add(&next, 1) & INT_MAX;
+  }
+  return index;
+}
+
+
+// Returns the (sub-)bucket of a histogram for the specified value
+// (see Histogram). Values less than 32 get their own bucket, larger
+// values get one of 16 buckets for their power of two.
+static int bucket(uint64_t value)
+{
+  if (value < 32) {
+    return value;
+  }
+  int shift = (63 - __builtin_clzll(value)) - 4;
+  return (shift << 4) + (value >> shift);
+}
+
+
+// Returns the largest value that falls in the specified bucket.
+static uint64_t bound(int bucket)
+{
+  if (bucket < 32) {
+    return bucket;
+  }
+  int shift = (bucket >> 4) - 1;
+  uint64_t base = (bucket & 15) + 16;
+  return ((base + 1) << shift) - 1;
+}
+
+
+// Returns (an upper bound on) the specified percentile of the values
+// in the buckets, but never more than 'max'.
+static uint64_t percentile(const uint64_t* buckets, double p, uint64_t max)
+{
+  uint64_t count = 0;
+  for (int i = 0; i < Histogram::BUCKETS; i++) {
+    count += buckets[i];
+  }
+
+  // The (1 based) rank of the value that is the percentile, i.e.,
+  // the nearest rank (rounding down would make tail percentiles of
+  // small samples come out low, e.g., p99 of 50 values wouldn't be
+  // the largest value).
+  uint64_t rank = (uint64_t) ceil(p * count);
+  if (rank < 1) {
+    rank = 1;
+  } else if (rank > count) {
+    rank = count;
+  }
+
+  uint64_t seen = 0;
+  for (int i = 0; i < Histogram::BUCKETS; i++) {
+    seen += buckets[i];
+    if (seen >= rank) {
+      return std::min(bound(i), max);
+    }
+  }
+
+  return max;
+}
+
+
 class StatisticsProcess : public Process<StatisticsProcess>
 {
 public:
-  StatisticsProcess(const Seconds& _window)
-    : ProcessBase("statistics"),
+  StatisticsProcess(const string& id, const Seconds& _window)
+    : ProcessBase(id),
       window(_window)
   {}
 
@@ -53,8 +146,8 @@ public:
 protected:
   virtual void initialize()
   {
-    route("snapshot.json", &StatisticsProcess::snapshot);
-    route("series.json", &StatisticsProcess::series);
+    route("/snapshot.json", &StatisticsProcess::snapshot);
+    route("/series.json", &StatisticsProcess::series);
   }
 
 private:
@@ -165,6 +258,66 @@ Future<Response> StatisticsProcess::snapshot(const Request& request)
     array.values.push_back(object);
   }
 
+  // Now aggregate the counters and histograms (by name).
+  map<string, double> values;
+
+  pthread_mutex_lock(&mutex);
+  {
+    if (counters != NULL) {
+      foreachvalue (Counter* counter, *counters) {
+        values[counter->name] += counter->value();
+      }
+    }
+
+    if (histograms != NULL) {
+      std::multimap<string, Histogram*>::const_iterator it =
+        histograms->begin();
+
+      while (it != histograms->end()) {
+        const string& name = it->first;
+
+        vector<uint64_t> buckets(Histogram::BUCKETS, 0);
+        uint64_t sum = 0;
+        uint64_t max = 0;
+
+        for (; it != histograms->end() && it->first == name; ++it) {
+          it->second->aggregate(&buckets[0], &sum, &max);
+        }
+
+        uint64_t count = 0;
+        foreach (uint64_t value, buckets) {
+          count += value;
+        }
+
+        // Durations are in nanoseconds but reported in milliseconds.
+        values[name + "/count"] = count;
+        if (count > 0) {
+          static const char* names[] = { "/p50", "/p90", "/p99", "/p999" };
+          static const double percentiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+          for (int i = 0; i < 4; i++) {
+            values[name + names[i]] =
+              percentile(&buckets[0], percentiles[i], max) / 1000000.0;
+          }
+
+          values[name + "/mean"] = sum / 1000000.0 / count;
+          values[name + "/max"] = max / 1000000.0;
+        }
+      }
+    }
+  }
+  pthread_mutex_unlock(&mutex);
+
+  double now = Clock::now();
+
+  foreachpair (const string& name, double value, values) {
+    JSON::Object object;
+    object.values["name"] = name;
+    object.values["time"] = now;
+    object.values["value"] = value;
+    array.values.push_back(object);
+  }
+
   return OK(array, request.query.get("jsonp"));
 }
 
@@ -213,7 +366,14 @@ Future<Response> StatisticsProcess::series(const Request& request)
 
 Statistics::Statistics(const Seconds& window)
 {
-  process = new StatisticsProcess(window);
+  initialize();
+
+  // Only the global statistics get the well known id (so that they
+  // can be found at /statistics), everybody else gets a unique id.
+  process = new StatisticsProcess(
+      statistics == NULL ? "statistics" : ID::generate("statistics"),
+      window);
+
   spawn(process);
 }
 
@@ -251,4 +411,182 @@ void Statistics::decrement(const string& name)
   dispatch(process, &StatisticsProcess::decrement, name);
 }
 
+
+// Returns 'count' zeroed, cache line aligned shards, which must be
+// deallocated with 'free'.
+template <typename Shard>
+static Shard* allocate(int count)
+{
+  void* memory = NULL;
+  if (posix_memalign(&memory, 64, count * sizeof(Shard)) != 0) {
+    LOG(FATAL) << "Failed to allocate " << count << " shards";
+  }
+
+  Shard* shards = (Shard*) memory;
+  for (int i = 0; i < count; i++) {
+    new (&shards[i]) Shard();
+  }
+
+  return shards;
+}
+
+
+Counter::Counter(const string& _name)
+  : name(_name),
+    shards(allocate<Shard>(16))
+{
+  pthread_mutex_lock(&mutex);
+  {
+    if (counters == NULL) {
+      counters = new std::multimap<string, Counter*>();
+    }
+    counters->insert(std::make_pair(name, this));
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+Counter::~Counter()
+{
+  pthread_mutex_lock(&mutex);
+  {
+    std::multimap<string, Counter*>::iterator it = counters->find(name);
+    while (it->second != this) {
+      ++it;
+    }
+    counters->erase(it);
+  }
+  pthread_mutex_unlock(&mutex);
+
+  free(shards);
+}
+
+
+void Counter::increment(int64_t amount)
+{
+  __sync_fetch_and_add(&shards[threadIndex() % 16].value, amount);
+}
+
+
+int64_t Counter::value() const
+{
+  int64_t value = 0;
+  for (int i = 0; i < 16; i++) {
+    value += shards[i].value;
+  }
+  return value;
+}
+
+
+Histogram::Histogram(const string& _name)
+  : name(_name),
+    shards(allocate<Shard>(8))
+{
+  pthread_mutex_lock(&mutex);
+  {
+    if (histograms == NULL) {
+      histograms = new std::multimap<string, Histogram*>();
+    }
+    histograms->insert(std::make_pair(name, this));
+  }
+  pthread_mutex_unlock(&mutex);
+}
+
+
+Histogram::~Histogram()
+{
+  pthread_mutex_lock(&mutex);
+  {
+    std::multimap<string, Histogram*>::iterator it = histograms->find(name);
+    while (it->second != this) {
+      ++it;
+    }
+    histograms->erase(it);
+  }
+  pthread_mutex_unlock(&mutex);
+
+  free(shards);
+}
+
+
+void Histogram::record(const Duration& duration)
+{
+  uint64_t value = duration.ns() > 0 ? (uint64_t) duration.ns() : 0;
+
+  Shard* shard = &shards[threadIndex() % 8];
+
+  __sync_fetch_and_add(&shard->buckets[bucket(value)], 1);
+  __sync_fetch_and_add(&shard->sum, value);
+
+  uint64_t max = shard->max;
+  while (value > max &&
+         !__sync_bool_compare_and_swap(&shard->max, max, value)) {
+    max = shard->max;
+  }
+}
+
+
+void Histogram::aggregate(
+    uint64_t* buckets,
+    uint64_t* sum,
+    uint64_t* max) const
+{
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < BUCKETS; j++) {
+      buckets[j] += shards[i].buckets[j];
+    }
+    *sum += shards[i].sum;
+    *max = std::max(*max, (uint64_t) shards[i].max);
+  }
+}
+
+
+uint64_t Histogram::count() const
+{
+  uint64_t count = 0;
+  for (int i = 0; i < 8; i++) {
+    for (int j = 0; j < BUCKETS; j++) {
+      count += shards[i].buckets[j];
+    }
+  }
+  return count;
+}
+
+
+Duration Histogram::mean() const
+{
+  vector<uint64_t> buckets(BUCKETS, 0);
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  aggregate(&buckets[0], &sum, &max);
+
+  uint64_t count = 0;
+  foreach (uint64_t value, buckets) {
+    count += value;
+  }
+
+  return Nanoseconds(count > 0 ? sum / (double) count : 0);
+}
+
+
+Duration Histogram::max() const
+{
+  uint64_t max = 0;
+  for (int i = 0; i < 8; i++) {
+    max = std::max(max, (uint64_t) shards[i].max);
+  }
+  return Nanoseconds(max);
+}
+
+
+Duration Histogram::percentile(double p) const
+{
+  vector<uint64_t> buckets(BUCKETS, 0);
+  uint64_t sum = 0;
+  uint64_t max = 0;
+  aggregate(&buckets[0], &sum, &max);
+
+  return Nanoseconds(process::percentile(&buckets[0], p, max));
+}
+
 } // namespace process {
@@ -1,16 +1,25 @@
 #include <gmock/gmock.h>
 
+#include <pthread.h>
+
 #include <map>
+#include <string>
 
 #include <process/clock.hpp>
+#include <process/dispatch.hpp>
 #include <process/future.hpp>
+#include <process/http.hpp>
+#include <process/id.hpp>
+#include <process/process.hpp>
 #include <process/statistics.hpp>
 
 #include <stout/duration.hpp>
+#include <stout/strings.hpp>
 
 using namespace process;
 
 using std::map;
+using std::string;
 
 
 TEST(Statistics, set)
@@ -62,3 +71,204 @@ TEST(Statistics, truncate)
 
   Clock::resume();
 }
+
+
+class MetricsProcess : public Process<MetricsProcess>
+{
+public:
+  MetricsProcess() : ProcessBase(ID::generate("statistics_tests_metrics")) {}
+
+  int identity(int i) { return i; }
+};
+
+
+TEST(Statistics, process)
+{
+  // Instrument every event of the processes spawned below.
+  uint32_t period = sample(1);
+
+  MetricsProcess process1;
+  MetricsProcess process2;
+  PID<MetricsProcess> pid1 = spawn(process1);
+  PID<MetricsProcess> pid2 = spawn(process2);
+
+  sample(period);
+
+  Future<int> future1;
+  Future<int> future2;
+  for (int i = 0; i < 32; i++) {
+    future1 = dispatch(pid1, &MetricsProcess::identity, i);
+    future2 = dispatch(pid2, &MetricsProcess::identity, i);
+  }
+
+  future1.await();
+  future2.await();
+
+  ASSERT_TRUE(future1.isReady());
+  EXPECT_EQ(31, future1.get());
+  ASSERT_TRUE(future2.isReady());
+  EXPECT_EQ(31, future2.get());
+
+  PID<> pid;
+  pid.id = "statistics";
+  pid.ip = process::ip();
+  pid.port = process::port();
+
+  Future<http::Response> response = http::get(pid, "snapshot.json");
+
+  response.await(Seconds(5.0));
+
+  ASSERT_TRUE(response.isReady());
+
+  const string& body = response.get().body;
+
+  // Both processes are aggregated by their type, i.e., without the
+  // '(N)' suffix of their ids.
+  const string prefix = "libprocess\\/statistics_tests_metrics";
+
+  EXPECT_TRUE(strings::contains(body, prefix + "\\/event_queue_size"))
+    << body;
+  EXPECT_TRUE(strings::contains(
+      body, prefix + "\\/event_queue_latency\\/count")) << body;
+  EXPECT_TRUE(strings::contains(
+      body,
+      prefix + "\\/handler_time\\/int (MetricsProcess::*)(int)\\/p99"))
+    << body;
+  EXPECT_FALSE(strings::contains(body, "statistics_tests_metrics(")) << body;
+
+  terminate(process1);
+  wait(process1);
+  terminate(process2);
+  wait(process2);
+}
+
+
+static void* increment(void* arg)
+{
+  Counter* counter = (Counter*) arg;
+  for (int i = 0; i < 100000; i++) {
+    counter->increment();
+  }
+  return NULL;
+}
+
+
+TEST(Statistics, counter)
+{
+  Counter counter("counter");
+
+  pthread_t threads[4];
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(0, pthread_create(&threads[i], NULL, increment, &counter));
+  }
+
+  for (int i = 0; i < 4; i++) {
+    ASSERT_EQ(0, pthread_join(threads[i], NULL));
+  }
+
+  counter.decrement(5);
+
+  EXPECT_EQ(399995, counter.value());
+}
+
+
+TEST(Statistics, histogram)
+{
+  Histogram histogram("histogram");
+
+  EXPECT_EQ(0u, histogram.count());
+
+  // Record 1ms through 1000ms.
+  for (int i = 1; i <= 1000; i++) {
+    histogram.record(Milliseconds(i));
+  }
+
+  EXPECT_EQ(1000u, histogram.count());
+  EXPECT_DOUBLE_EQ(500.5, histogram.mean().ms());
+  EXPECT_DOUBLE_EQ(1000.0, histogram.max().ms());
+
+  // Percentiles are only accurate to within 1/16th.
+  EXPECT_LE(500.0, histogram.percentile(0.5).ms());
+  EXPECT_GE(500.0 * 17 / 16, histogram.percentile(0.5).ms());
+  EXPECT_LE(990.0, histogram.percentile(0.99).ms());
+  EXPECT_GE(1000.0, histogram.percentile(0.99).ms());
+  EXPECT_DOUBLE_EQ(1000.0, histogram.percentile(1.0).ms());
+
+  // Small durations are exact.
+  Histogram small("small");
+  small.record(Nanoseconds(3));
+  EXPECT_DOUBLE_EQ(3.0, small.percentile(0.5).ns());
+}
+
+
+TEST(Statistics, histogramSmall)
+{
+  // Percentiles of a few samples are the nearest rank (durations
+  // less than 32ns are exact).
+  Histogram three("three");
+  three.record(Nanoseconds(1));
+  three.record(Nanoseconds(2));
+  three.record(Nanoseconds(3));
+
+  EXPECT_DOUBLE_EQ(1.0, three.percentile(0.0).ns());
+  EXPECT_DOUBLE_EQ(1.0, three.percentile(0.3).ns());
+  EXPECT_DOUBLE_EQ(2.0, three.percentile(0.5).ns());
+  EXPECT_DOUBLE_EQ(3.0, three.percentile(0.9).ns());
+  EXPECT_DOUBLE_EQ(3.0, three.percentile(1.0).ns());
+
+  Histogram twenty("twenty");
+  for (int i = 1; i <= 20; i++) {
+    twenty.record(Nanoseconds(i));
+  }
+
+  EXPECT_DOUBLE_EQ(10.0, twenty.percentile(0.5).ns());
+  EXPECT_DOUBLE_EQ(18.0, twenty.percentile(0.9).ns());
+  EXPECT_DOUBLE_EQ(20.0, twenty.percentile(0.99).ns());
+
+  // The largest of 50 values is their p99.
+  Histogram fifty("fifty");
+  for (int i = 1; i <= 50; i++) {
+    fifty.record(Milliseconds(i));
+  }
+
+  EXPECT_DOUBLE_EQ(50.0, fifty.percentile(0.99).ms());
+}
+
+
+TEST(Statistics, snapshot)
+{
+  Counter counter1("statistics_tests/counter");
+  Counter counter2("statistics_tests/counter");
+  Histogram histogram("statistics_tests/histogram");
+
+  // Counters with the same name get aggregated.
+  counter1.increment(2);
+  counter2.increment(3);
+
+  histogram.record(Milliseconds(5));
+
+  PID<> pid;
+  pid.id = "statistics";
+  pid.ip = process::ip();
+  pid.port = process::port();
+
+  Future<http::Response> response = http::get(pid, "snapshot.json");
+
+  response.await(Seconds(5.0));
+
+  ASSERT_TRUE(response.isReady());
+
+  const string& body = response.get().body;
+
+  size_t index = body.find("\"statistics_tests\\/counter\"");
+  ASSERT_NE(string::npos, index) << body;
+
+  const string counter =
+    body.substr(index, body.find('}', index) + 1 - index);
+  EXPECT_TRUE(strings::contains(counter, "\"value\":5}")) << counter;
+
+  EXPECT_TRUE(strings::contains(body, "statistics_tests\\/histogram\\/p99"))
+    << body;
+  EXPECT_TRUE(strings::contains(body, "statistics_tests\\/histogram\\/count"))
+    << body;
+}
@@ -26,7 +26,10 @@
 #include <stout/duration.hpp>
 #include <stout/os.hpp>
 
+#include "decoder.hpp"
 #include "encoder.hpp"
+#include "event_queue.hpp"
+#include "timer_wheel.hpp"
 
 using namespace process;
 
@@ -1088,6 +1091,77 @@ TEST(Process, remote)
 }
 
 
+// Receives data on the socket until it contains 'what' (or the
+// socket times out or gets closed).
+static bool receive(int s, const std::string& what, std::string* data)
+{
+  while (data->find(what) == std::string::npos) {
+    char buffer[1024];
+    ssize_t length = recv(s, buffer, sizeof(buffer), 0);
+    if (length <= 0) {
+      return false;
+    }
+    data->append(buffer, length);
+  }
+  return true;
+}
+
+
+TEST(Process, Pooling)
+{
+  ASSERT_TRUE(GTEST_IS_THREADSAFE);
+
+  // Listen for connections as though we were another node.
+  int s = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+
+  ASSERT_LE(0, s);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = PF_INET;
+  addr.sin_port = 0;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  ASSERT_EQ(0, bind(s, (sockaddr*) &addr, sizeof(addr)));
+  ASSERT_EQ(0, listen(s, 16));
+
+  socklen_t addrlen = sizeof(addr);
+  ASSERT_EQ(0, getsockname(s, (sockaddr*) &addr, &addrlen));
+
+  const UPID to("receiver", addr.sin_addr.s_addr, ntohs(addr.sin_port));
+
+  post(to, "first");
+
+  int c = accept(s, NULL, NULL);
+
+  ASSERT_LE(0, c);
+
+  timeval timeout;
+  timeout.tv_sec = 5;
+  timeout.tv_usec = 0;
+  ASSERT_EQ(0, setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)));
+
+  std::string data;
+  ASSERT_TRUE(receive(c, "/receiver/first", &data));
+
+  // Give the socket a chance to become idle before sending again.
+  usleep(100000);
+
+  post(to, "second");
+
+  // The second message should reuse the (now idle) connection ...
+  ASSERT_TRUE(receive(c, "/receiver/second", &data));
+
+  // ... rather than make a new one.
+  Try<Nothing> nonblock = os::nonblock(s);
+  ASSERT_TRUE(nonblock.isSome());
+  EXPECT_EQ(-1, accept(s, NULL, NULL));
+
+  close(c);
+  close(s);
+}
+
+
 class HttpProcess : public Process<HttpProcess>
 {
 public:
@@ -1351,6 +1425,344 @@ TEST(HTTP, encode)
 }
 
 
+TEST(Process, EventQueue)
+{
+  EventQueue queue;
+
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.dequeue() == NULL);
+
+  queue.enqueue(new ExitedEvent(UPID("1", 0, 0)));
+  queue.enqueue(new ExitedEvent(UPID("2", 0, 0)));
+
+  EXPECT_FALSE(queue.empty());
+
+  // Injected events go in front (most recently injected first).
+  queue.enqueue(new ExitedEvent(UPID("3", 0, 0)), true);
+  queue.enqueue(new ExitedEvent(UPID("4", 0, 0)), true);
+
+  Event* event = queue.dequeue();
+  ASSERT_TRUE(event != NULL);
+  EXPECT_EQ("4", event->as<ExitedEvent>().pid.id);
+  delete event;
+
+  // Events enqueued after a batch has been taken still come last,
+  // but injected events still go in front.
+  queue.enqueue(new ExitedEvent(UPID("5", 0, 0)));
+  queue.enqueue(new TerminateEvent(UPID()), true);
+
+  event = queue.dequeue();
+  ASSERT_TRUE(event != NULL);
+  EXPECT_TRUE(event->is<TerminateEvent>());
+  delete event;
+
+  const char* expected[] = { "3", "1", "2", "5" };
+
+  for (int i = 0; i < 4; i++) {
+    event = queue.dequeue();
+    ASSERT_TRUE(event != NULL);
+    EXPECT_EQ(expected[i], event->as<ExitedEvent>().pid.id);
+    delete event;
+  }
+
+  EXPECT_TRUE(queue.empty());
+  EXPECT_TRUE(queue.dequeue() == NULL);
+
+  // Any remaining events are deleted with the queue.
+  queue.enqueue(new ExitedEvent(UPID("6", 0, 0)));
+}
+
+
+TEST(Process, Framing)
+{
+  const UPID from("sender", 0x0100007f, 1234);
+  const UPID to("receiver", 0x0100007f, 5678);
+
+  // Start with a regular (HTTP) message, then upgrade and send a
+  // couple of framed messages (one without a body).
+  std::string data;
+
+  Message* message = new Message();
+  message->name = "http";
+  message->from = from;
+  message->to = to;
+  message->body = "hello world";
+
+  data += MessageEncoder::encode(message);
+  delete message;
+
+  data += MessageEncoder::upgrade(from);
+
+  message = new Message();
+  message->name = "framed";
+  message->from = from;
+  message->to = to;
+  message->body = std::string("\0binary\r\n", 10);
+
+  data += MessageEncoder::frame(message);
+
+  message->body.clear();
+
+  data += MessageEncoder::frame(message);
+  delete message;
+
+  // Feed the decoder a few bytes at a time so that requests and
+  // framed messages get split across calls.
+  DataDecoder decoder((Socket()));
+
+  std::deque<http::Request*> requests;
+  std::deque<Message*> messages;
+
+  for (size_t index = 0; index < data.size(); index += 7) {
+    size_t length = std::min<size_t>(7, data.size() - index);
+    foreach (http::Request* request, decoder.decode(&data[index], length)) {
+      requests.push_back(request);
+    }
+    foreach (Message* message, decoder.decoded()) {
+      messages.push_back(message);
+    }
+    ASSERT_FALSE(decoder.failed());
+  }
+
+  ASSERT_EQ(2u, requests.size());
+
+  EXPECT_EQ("/receiver/http", requests[0]->path);
+  EXPECT_EQ("hello world", requests[0]->body);
+  EXPECT_EQ(Option<std::string>::some(LIBPROCESS_FRAMING),
+            requests[0]->headers.get("Libprocess-Framing"));
+
+  EXPECT_EQ(Option<std::string>::some(LIBPROCESS_FRAMING),
+            requests[1]->headers.get("Upgrade"));
+
+  ASSERT_EQ(2u, messages.size());
+
+  EXPECT_EQ("framed", messages[0]->name);
+  EXPECT_EQ(from, messages[0]->from);
+  EXPECT_EQ("receiver", messages[0]->to.id);
+  EXPECT_EQ(std::string("\0binary\r\n", 10), messages[0]->body);
+
+  EXPECT_EQ("framed", messages[1]->name);
+  EXPECT_EQ(from, messages[1]->from);
+  EXPECT_EQ("", messages[1]->body);
+
+  foreach (http::Request* request, requests) {
+    delete request;
+  }
+
+  foreach (Message* message, messages) {
+    delete message;
+  }
+}
+
+
+TEST(Process, FramingSplit)
+{
+  const UPID from("sender", 0x0100007f, 1234);
+  const UPID to("receiver", 0x0100007f, 5678);
+
+  Message message;
+  message.name = "framed";
+  message.from = from;
+  message.to = to;
+  message.body = "body";
+
+  const std::string data =
+    MessageEncoder::upgrade(from) + MessageEncoder::frame(&message);
+
+  // Split the data into two reads at every possible position,
+  // including in between the CR and LF ending the upgrade request.
+  for (size_t split = 0; split <= data.size(); split++) {
+    DataDecoder decoder((Socket()));
+
+    std::deque<http::Request*> requests = decoder.decode(data.data(), split);
+    std::deque<http::Request*> more =
+      decoder.decode(data.data() + split, data.size() - split);
+    requests.insert(requests.end(), more.begin(), more.end());
+
+    std::deque<Message*> messages = decoder.decoded();
+
+    ASSERT_FALSE(decoder.failed()) << "split at " << split;
+    ASSERT_EQ(1u, requests.size()) << "split at " << split;
+    ASSERT_EQ(1u, messages.size()) << "split at " << split;
+
+    EXPECT_EQ("framed", messages[0]->name);
+    EXPECT_EQ(from, messages[0]->from);
+    EXPECT_EQ("body", messages[0]->body);
+
+    delete requests[0];
+    delete messages[0];
+  }
+}
+
+
+TEST(Process, FramingTooLarge)
+{
+  const UPID from("sender", 0x0100007f, 1234);
+
+  // A frame header claiming (almost) 4GB for each of the fields.
+  std::string data = MessageEncoder::upgrade(from);
+  data.append(MessageEncoder::FRAME_HEADER_SIZE, '\xff');
+
+  DataDecoder decoder((Socket()));
+
+  std::deque<http::Request*> requests =
+    decoder.decode(data.data(), data.size());
+
+  ASSERT_EQ(1u, requests.size());
+  delete requests[0];
+
+  EXPECT_TRUE(decoder.failed());
+  EXPECT_TRUE(decoder.decoded().empty());
+
+  // A failed decoder doesn't decode (or buffer) anything anymore.
+  EXPECT_TRUE(decoder.decode(data.data(), data.size()).empty());
+  EXPECT_TRUE(decoder.failed());
+}
+
+
+TEST(Process, Coalescing)
+{
+  Message* message = new Message();
+  message->name = "name";
+  message->from = UPID("from", 0x0100007f, 1234);
+  message->to = UPID("to", 0x0100007f, 5678);
+  message->body = "body";
+
+  const std::string expected =
+    "prefix" +
+    MessageEncoder::encode(message) +
+    MessageEncoder::frame(message);
+
+  Message* copy = new Message(*message);
+
+  DataEncoder encoder("prefix");
+  encoder.coalesce(new MessageEncoder(message));
+  encoder.coalesce(new MessageEncoder(copy, true));
+
+  EXPECT_EQ(2u, encoder.coalescing());
+  EXPECT_EQ(expected.size(), encoder.remaining());
+
+  // Send the data a few bytes (and at most a few iovecs) at a time.
+  std::string data;
+  while (encoder.remaining() > 0) {
+    struct iovec iov[2];
+    int count = encoder.next(iov, 2);
+    ASSERT_GT(count, 0);
+    ASSERT_LE(count, 2);
+
+    size_t length = std::min<size_t>(5, iov[0].iov_len);
+    data.append((const char*) iov[0].iov_base, length);
+    encoder.advance(length);
+  }
+
+  EXPECT_EQ(expected, data);
+
+  struct iovec iov[1];
+  EXPECT_EQ(0, encoder.next(iov, 1));
+}
+
+
+TEST(Process, TimerWheel)
+{
+  TimerWheel<int> wheel;
+
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_TRUE(wheel.next().isNone());
+  EXPECT_TRUE(wheel.advance(100.0).empty());
+
+  // Timers expire in order of their timeouts (even within a tick)
+  // and only once their timeout has been reached.
+  wheel.add(1, 100.0005, 1);
+  wheel.add(2, 100.0002, 2);
+  wheel.add(3, 100.5, 3);
+  wheel.add(4, 3700.0, 4); // Needs to get cascaded a few levels.
+  wheel.add(5, 100.0002, 5);
+
+  EXPECT_EQ(5u, wheel.size());
+  ASSERT_TRUE(wheel.next().isSome());
+  EXPECT_LE(wheel.next().get(), 100.0002);
+
+  EXPECT_TRUE(wheel.advance(100.0001).empty());
+
+  std::list<int> timers = wheel.advance(100.0005);
+  ASSERT_EQ(3u, timers.size());
+  EXPECT_EQ(2, timers.front()); timers.pop_front();
+  EXPECT_EQ(5, timers.front()); timers.pop_front();
+  EXPECT_EQ(1, timers.front()); timers.pop_front();
+
+  ASSERT_TRUE(wheel.next().isSome());
+  EXPECT_GT(wheel.next().get(), 100.0005);
+  EXPECT_LE(wheel.next().get(), 100.5);
+
+  EXPECT_TRUE(wheel.cancel(3));
+  EXPECT_FALSE(wheel.cancel(3));
+
+  timers = wheel.advance(3699.9999);
+  EXPECT_TRUE(timers.empty());
+  ASSERT_TRUE(wheel.next().isSome());
+  EXPECT_LE(wheel.next().get(), 3700.0);
+
+  // Timers that should have already expired expire next time.
+  wheel.add(6, 1.0, 6);
+
+  timers = wheel.advance(3700.0);
+  ASSERT_EQ(2u, timers.size());
+  EXPECT_EQ(6, timers.front());
+  EXPECT_EQ(4, timers.back());
+
+  EXPECT_TRUE(wheel.empty());
+  EXPECT_TRUE(wheel.next().isNone());
+
+  // Compare against a (sorted) map for lots of random timers,
+  // cancellations, and advances of varying lengths.
+  std::map<double, int> reference;
+  double now = 3700.0;
+  int id = 100;
+
+  srand(42);
+
+  for (int i = 0; i < 10000; i++) {
+    int action = rand() % 10;
+    if (action < 6) {
+      double timeout = now + ((rand() % 4) == 0
+        ? (rand() % 100000) / 10.0 // Up to ~3 hours.
+        : (rand() % 100000) / 100000.0); // Up to a second.
+      if (reference.count(timeout) == 0) {
+        wheel.add(id, timeout, id);
+        reference[timeout] = id++;
+      }
+    } else if (action < 8 && !reference.empty()) {
+      std::map<double, int>::iterator it = reference.begin();
+      std::advance(it, rand() % reference.size());
+      EXPECT_TRUE(wheel.cancel(it->second));
+      reference.erase(it);
+    } else {
+      now += (rand() % 4) == 0
+        ? (rand() % 10000) / 10.0
+        : (rand() % 1000) / 10000.0;
+
+      timers = wheel.advance(now);
+
+      while (!reference.empty() && reference.begin()->first <= now) {
+        ASSERT_FALSE(timers.empty());
+        EXPECT_EQ(reference.begin()->second, timers.front());
+        timers.pop_front();
+        reference.erase(reference.begin());
+      }
+
+      EXPECT_TRUE(timers.empty());
+      ASSERT_EQ(reference.size(), wheel.size());
+
+      if (!reference.empty()) {
+        ASSERT_TRUE(wheel.next().isSome());
+        EXPECT_GT(wheel.next().get(), now);
+        EXPECT_LE(wheel.next().get(), reference.begin()->first);
+      }
+    }
+  }
+}
+
+
 TEST(Process, BufferedRead)
 {
   // 128 Bytes.
@@ -0,0 +1,367 @@
+#ifndef __TIMER_WHEEL_HPP__
+#define __TIMER_WHEEL_HPP__
+
+#include <math.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <limits>
+#include <list>
+#include <vector>
+
+#include <stout/foreach.hpp>
+#include <stout/hashmap.hpp>
+#include <stout/option.hpp>
+
+
+namespace process {
+
+// A hierarchical timing wheel (see "Hashed and Hierarchical Timing
+// Wheels" by Varghese and Lauck) used to keep track of outstanding
+// timers. Adding and canceling a timer is O(1). Time is divided into
+// ticks of a millisecond and each level of the wheel has SLOTS
+// slots, where a slot at level 'k' spans SLOTS^k ticks. A timer goes
+// into the lowest level that can hold it and gets "cascaded" down to
+// lower levels as time advances, until it reaches level 0 where it
+// expires. Advancing the wheel skips over ticks for which nothing
+// needs to be done, so advancing across large spans of time (e.g.,
+// when the clock is paused and advanced in tests) is cheap.
+//
+// Note that a timer still only expires once 'now' is greater than or
+// equal to it's timeout (i.e., the resolution only determines which
+// slot a timer goes into, not when it expires).
+//
+// The wheel is not thread-safe, callers must synchronize access.
+template <typename T>
+class TimerWheel
+{
+public:
+  TimerWheel() : current(0), earliest(Option<double>::none())
+  {
+    for (int level = 0; level < LEVELS; level++) {
+      occupied[level] = 0;
+      for (int slot = 0; slot < SLOTS; slot++) {
+        slots[level][slot] = NULL;
+      }
+    }
+  }
+
+  ~TimerWheel()
+  {
+    foreachvalue (Entry* entry, entries) {
+      delete entry;
+    }
+  }
+
+  // Adds a timer with the specified (unique) id and timeout. Timers
+  // with the same timeout expire in order of their ids.
+  void add(uint64_t id, double timeout, const T& t)
+  {
+    Entry* entry = new Entry(id, timeout, ticks(timeout), t);
+
+    // An empty wheel can be moved to any point in time.
+    if (entries.empty()) {
+      current = entry->tick;
+    }
+
+    entries[id] = entry;
+    place(entry);
+
+    if (earliest.isNone() || timeout < earliest.get()) {
+      earliest = timeout;
+    }
+  }
+
+  // Cancels the timer with the specified id, returns false if there
+  // is no such (outstanding) timer.
+  bool cancel(uint64_t id)
+  {
+    typename hashmap<uint64_t, Entry*>::iterator it = entries.find(id);
+    if (it == entries.end()) {
+      return false;
+    }
+
+    Entry* entry = it->second;
+    entries.erase(it);
+    unlink(entry);
+    delete entry;
+
+    // Note that we don't update 'earliest' since it's still a valid
+    // lower bound (we'll recompute it next time we advance).
+    return true;
+  }
+
+  // Advances the wheel to 'now' and returns all the timers that have
+  // timed out (ordered by their timeout, then id).
+  std::list<T> advance(double now)
+  {
+    std::vector<Entry*> expired;
+
+    const uint64_t target = ticks(now);
+
+    if (entries.empty()) {
+      current = target;
+    } else {
+      expire(now, &expired);
+
+      while (current < target) {
+        // Jump to the next tick that has any work to do.
+        current = std::min(target, next(current));
+
+        // Cascade all the levels that "wrapped" at this tick (i.e.,
+        // all levels for which this tick is on a slot boundary).
+        for (int level = 1; level < LEVELS; level++) {
+          if ((current & ((1ULL << (BITS * level)) - 1)) != 0) {
+            break;
+          }
+          cascade(level, (current >> (BITS * level)) & MASK);
+        }
+
+        expire(now, &expired);
+      }
+    }
+
+    std::sort(expired.begin(), expired.end(), Entry::compare);
+
+    std::list<T> timers;
+    foreach (Entry* entry, expired) {
+      timers.push_back(entry->t);
+      delete entry;
+    }
+
+    earliest = lowerbound(now);
+
+    return timers;
+  }
+
+  // Returns a lower bound on the earliest timeout of all the
+  // outstanding timers (or none if there are no outstanding timers).
+  // Right after advancing the wheel to 'now' the lower bound is
+  // always greater than 'now' (since every timer with an earlier
+  // timeout has expired).
+  Option<double> next() const
+  {
+    return entries.empty() ? Option<double>::none() : earliest;
+  }
+
+  size_t size() const
+  {
+    return entries.size();
+  }
+
+  bool empty() const
+  {
+    return entries.empty();
+  }
+
+private:
+  static const int BITS = 6;
+  static const int SLOTS = 1 << BITS;
+  static const uint64_t MASK = SLOTS - 1;
+  static const int LEVELS = 6; // Spans 2^36 ticks (> 2 years).
+
+  // Seconds per tick.
+  static double resolution() { return 0.001; }
+
+  static uint64_t ticks(double seconds)
+  {
+    return seconds > 0 ? (uint64_t) (seconds / resolution()) : 0;
+  }
+
+  struct Entry
+  {
+    Entry(uint64_t _id, double _timeout, uint64_t _tick, const T& _t)
+      : id(_id), timeout(_timeout), tick(_tick), t(_t),
+        level(0), slot(0), prev(NULL), next(NULL) {}
+
+    static bool compare(const Entry* left, const Entry* right)
+    {
+      return left->timeout < right->timeout ||
+        (left->timeout == right->timeout && left->id < right->id);
+    }
+
+    const uint64_t id;
+    const double timeout;
+    const uint64_t tick;
+    const T t;
+
+    // Location in the wheel.
+    int level;
+    int slot;
+    Entry* prev;
+    Entry* next;
+  };
+
+  // Puts the entry into the slot of the lowest level that can hold it
+  // (relative to the current tick).
+  void place(Entry* entry)
+  {
+    // Timers that should have already expired go in the current slot
+    // (where they'll expire next time we advance).
+    uint64_t tick = std::max(entry->tick, current);
+    uint64_t delta = tick - current;
+
+    // Timers beyond the span of the wheel go as far out as possible
+    // (and get placed again when they get cascaded).
+    if (delta >= (1ULL << (BITS * LEVELS))) {
+      delta = (1ULL << (BITS * LEVELS)) - 1;
+      tick = current + delta;
+    }
+
+    int level = 0;
+    while (delta >= (1ULL << (BITS * (level + 1)))) {
+      level++;
+    }
+
+    entry->level = level;
+    entry->slot = (tick >> (BITS * level)) & MASK;
+    entry->prev = NULL;
+    entry->next = slots[level][entry->slot];
+
+    if (entry->next != NULL) {
+      entry->next->prev = entry;
+    }
+
+    slots[level][entry->slot] = entry;
+    occupied[level] |= 1ULL << entry->slot;
+  }
+
+  void unlink(Entry* entry)
+  {
+    if (entry->prev != NULL) {
+      entry->prev->next = entry->next;
+    } else {
+      slots[entry->level][entry->slot] = entry->next;
+      if (entry->next == NULL) {
+        occupied[entry->level] &= ~(1ULL << entry->slot);
+      }
+    }
+
+    if (entry->next != NULL) {
+      entry->next->prev = entry->prev;
+    }
+  }
+
+  // Places all the entries in the specified slot again (which will
+  // move them to a lower level).
+  void cascade(int level, int slot)
+  {
+    Entry* entry = slots[level][slot];
+    slots[level][slot] = NULL;
+    occupied[level] &= ~(1ULL << slot);
+
+    while (entry != NULL) {
+      Entry* next = entry->next;
+      place(entry);
+      entry = next;
+    }
+  }
+
+  // Removes the entries in the current slot that have timed out.
+  void expire(double now, std::vector<Entry*>* expired)
+  {
+    Entry* entry = slots[0][current & MASK];
+    while (entry != NULL) {
+      Entry* next = entry->next;
+      if (entry->timeout <= now) {
+        entries.erase(entry->id);
+        unlink(entry);
+        expired->push_back(entry);
+      }
+      entry = next;
+    }
+  }
+
+  // Rotates 'bits' right so that bit 'start' becomes bit 0.
+  static uint64_t rotate(uint64_t bits, int start)
+  {
+    return start == 0 ? bits : (bits >> start) | (bits << (SLOTS - start));
+  }
+
+  // Returns the first tick after 'tick' at which either a level 0
+  // slot has entries or a non-empty slot needs to be cascaded.
+  uint64_t next(uint64_t tick) const
+  {
+    uint64_t result = std::numeric_limits<uint64_t>::max();
+
+    // Level 0 slots hold entries for at most the next SLOTS - 1 ticks
+    // (the current slot is handled separately, see 'expire').
+    uint64_t bits = rotate(occupied[0], (tick + 1) & MASK);
+    bits &= ~(1ULL << (SLOTS - 1));
+    if (bits != 0) {
+      result = tick + 1 + __builtin_ctzll(bits);
+    }
+
+    // A slot at a higher level gets cascaded at the start of the
+    // next block (of SLOTS^level ticks) that maps to that slot.
+    for (int level = 1; level < LEVELS; level++) {
+      uint64_t block = tick >> (BITS * level);
+      bits = rotate(occupied[level], (block + 1) & MASK);
+      if (bits != 0) {
+        block += 1 + __builtin_ctzll(bits);
+        result = std::min(result, block << (BITS * level));
+      }
+    }
+
+    return result;
+  }
+
+  // Computes a lower bound on the earliest timeout after having
+  // advanced to 'now'.
+  Option<double> lowerbound(double now) const
+  {
+    if (entries.empty()) {
+      return Option<double>::none();
+    }
+
+    // Find the first level 0 slot with entries, starting from the
+    // current slot, and use the exact earliest timeout in that slot.
+    Option<double> result = Option<double>::none();
+
+    uint64_t bits = rotate(occupied[0], current & MASK);
+    if (bits != 0) {
+      int slot = (current + __builtin_ctzll(bits)) & MASK;
+      for (Entry* entry = slots[0][slot]; entry != NULL; entry = entry->next) {
+        if (result.isNone() || entry->timeout < result.get()) {
+          result = entry->timeout;
+        }
+      }
+    }
+
+    // Entries at higher levels don't time out before they need to
+    // get cascaded.
+    uint64_t tick = next(current);
+    if (tick != std::numeric_limits<uint64_t>::max()) {
+      double timeout = tick * resolution();
+      if (result.isNone() || timeout < result.get()) {
+        result = timeout;
+      }
+    }
+
+    // Every outstanding timer times out after 'now', so make sure
+    // rounding errors converting ticks to seconds don't suggest
+    // otherwise (which could cause us to spin).
+    if (result.isSome() && result.get() <= now) {
+      result = nextafter(now, std::numeric_limits<double>::max());
+    }
+
+    return result;
+  }
+
+  // Not copyable, not assignable.
+  TimerWheel(const TimerWheel&);
+  TimerWheel& operator = (const TimerWheel&);
+
+  uint64_t current; // Current tick.
+
+  Entry* slots[LEVELS][SLOTS];
+  uint64_t occupied[LEVELS]; // Bitmap of slots with entries.
+
+  hashmap<uint64_t, Entry*> entries;
+
+  Option<double> earliest; // Lower bound on the earliest timeout.
+};
+
+} // namespace process {
+
+#endif // __TIMER_WHEEL_HPP__